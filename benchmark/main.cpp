@@ -0,0 +1,764 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+// sessions fed by test sources send to receiving sessions in the same
+//   process, so the whole path from capture to the output widget is
+//   measured without cameras, microphones or network.  every captured frame
+//   gets its number stamped into the top left corner, which is read back
+//   from the output widget to get the capture-to-frame latency.  the packets
+//   can be sent through a simulated bad network, to see how well freezes
+//   and audio gaps are avoided.
+
+#include "psimedia.h"
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QLibrary>
+#include <QTimer>
+#include <QtMath>
+#include <QtPlugin>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <new>
+#include <vector>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#define AUDIO_SOURCE "audiotestsrc is-live=true"
+#define AUDIO_SINK "fakesink sync=true"
+#define VIDEO_SOURCE "videotestsrc is-live=true horizontal-speed=4"
+
+#define VIDEO_FPS 30
+
+// a white and a black guard block, then the bits of the frame number,
+//   lowest first
+#define STAMP_BLOCK 16
+#define STAMP_BITS 20
+#define STAMP_FRAMES (1 << STAMP_BITS)
+
+// how long a session may take to start or stop, in ms
+#define SESSION_TIMEOUT 10000
+
+// a frame shown this much later than usual counts as a freeze, in us
+#define FREEZE_MIN_EXTRA 150000
+
+//----------------------------------------------------------------------------
+// Counters
+//----------------------------------------------------------------------------
+static std::atomic<quint64> g_allocations { 0 };
+
+#ifdef __GLIBC__
+// glibc lets the program replace malloc, for the libraries too, so glib,
+//   gstreamer and qt allocations are all counted.  operator new ends up
+//   here as well.
+#define ALLOCATIONS_COUNTED "malloc"
+
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t n, std::size_t size);
+void *__libc_realloc(void *p, std::size_t size);
+
+void *malloc(std::size_t size) noexcept
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(std::size_t n, std::size_t size) noexcept
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, std::size_t size) noexcept
+{
+    if (!p)
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, size);
+}
+}
+#else
+// elsewhere only allocations through operator new are counted.  on
+//   platforms with symbol interposition this includes those of the
+//   provider and qt, but never those of glib and gstreamer.
+#define ALLOCATIONS_COUNTED "operator new"
+
+void *operator new(std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+#endif
+
+static qint64 now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// cpu time of the whole process in us, or -1 where we can't tell
+static qint64 cpu_time_us()
+{
+#ifdef Q_OS_UNIX
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return -1;
+    return qint64(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#else
+    return -1;
+#endif
+}
+
+//----------------------------------------------------------------------------
+// Frame stamping
+//----------------------------------------------------------------------------
+static std::atomic<quint32>             g_nextFrame { 0 };
+static std::vector<std::atomic<qint64>> g_captureTimes(STAMP_FRAMES); // by frame number
+
+// audio the decoders had to make up for lost packets, in us
+static std::atomic<quint64> g_concealed { 0 };
+
+static void stamp_frame(GstVideoFrame *frame, quint32 number)
+{
+    const GstVideoFormatInfo *finfo  = frame->info.finfo;
+    const int                 blocks = 2 + STAMP_BITS;
+    if (GST_VIDEO_FRAME_WIDTH(frame) < blocks * STAMP_BLOCK || GST_VIDEO_FRAME_HEIGHT(frame) < STAMP_BLOCK)
+        return;
+
+    // writing bytes only works for formats of 8 bits per component
+    for (guint c = 0; c < GST_VIDEO_FRAME_N_COMPONENTS(frame); ++c) {
+        if (GST_VIDEO_FORMAT_INFO_DEPTH(finfo, c) != 8)
+            return;
+    }
+
+    for (guint c = 0; c < GST_VIDEO_FRAME_N_COMPONENTS(frame); ++c) {
+        guint8 *data    = GST_VIDEO_FRAME_COMP_DATA(frame, c);
+        int     stride  = GST_VIDEO_FRAME_COMP_STRIDE(frame, c);
+        int     pstride = GST_VIDEO_FRAME_COMP_PSTRIDE(frame, c);
+        int     bw      = GST_VIDEO_FORMAT_INFO_SCALE_WIDTH(finfo, c, STAMP_BLOCK);
+        int     bh      = GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT(finfo, c, STAMP_BLOCK);
+
+        for (int b = 0; b < blocks; ++b) {
+            bool   white = b == 0 || (b >= 2 && (number >> (b - 2)) & 1);
+            guint8 value;
+            if (GST_VIDEO_FORMAT_INFO_HAS_ALPHA(finfo) && c == GST_VIDEO_COMP_A)
+                value = 255;
+            else if (GST_VIDEO_FORMAT_INFO_IS_YUV(finfo) && c != GST_VIDEO_COMP_Y)
+                value = 128;
+            else
+                value = white ? 255 : 0;
+
+            for (int y = 0; y < bh; ++y) {
+                guint8 *p = data + y * stride + b * bw * pstride;
+                for (int x = 0; x < bw; ++x)
+                    p[x * pstride] = value;
+            }
+        }
+    }
+}
+
+static GstPadProbeReturn stamp_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    Q_UNUSED(data);
+
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    if (!caps)
+        return GST_PAD_PROBE_OK;
+    GstVideoInfo vinfo;
+    bool         ok = gst_video_info_from_caps(&vinfo, caps);
+    gst_caps_unref(caps);
+    if (!ok)
+        return GST_PAD_PROBE_OK;
+
+    GstBuffer *buffer             = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+    GST_PAD_PROBE_INFO_DATA(info) = buffer;
+
+    GstVideoFrame frame;
+    if (!gst_video_frame_map(&frame, &vinfo, buffer, GST_MAP_WRITE))
+        return GST_PAD_PROBE_OK;
+    quint32 number = g_nextFrame.fetch_add(1, std::memory_order_relaxed) % STAMP_FRAMES;
+    stamp_frame(&frame, number);
+    gst_video_frame_unmap(&frame);
+
+    g_captureTimes[number].store(now_us(), std::memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+// the jitter buffer sends a gap event for every packet given up on, which
+//   the decoder fills with concealment (or with fec of the next packet)
+static GstPadProbeReturn gap_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    Q_UNUSED(pad);
+    Q_UNUSED(data);
+
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_GAP) {
+        GstClockTime duration;
+        gst_event_parse_gap(event, nullptr, &duration);
+        if (GST_CLOCK_TIME_IS_VALID(duration))
+            g_concealed.fetch_add(duration / GST_USECOND, std::memory_order_relaxed);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// the provider builds the pipelines, so catch the test sources and the
+//   audio decoders when they are put into a bin
+static gboolean element_added_hook(GSignalInvocationHint *hint, guint n_params, const GValue *params, gpointer data)
+{
+    Q_UNUSED(hint);
+    Q_UNUSED(data);
+
+    if (n_params < 2)
+        return TRUE;
+
+    GstElement        *element = GST_ELEMENT(g_value_get_object(&params[1]));
+    GstElementFactory *factory = gst_element_get_factory(element);
+    if (!factory)
+        return TRUE;
+
+    const gchar *name = gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory));
+    if (qstrcmp(name, "videotestsrc") == 0) {
+        GstPad *pad = gst_element_get_static_pad(element, "src");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, stamp_probe, nullptr, nullptr);
+        gst_object_unref(pad);
+    } else if (qstrcmp(name, "opusdec") == 0) {
+        GstPad *pad = gst_element_get_static_pad(element, "sink");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, gap_probe, nullptr, nullptr);
+        gst_object_unref(pad);
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------------
+// OutputWidget
+//----------------------------------------------------------------------------
+class OutputWidget : public PsiMedia::VideoWidget {
+public:
+    QSize         videoSize;
+    bool          measuring = false;
+    QList<qint64> latencies;      // in us, of the frames shown while measuring
+    qint64        freezeTime = 0; // us, while measuring
+
+protected:
+    void paintEvent(QPaintEvent *event) override
+    {
+        VideoWidget::paintEvent(event);
+        if (rendering)
+            return;
+
+        // what was painted can't be read back from in here
+        qint64 shown = now_us();
+        QTimer::singleShot(0, this, [this, shown]() { readStamp(shown); });
+    }
+
+private:
+    bool    rendering       = false;
+    quint32 lastNumber      = STAMP_FRAMES;
+    qint64  lastShown       = 0;
+    double  averageInterval = 0; // us, between frames shown
+
+    void readStamp(qint64 shown)
+    {
+        // the frame is scaled into the widget keeping the aspect ratio
+        QSize source = sizeHint().isValid() ? sizeHint() : videoSize;
+        QSize target = source.scaled(size(), Qt::KeepAspectRatio);
+        if (target.isEmpty())
+            return;
+        double scale = double(target.width()) / source.width();
+        QRect  stamp((width() - target.width()) / 2, (height() - target.height()) / 2,
+                     qCeil((2 + STAMP_BITS) * STAMP_BLOCK * scale), qCeil(STAMP_BLOCK * scale));
+
+        // only render the stamp, so reading it costs next to nothing
+        QImage image(stamp.size(), QImage::Format_RGB32);
+        image.fill(Qt::black);
+        rendering = true;
+        render(&image, QPoint(), QRegion(stamp));
+        rendering = false;
+
+        auto bit = [&](int block) {
+            QPoint p(int((block * STAMP_BLOCK + STAMP_BLOCK / 2) * scale), int(STAMP_BLOCK / 2 * scale));
+            return image.valid(p) && qGray(image.pixel(p)) > 128;
+        };
+
+        // no stamp, e.g. a frame that didn't decode properly
+        if (!bit(0) || bit(1))
+            return;
+
+        quint32 number = 0;
+        for (int n = 0; n < STAMP_BITS; ++n) {
+            if (bit(2 + n))
+                number |= 1 << n;
+        }
+
+        // painted again without a new frame
+        if (number == lastNumber)
+            return;
+        lastNumber = number;
+
+        // a freeze is how webrtc counts them: at least three times the
+        //   usual interval, and noticeably longer
+        if (lastShown) {
+            double interval = shown - lastShown;
+            if (averageInterval > 0
+                && interval > std::max(3 * averageInterval, averageInterval + FREEZE_MIN_EXTRA)) {
+                if (measuring)
+                    freezeTime += qint64(interval);
+            } else
+                averageInterval = averageInterval > 0 ? averageInterval * 0.9 + interval * 0.1 : interval;
+        }
+        lastShown = shown;
+
+        qint64 captured = g_captureTimes[number].load(std::memory_order_relaxed);
+        if (measuring && captured && captured <= shown)
+            latencies += shown - captured;
+    }
+};
+
+//----------------------------------------------------------------------------
+// Loopback
+//----------------------------------------------------------------------------
+// packets sent during the measurement
+class Traffic {
+public:
+    quint64 rtpPackets = 0;
+    quint64 rtpBytes   = 0;
+    quint64 allPackets = 0; // rtp and rtcp, both ways
+};
+
+static Traffic g_traffic;
+
+// runs the event loop until the signal is emitted, the session fails or
+//   time is up
+static bool wait_for(PsiMedia::RtpSession *session, void (PsiMedia::RtpSession::*signal)(), int msecs)
+{
+    QEventLoop loop;
+    bool       ok = false;
+    QObject::connect(session, signal, &loop, [&ok, &loop]() {
+        ok = true;
+        loop.quit();
+    });
+    QObject::connect(session, &PsiMedia::RtpSession::error, &loop, &QEventLoop::quit);
+    QTimer::singleShot(msecs, &loop, &QEventLoop::quit);
+    loop.exec();
+    return ok;
+}
+
+static void run_for(int msecs)
+{
+    QEventLoop loop;
+    QTimer::singleShot(msecs, &loop, &QEventLoop::quit);
+    loop.exec();
+}
+
+// through the impairment, if there is one
+static void forward(PsiMedia::RtpChannel *from, PsiMedia::RtpChannel *to, PsiMedia::RtpImpairment *impairment,
+                    bool media)
+{
+    QObject::connect(from, &PsiMedia::RtpChannel::readyRead, from, [from, to, impairment, media]() {
+        while (from->packetsAvailable() > 0) {
+            PsiMedia::RtpPacket packet = from->read();
+            if (media && packet.portOffset() == 0) {
+                ++g_traffic.rtpPackets;
+                g_traffic.rtpBytes += quint64(packet.rawValue().size());
+            }
+            ++g_traffic.allPackets;
+            if (impairment)
+                impairment->write(packet);
+            else
+                to->write(packet);
+        }
+    });
+
+    if (impairment) {
+        QObject::connect(impairment, &PsiMedia::RtpImpairment::packetReady, to,
+                         [to](const PsiMedia::RtpPacket &packet) { to->write(packet); });
+    }
+}
+
+class Loopback {
+public:
+    // one per channel and direction, media first.  these go last, as the
+    //   channels forward to them.
+    PsiMedia::RtpImpairment impairments[4];
+
+    PsiMedia::RtpSession sender;
+    PsiMedia::RtpSession receiver;
+    OutputWidget         widget;
+
+    // profile may be null for a perfect network
+    bool start(const QSize &size, const PsiMedia::RtpImpairment::Profile *profile, QString *errorMessage)
+    {
+        PsiMedia::AudioParams audioParams;
+        audioParams.setCodec("opus");
+        audioParams.setSampleRate(16000);
+        audioParams.setSampleSize(16);
+        audioParams.setChannels(1);
+
+        PsiMedia::VideoParams videoParams;
+        videoParams.setCodec("vp8");
+        videoParams.setSize(size);
+        videoParams.setFps(VIDEO_FPS);
+
+        widget.videoSize = size;
+        widget.resize(size);
+        widget.show();
+
+        sender.setAudioInputDevice(AUDIO_SOURCE);
+        sender.setVideoInputDevice(VIDEO_SOURCE);
+        sender.setLocalAudioPreferences({ audioParams });
+        sender.setLocalVideoPreferences({ videoParams });
+        sender.start();
+        if (!wait_for(&sender, &PsiMedia::RtpSession::started, SESSION_TIMEOUT)) {
+            *errorMessage = "sender did not start";
+            return false;
+        }
+        if (!sender.canTransmitAudio() || !sender.canTransmitVideo()) {
+            *errorMessage = "sender can't transmit";
+            return false;
+        }
+
+        receiver.setAudioOutputDevice(AUDIO_SINK);
+        receiver.setVideoOutputWidget(&widget);
+        receiver.setLocalAudioPreferences({ audioParams });
+        receiver.setLocalVideoPreferences({ videoParams });
+        receiver.setRemoteAudioPreferences(sender.localAudioPayloadInfo());
+        receiver.setRemoteVideoPreferences(sender.localVideoPayloadInfo());
+
+        // the same profile, but not the same packet fates
+        PsiMedia::RtpImpairment *impairment[4] = {};
+        for (int n = 0; profile && n < 4; ++n) {
+            PsiMedia::RtpImpairment::Profile p = *profile;
+            p.seed += quint32(n);
+            impairments[n].setProfile(p);
+            impairment[n] = &impairments[n];
+        }
+        forward(sender.audioRtpChannel(), receiver.audioRtpChannel(), impairment[0], true);
+        forward(sender.videoRtpChannel(), receiver.videoRtpChannel(), impairment[1], true);
+        forward(receiver.audioRtpChannel(), sender.audioRtpChannel(), impairment[2], false);
+        forward(receiver.videoRtpChannel(), sender.videoRtpChannel(), impairment[3], false);
+
+        receiver.start();
+        if (!wait_for(&receiver, &PsiMedia::RtpSession::started, SESSION_TIMEOUT)) {
+            *errorMessage = "receiver did not start";
+            return false;
+        }
+
+        sender.setRemoteAudioPreferences(receiver.localAudioPayloadInfo());
+        sender.setRemoteVideoPreferences(receiver.localVideoPayloadInfo());
+        sender.updatePreferences();
+        if (!wait_for(&sender, &PsiMedia::RtpSession::preferencesUpdated, SESSION_TIMEOUT)) {
+            *errorMessage = "sender did not accept the receiver's preferences";
+            return false;
+        }
+
+        sender.transmitAudio();
+        sender.transmitVideo();
+        return true;
+    }
+
+    void stop()
+    {
+        sender.stop();
+        receiver.stop();
+        wait_for(&sender, &PsiMedia::RtpSession::stopped, SESSION_TIMEOUT);
+        wait_for(&receiver, &PsiMedia::RtpSession::stopped, SESSION_TIMEOUT);
+    }
+};
+
+//----------------------------------------------------------------------------
+// Benchmark
+//----------------------------------------------------------------------------
+class Result {
+public:
+    QSize         size;
+    double        seconds     = 0;
+    qint64        cpu         = -1; // us, of the whole process
+    quint64       allocations = 0;
+    Traffic       traffic;
+    QList<qint64> latencies;      // us
+    qint64        freezeTime = 0; // us, of all receivers
+    quint64       concealed  = 0; // us, of all receivers
+    quint64       mediaIn    = 0; // packets from the senders into the network
+    quint64       mediaLost  = 0; // and those it dropped
+};
+
+static double percentile(QList<qint64> values, double p)
+{
+    if (values.isEmpty())
+        return -1;
+    std::sort(values.begin(), values.end());
+    int n = qBound(0, int(std::ceil(p * values.count())) - 1, int(values.count()) - 1);
+    return values[n] / 1000.0;
+}
+
+static bool run(const QSize &size, const PsiMedia::RtpImpairment::Profile *profile, int pairs, int warmup,
+                int duration, Result *result, QString *errorMessage)
+{
+    QList<Loopback *> loopbacks;
+    for (int n = 0; n < pairs; ++n)
+        loopbacks += new Loopback;
+
+    bool ok = true;
+    for (Loopback *l : std::as_const(loopbacks)) {
+        if (!l->start(size, profile, errorMessage)) {
+            ok = false;
+            break;
+        }
+    }
+
+    if (ok) {
+        run_for(warmup);
+
+        g_traffic              = Traffic();
+        qint64  cpu            = cpu_time_us();
+        quint64 allocBegin     = g_allocations.load(std::memory_order_relaxed);
+        quint64 concealedBegin = g_concealed.load(std::memory_order_relaxed);
+        for (Loopback *l : std::as_const(loopbacks)) {
+            l->widget.measuring = true;
+            for (PsiMedia::RtpImpairment &i : l->impairments)
+                i.resetStatistics();
+        }
+        QElapsedTimer timer;
+        timer.start();
+
+        run_for(duration);
+
+        result->size        = size;
+        result->seconds     = timer.nsecsElapsed() / 1e9;
+        result->allocations = g_allocations.load(std::memory_order_relaxed) - allocBegin;
+        result->traffic     = g_traffic;
+        result->concealed   = g_concealed.load(std::memory_order_relaxed) - concealedBegin;
+        if (cpu != -1)
+            result->cpu = cpu_time_us() - cpu;
+        for (Loopback *l : std::as_const(loopbacks)) {
+            l->widget.measuring = false;
+            result->latencies += l->widget.latencies;
+            result->freezeTime += l->widget.freezeTime;
+            for (int n = 0; n < 2; ++n) {
+                PsiMedia::RtpImpairment::Statistics stats = l->impairments[n].statistics();
+                result->mediaIn += stats.packetsIn;
+                result->mediaLost += stats.lost + stats.queueDropped;
+            }
+        }
+    }
+
+    for (Loopback *l : std::as_const(loopbacks))
+        l->stop();
+    qDeleteAll(loopbacks);
+    return ok;
+}
+
+static void print_result(const Result &r, int pairs)
+{
+    double seconds  = std::max(r.seconds, 1e-3);
+    int    sessions = pairs * 2;
+
+    QByteArray cpu = "n/a";
+    if (r.cpu != -1)
+        cpu = QByteArray::number(100.0 * r.cpu / 1e6 / seconds / sessions, 'f', 1) + "%";
+
+    QByteArray allocs = "n/a";
+    if (r.traffic.allPackets > 0)
+        allocs = QByteArray::number(double(r.allocations) / r.traffic.allPackets, 'f', 1);
+
+    QByteArray p50 = "n/a", p99 = "n/a";
+    if (!r.latencies.isEmpty()) {
+        p50 = QByteArray::number(percentile(r.latencies, 0.50), 'f', 1);
+        p99 = QByteArray::number(percentile(r.latencies, 0.99), 'f', 1);
+    }
+
+    // of the time measured, summed over the receivers
+    double freeze  = 100.0 * r.freezeTime / 1e6 / seconds / pairs;
+    double conceal = 100.0 * r.concealed / 1e6 / seconds / pairs;
+    double loss    = r.mediaIn > 0 ? 100.0 * r.mediaLost / r.mediaIn : 0;
+
+    QByteArray size = QByteArray::number(r.size.width()) + "x" + QByteArray::number(r.size.height());
+    printf("%-10s %9.0f %9.0f %12s %11s %9.1f %9s %9s %7.1f%% %7.1f%% %7.1f%%\n", size.constData(),
+           r.traffic.rtpPackets / seconds, r.traffic.rtpBytes * 8 / 1000.0 / seconds, cpu.constData(),
+           allocs.constData(), r.latencies.count() / seconds / pairs, p50.constData(), p99.constData(), loss, freeze,
+           conceal);
+    fflush(stdout);
+}
+
+static bool parse_size(const QString &s, QSize *size)
+{
+    if (s == "360p")
+        *size = QSize(640, 360);
+    else if (s == "720p")
+        *size = QSize(1280, 720);
+    else if (s == "1080p")
+        *size = QSize(1920, 1080);
+    else {
+        QStringList parts = s.split('x');
+        if (parts.count() != 2)
+            return false;
+        *size = QSize(parts[0].toInt(), parts[1].toInt());
+    }
+    return size->width() >= (2 + STAMP_BITS) * STAMP_BLOCK && size->height() >= STAMP_BLOCK;
+}
+
+#ifdef GSTPROVIDER_STATIC
+Q_IMPORT_PLUGIN(gstprovider)
+#endif
+
+#ifndef GSTPROVIDER_STATIC
+static QString findPlugin(const QString &relpath, const QString &basename)
+{
+    QDir dir(QCoreApplication::applicationDirPath());
+    if (!dir.cd(relpath))
+        return QString();
+    for (const QString &fileName : dir.entryList()) {
+        if (fileName.contains(basename)) {
+            QString filePath = dir.filePath(fileName);
+            if (QLibrary::isLibrary(filePath))
+                return filePath;
+        }
+    }
+    return QString();
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    // no windows need to be seen
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication qapp(argc, argv);
+    QApplication::setApplicationName("psimedia-benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Loops RTP of test sources back into receiving sessions in-process.");
+    parser.addHelpOption();
+    QCommandLineOption sizeOption("size", "Video size: 360p, 720p, 1080p or WxH. May be repeated.", "size");
+    QCommandLineOption pairsOption("pairs", "Sender/receiver pairs running at once.", "n", "1");
+    QCommandLineOption warmupOption("warmup", "Seconds to run before measuring.", "s", "3");
+    QCommandLineOption durationOption("duration", "Seconds to measure.", "s", "10");
+    QCommandLineOption impairOption("impair",
+                                    "Send through a simulated bad network, e.g. \"wifi\" or "
+                                    "\"seed=7,loss=0.05,burst=3,jitter=30\". See RtpImpairment::Profile.",
+                                    "profile");
+    QCommandLineOption maxP99Option("max-p99", "Fail if the p99 latency of any size exceeds this many ms.", "ms");
+    parser.addOptions({ sizeOption, pairsOption, warmupOption, durationOption, impairOption, maxP99Option });
+    parser.process(qapp);
+
+    QList<QSize> sizes;
+    const QStringList sizeArgs = parser.isSet(sizeOption) ? parser.values(sizeOption)
+                                                          : QStringList { "360p", "720p", "1080p" };
+    for (const QString &s : sizeArgs) {
+        QSize size;
+        if (!parse_size(s, &size)) {
+            fprintf(stderr, "Invalid video size: %s\n", qPrintable(s));
+            return 1;
+        }
+        sizes += size;
+    }
+
+    int    pairs    = std::max(1, parser.value(pairsOption).toInt());
+    int    warmup   = std::max(0, int(parser.value(warmupOption).toDouble() * 1000));
+    int    duration = std::max(1, int(parser.value(durationOption).toDouble() * 1000));
+    double maxP99   = parser.isSet(maxP99Option) ? parser.value(maxP99Option).toDouble() : -1;
+
+    PsiMedia::RtpImpairment::Profile profile;
+    if (parser.isSet(impairOption)) {
+        bool ok;
+        profile = PsiMedia::RtpImpairment::Profile::fromString(parser.value(impairOption), &ok);
+        if (!ok) {
+            fprintf(stderr, "Invalid impairment profile: %s\n", qPrintable(parser.value(impairOption)));
+            return 1;
+        }
+    }
+
+#ifndef GSTPROVIDER_STATIC
+    QString pluginFile = qgetenv("PSI_MEDIA_PLUGIN");
+
+    if (pluginFile.isEmpty())
+        pluginFile = findPlugin(".", "gstprovider" DEBUG_POSTFIX);
+
+    if (pluginFile.isEmpty())
+        pluginFile = findPlugin("../gstprovider", "gstprovider" DEBUG_POSTFIX);
+
+#ifdef PLUGIN_INSTALL_PATH
+    if (pluginFile.isEmpty())
+        pluginFile = findPlugin(PLUGIN_INSTALL_PATH, "gstprovider" DEBUG_POSTFIX);
+#endif
+#ifdef PLUGIN_INSTALL_PATH_DEBUG
+    if (pluginFile.isEmpty())
+        pluginFile = findPlugin(PLUGIN_INSTALL_PATH_DEBUG, "gstprovider" DEBUG_POSTFIX);
+#endif
+
+    PsiMedia::loadPlugin(pluginFile, QString());
+#endif
+
+    if (!PsiMedia::isSupported()) {
+        fprintf(stderr, "Error: Could not load PsiMedia subsystem.\n");
+        return 1;
+    }
+
+    // the provider has initialized gstreamer by now, so this only makes
+    //   sure we can use it from here too
+    gst_init(nullptr, nullptr);
+    g_signal_add_emission_hook(g_signal_lookup("element-added", GST_TYPE_BIN), 0, element_added_hook, nullptr,
+                               nullptr);
+
+    printf("%d pair(s), %d s warmup, %d s measured, latency in ms, allocations by %s\n", pairs, warmup / 1000,
+           duration / 1000, ALLOCATIONS_COUNTED);
+    if (parser.isSet(impairOption))
+        printf("network: %s\n", qPrintable(profile.toString()));
+    printf("%-10s %9s %9s %12s %11s %9s %9s %9s %8s %8s %8s\n", "size", "pkt/s", "kbit/s", "cpu/session",
+           "allocs/pkt", "frames/s", "p50", "p99", "loss", "freeze", "conceal");
+
+    bool passed = true;
+    for (const QSize &size : std::as_const(sizes)) {
+        Result  result;
+        QString errorMessage;
+        if (!run(size, parser.isSet(impairOption) ? &profile : nullptr, pairs, warmup, duration, &result,
+                 &errorMessage)) {
+            fprintf(stderr, "%dx%d: %s\n", size.width(), size.height(), qPrintable(errorMessage));
+            return 1;
+        }
+        print_result(result, pairs);
+
+        if (result.latencies.isEmpty()) {
+            fprintf(stderr, "%dx%d: no frames were shown\n", size.width(), size.height());
+            passed = false;
+        } else if (maxP99 >= 0 && percentile(result.latencies, 0.99) > maxP99)
+            passed = false;
+    }
+
+    return passed ? 0 : 2;
+}
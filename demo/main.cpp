@@ -420,9 +420,23 @@ void RtpSocketGroup::sock_bytesWritten(qint64 bytes)
 }
 
 RtpBinding::RtpBinding(Mode _mode, PsiMedia::RtpChannel *_channel, RtpSocketGroup *_socketGroup, QObject *parent) :
-    QObject(parent), mode(_mode), channel(_channel), socketGroup(_socketGroup), sendBasePort(-1)
+    QObject(parent), mode(_mode), channel(_channel), socketGroup(_socketGroup), impairment(nullptr), sendBasePort(-1)
 {
     socketGroup->setParent(this);
+
+    QString profile = QString::fromLocal8Bit(qgetenv("PSI_MEDIA_IMPAIRMENT"));
+    if (!profile.isEmpty()) {
+        bool ok;
+        auto p = PsiMedia::RtpImpairment::Profile::fromString(profile, &ok);
+        if (ok) {
+            impairment = new PsiMedia::RtpImpairment(this);
+            impairment->setProfile(p);
+            connect(impairment, SIGNAL(packetReady(PsiMedia::RtpPacket)),
+                    SLOT(impairment_ready(PsiMedia::RtpPacket)));
+        } else
+            qWarning("Invalid PSI_MEDIA_IMPAIRMENT profile: %s", qPrintable(profile));
+    }
+
     connect(socketGroup, SIGNAL(readyRead(int)), SLOT(net_ready(int)));
     connect(socketGroup, SIGNAL(datagramWritten(int)), SLOT(net_written(int)));
     connect(channel, SIGNAL(readyRead()), SLOT(app_ready()));
@@ -475,13 +489,24 @@ void RtpBinding::app_ready()
         if (mode == Receive && offset == 0)
             continue;
 
-        if (sendAddress.isNull() || sendBasePort < BASE_PORT_MIN || sendBasePort > BASE_PORT_MAX)
-            continue;
-
-        socketGroup->socket[offset].writeDatagram(packet.rawValue(), sendAddress, quint16(sendBasePort + offset));
+        if (impairment)
+            impairment->write(packet);
+        else
+            sendPacket(packet);
     }
 }
 
+void RtpBinding::impairment_ready(const PsiMedia::RtpPacket &packet) { sendPacket(packet); }
+
+void RtpBinding::sendPacket(const PsiMedia::RtpPacket &packet)
+{
+    if (sendAddress.isNull() || sendBasePort < BASE_PORT_MIN || sendBasePort > BASE_PORT_MAX)
+        return;
+
+    int offset = packet.portOffset();
+    socketGroup->socket[offset].writeDatagram(packet.rawValue(), sendAddress, quint16(sendBasePort + offset));
+}
+
 void RtpBinding::app_written(int count)
 {
     Q_UNUSED(count);
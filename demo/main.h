@@ -117,17 +117,20 @@ private slots:
 
 // bind a channel to a socket group.
 // takes ownership of socket group.
+// outgoing packets go through a simulated bad network first if
+//   PSI_MEDIA_IMPAIRMENT is set to a profile, see RtpImpairment.
 class RtpBinding : public QObject {
     Q_OBJECT
 
 public:
     enum Mode { Send, Receive };
 
-    Mode                  mode;
-    PsiMedia::RtpChannel *channel;
-    RtpSocketGroup       *socketGroup;
-    QHostAddress          sendAddress;
-    int                   sendBasePort;
+    Mode                     mode;
+    PsiMedia::RtpChannel    *channel;
+    RtpSocketGroup          *socketGroup;
+    PsiMedia::RtpImpairment *impairment;
+    QHostAddress             sendAddress;
+    int                      sendBasePort;
 
     RtpBinding(Mode _mode, PsiMedia::RtpChannel *_channel, RtpSocketGroup *_socketGroup, QObject *parent = nullptr);
 
@@ -136,6 +139,10 @@ private slots:
     void net_written(int offset);
     void app_ready();
     void app_written(int count);
+    void impairment_ready(const PsiMedia::RtpPacket &packet);
+
+private:
+    void sendPacket(const PsiMedia::RtpPacket &packet);
 };
 
 class MainWin : public QMainWindow {
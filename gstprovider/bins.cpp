@@ -29,6 +29,9 @@
 // default latency is 200ms
 #define DEFAULT_RTP_LATENCY 200
 
+// vp8enc's own default target bitrate
+#define VP8_DEFAULT_KBPS 256
+
 namespace PsiMedia {
 
 static int get_rtp_latency()
@@ -40,6 +43,8 @@ static int get_rtp_latency()
         return DEFAULT_RTP_LATENCY;
 }
 
+bool bins_rtp_latency_is_adaptive() { return qgetenv("PSI_RTP_LATENCY").isEmpty(); }
+
 static GstElement *audio_codec_to_enc_element(const QString &name)
 {
     QString ename;
@@ -61,9 +66,12 @@ static GstElement *audio_codec_to_enc_element(const QString &name)
 static GstElement *audio_codec_to_dec_element(const QString &name)
 {
     QString ename;
-    if (name == "opus")
-        ename = "opusdec";
-    else if (name == "vorbis")
+    if (name == "opus") {
+        // recover single losses from the fec data of the next packet
+        auto e = gst_element_factory_make("opusdec", nullptr);
+        g_object_set(G_OBJECT(e), "use-inband-fec", TRUE, "plc", TRUE, NULL);
+        return e;
+    } else if (name == "vorbis")
         ename = "vorbisdec";
     else if (name == "pcmu")
         ename = "mulawdec";
@@ -103,15 +111,35 @@ static GstElement *audio_codec_to_rtpdepay_element(const QString &name)
     return gst_element_factory_make(ename.toLatin1().data(), nullptr);
 }
 
+static bool have_element(const char *name)
+{
+    GstElementFactory *factory = gst_element_factory_find(name);
+    if (!factory)
+        return false;
+
+    gst_object_unref(factory);
+    return true;
+}
+
 static GstElement *video_codec_to_enc_element(const QString &name)
 {
     QString ename;
     if (name == QLatin1String("vp8"))
         ename = QLatin1String("vp8enc");
-    else
+    else if (name == QLatin1String("h264")) {
+        auto e = gst_element_factory_make("x264enc", "video-encoder");
+        if (e) {
+            gst_util_set_object_arg(G_OBJECT(e), "tune", "zerolatency");
+            gst_util_set_object_arg(G_OBJECT(e), "speed-preset", "ultrafast");
+            g_object_set(G_OBJECT(e), "bframes", 0u, "key-int-max", 300u, NULL);
+            return e;
+        }
+        ename = QLatin1String("openh264enc");
+    } else
         return nullptr;
 
-    return gst_element_factory_make(ename.toLatin1().data(), nullptr);
+    // named, so keyframes can be forced on it
+    return gst_element_factory_make(ename.toLatin1().data(), "video-encoder");
 }
 
 static GstElement *video_codec_to_dec_element(const QString &name)
@@ -119,6 +147,8 @@ static GstElement *video_codec_to_dec_element(const QString &name)
     QString ename;
     if (name == QLatin1String("vp8"))
         ename = QLatin1String("vp8dec");
+    else if (name == QLatin1String("h264"))
+        ename = have_element("avdec_h264") ? QLatin1String("avdec_h264") : QLatin1String("openh264dec");
     else
         return nullptr;
 
@@ -130,10 +160,17 @@ static GstElement *video_codec_to_rtppay_element(const QString &name)
     QString ename;
     if (name == "vp8")
         ename = "rtpvp8pay";
-    else
+    else if (name == "h264") {
+        // parameter sets go with every idr, so a receiver can start at any
+        //   keyframe
+        auto e = gst_element_factory_make("rtph264pay", "video-payloader");
+        if (e)
+            g_object_set(G_OBJECT(e), "config-interval", -1, NULL);
+        return e;
+    } else
         return nullptr;
 
-    return gst_element_factory_make(ename.toLatin1().data(), nullptr);
+    return gst_element_factory_make(ename.toLatin1().data(), "video-payloader");
 }
 
 static GstElement *video_codec_to_rtpdepay_element(const QString &name)
@@ -141,12 +178,25 @@ static GstElement *video_codec_to_rtpdepay_element(const QString &name)
     QString ename;
     if (name == "vp8")
         ename = "rtpvp8depay";
+    else if (name == "h264")
+        ename = "rtph264depay";
     else
         return nullptr;
 
     return gst_element_factory_make(ename.toLatin1().data(), nullptr);
 }
 
+bool bins_video_codec_available(const QString &codec)
+{
+    if (codec == QLatin1String("vp8"))
+        return true;
+    if (codec == QLatin1String("h264"))
+        return (have_element("x264enc") || have_element("openh264enc"))
+            && (have_element("avdec_h264") || have_element("openh264dec")) && have_element("rtph264pay")
+            && have_element("rtph264depay");
+    return false;
+}
+
 static bool audio_codec_get_send_elements(const QString &name, GstElement **enc, GstElement **rtppay)
 {
     GstElement *eenc = audio_codec_to_enc_element(name);
@@ -358,39 +408,165 @@ GstElement *bins_audioenc_create(const QString &codec, int id, int rate, int siz
     return bin;
 }
 
-GstElement *bins_videoenc_create(const QString &codec, int id, int maxkbps)
+bool bins_rtx_available()
+{
+    static const bool available = have_element("rtprtxsend") && have_element("rtprtxreceive");
+    return available;
+}
+
+bool bins_fec_available()
+{
+    static const bool available = have_element("rtpulpfecenc") && have_element("rtpredenc")
+        && have_element("rtpulpfecdec") && have_element("rtpreddec") && have_element("rtpstorage");
+    return available;
+}
+
+// reference patterns for vp8 temporal scalability.  a frame never refers to
+//   one of a higher layer: the base layer only updates and references the
+//   last frame, the middle layer keeps the golden frame and the top layer
+//   updates nothing at all.  so upper layers can be dropped at any point.
+static const char *vp8_ts_layer_flags_2 = "<no-ref-golden+no-ref-alt+no-upd-golden+no-upd-alt,"
+                                          "no-ref-golden+no-ref-alt+no-upd-last+no-upd-golden+no-upd-alt+no-upd-entropy>";
+static const char *vp8_ts_layer_flags_3 = "<no-ref-golden+no-ref-alt+no-upd-golden+no-upd-alt,"
+                                          "no-ref-alt+no-upd-last+no-upd-golden+no-upd-alt+no-upd-entropy,"
+                                          "no-ref-alt+no-upd-last+no-upd-alt+no-upd-entropy,"
+                                          "no-ref-alt+no-upd-last+no-upd-golden+no-upd-alt+no-upd-entropy>";
+
+static void vp8_set_temporal_layers(GstElement *videoenc, GstElement *videortppay, int layers, int kbps)
+{
+    if (layers < 2)
+        return;
+
+    // without the per-layer flags (gstreamer < 1.20) libvpx is free to
+    //   reference upper layer frames, which would defeat the purpose
+    if (!g_object_class_find_property(G_OBJECT_GET_CLASS(videoenc), "temporal-scalability-layer-flags"))
+        return;
+
+    if (kbps <= 0)
+        kbps = VP8_DEFAULT_KBPS;
+
+    // the layer bitrates are cumulative, in kbps
+    QString bitrates;
+    if (layers == 2)
+        bitrates = QString("<%1,%2>").arg(kbps * 6 / 10).arg(kbps);
+    else
+        bitrates = QString("<%1,%2,%3>").arg(kbps * 4 / 10).arg(kbps * 6 / 10).arg(kbps);
+
+    GObject *obj = G_OBJECT(videoenc);
+    g_object_set(obj, "target-bitrate", kbps * 1000, NULL);
+    gst_util_set_object_arg(obj, "error-resilient", "default");
+    if (layers == 2) {
+        gst_util_set_object_arg(obj, "temporal-scalability-number-layers", "2");
+        gst_util_set_object_arg(obj, "temporal-scalability-periodicity", "2");
+        gst_util_set_object_arg(obj, "temporal-scalability-layer-id", "<0,1>");
+        gst_util_set_object_arg(obj, "temporal-scalability-rate-decimator", "<2,1>");
+        gst_util_set_object_arg(obj, "temporal-scalability-layer-flags", vp8_ts_layer_flags_2);
+    } else {
+        gst_util_set_object_arg(obj, "temporal-scalability-number-layers", "3");
+        gst_util_set_object_arg(obj, "temporal-scalability-periodicity", "4");
+        gst_util_set_object_arg(obj, "temporal-scalability-layer-id", "<0,2,1,2>");
+        gst_util_set_object_arg(obj, "temporal-scalability-rate-decimator", "<4,2,1>");
+        gst_util_set_object_arg(obj, "temporal-scalability-layer-flags", vp8_ts_layer_flags_3);
+    }
+    gst_util_set_object_arg(obj, "temporal-scalability-target-bitrate", bitrates.toLatin1().constData());
+
+    // the layer ids go into the extended payload descriptor
+    gst_util_set_object_arg(G_OBJECT(videortppay), "picture-id-mode", "15-bit");
+}
+
+// the encoder may be x264enc, in kbps, or openh264enc, in bps.  the profile
+//   is the one every receiver can decode.
+static GstElement *h264_set_bitrate_and_profile(GstElement *videoenc, int kbps)
+{
+    if (kbps > 0) {
+        bool inKbps = QLatin1String(GST_OBJECT_NAME(gst_element_get_factory(videoenc))) == QLatin1String("x264enc");
+        g_object_set(G_OBJECT(videoenc), "bitrate", guint(inKbps ? kbps : kbps * 1000), NULL);
+    }
+
+    GstElement *capsfilter = gst_element_factory_make("capsfilter", nullptr);
+    GstCaps    *caps       = gst_caps_new_simple("video/x-h264", "profile", G_TYPE_STRING, "constrained-baseline",
+                                                 NULL);
+    g_object_set(G_OBJECT(capsfilter), "caps", caps, NULL);
+    gst_caps_unref(caps);
+    return capsfilter;
+}
+
+GstElement *bins_videoenc_create(const QString &codec, int id, int maxkbps, int temporalLayers, bool encoded)
 {
     GstElement *bin = gst_bin_new("videoencbin");
 
     GstElement *videoenc    = nullptr;
     GstElement *videortppay = nullptr;
-    if (!video_codec_get_send_elements(codec, &videoenc, &videortppay))
+    if (encoded) {
+        videortppay = video_codec_to_rtppay_element(codec);
+        if (!videortppay)
+            return nullptr;
+    } else if (!video_codec_get_send_elements(codec, &videoenc, &videortppay))
         return nullptr;
 
     if (id != -1)
         g_object_set(G_OBJECT(videortppay), "pt", id, NULL);
 
-    GstElement *videoconvert = gst_element_factory_make("videoconvert", nullptr);
+    if (codec == "vp8" && videoenc)
+        vp8_set_temporal_layers(videoenc, videortppay, temporalLayers, maxkbps);
+
+    GstElement *videoconvert = nullptr;
+    GstElement *videoprofile = nullptr;
+    if (videoenc) {
+        videoconvert = gst_element_factory_make("videoconvert", nullptr);
+        if (codec == "h264")
+            videoprofile = h264_set_bitrate_and_profile(videoenc, maxkbps);
+    }
 
-    gst_bin_add(GST_BIN(bin), videoconvert);
-    gst_bin_add(GST_BIN(bin), videoenc);
     gst_bin_add(GST_BIN(bin), videortppay);
 
-    gst_element_link_many(videoconvert, videoenc, videortppay, NULL);
+    GstElement *first = videortppay;
+    if (videoenc) {
+        gst_bin_add(GST_BIN(bin), videoconvert);
+        gst_bin_add(GST_BIN(bin), videoenc);
+        if (videoprofile) {
+            gst_bin_add(GST_BIN(bin), videoprofile);
+            gst_element_link_many(videoconvert, videoenc, videoprofile, videortppay, NULL);
+        } else
+            gst_element_link_many(videoconvert, videoenc, videortppay, NULL);
+        first = videoconvert;
+    }
+
+    // fec is off (and red a passthrough) until negotiated
+    GstElement *last = videortppay;
+    if (bins_fec_available()) {
+        GstElement *videoulpfecenc = gst_element_factory_make("rtpulpfecenc", "ulpfecenc");
+        GstElement *videoredenc    = gst_element_factory_make("rtpredenc", "redenc");
+        gst_bin_add(GST_BIN(bin), videoulpfecenc);
+        gst_bin_add(GST_BIN(bin), videoredenc);
+        gst_element_link_many(last, videoulpfecenc, videoredenc, NULL);
+        last = videoredenc;
+    }
+
+    // keeps the last second of packets around for retransmission
+    if (bins_rtx_available()) {
+        GstElement *videortxsend = gst_element_factory_make("rtprtxsend", "rtxsend");
+        g_object_set(G_OBJECT(videortxsend), "max-size-time", 1000u, NULL);
+        gst_bin_add(GST_BIN(bin), videortxsend);
+        gst_element_link(last, videortxsend);
+        last = videortxsend;
+    }
 
     GstPad *pad;
 
-    pad = gst_element_get_static_pad(videoconvert, "sink");
+    pad = gst_element_get_static_pad(first, "sink");
     gst_element_add_pad(bin, gst_ghost_pad_new("sink", pad));
     gst_object_unref(GST_OBJECT(pad));
 
-    pad = gst_element_get_static_pad(videortppay, "src");
+    pad = gst_element_get_static_pad(last, "src");
     gst_element_add_pad(bin, gst_ghost_pad_new("src", pad));
     gst_object_unref(GST_OBJECT(pad));
 
     return bin;
 }
 
+GstElement *bins_videodecoder_create(const QString &codec) { return video_codec_to_dec_element(codec); }
+
 GstElement *bins_audiodec_create(const QString &codec)
 {
     GstElement *bin = gst_bin_new("audiodecbin");
@@ -400,7 +576,10 @@ GstElement *bins_audiodec_create(const QString &codec)
     if (!audio_codec_get_recv_elements(codec, &audiodec, &audiortpdepay))
         return nullptr;
 
-    GstElement *audiortpjitterbuffer = gst_element_factory_make("rtpjitterbuffer", nullptr);
+    // named, so the worker can time it
+    gst_object_set_name(GST_OBJECT(audiodec), "audio-decoder");
+
+    GstElement *audiortpjitterbuffer = gst_element_factory_make("rtpjitterbuffer", "jitterbuffer");
 
     gst_bin_add(GST_BIN(bin), audiortpjitterbuffer);
     gst_bin_add(GST_BIN(bin), audiortpdepay);
@@ -410,6 +589,9 @@ GstElement *bins_audiodec_create(const QString &codec)
 
     g_object_set(G_OBJECT(audiortpjitterbuffer), "latency", (unsigned int)get_rtp_latency(), NULL);
 
+    // tell the decoder about losses, for fec and concealment
+    g_object_set(G_OBJECT(audiortpjitterbuffer), "do-lost", TRUE, NULL);
+
     GstPad *pad;
 
     pad = gst_element_get_static_pad(audiortpjitterbuffer, "sink");
@@ -423,28 +605,99 @@ GstElement *bins_audiodec_create(const QString &codec)
     return bin;
 }
 
-GstElement *bins_videodec_create(const QString &codec)
+// all video payloads, whatever their type, use a 90khz clock
+static GstCaps *videojitterbuffer_request_pt_map(GstElement *element, guint pt, gpointer data)
+{
+    Q_UNUSED(element);
+    Q_UNUSED(data);
+    return gst_caps_new_simple("application/x-rtp", "media", G_TYPE_STRING, "video", "clock-rate", G_TYPE_INT, 90000,
+                               "payload", G_TYPE_INT, int(pt), NULL);
+}
+
+GstElement *bins_videodec_create()
 {
     GstElement *bin = gst_bin_new("videodecbin");
 
+    GstElement *videortpjitterbuffer = gst_element_factory_make("rtpjitterbuffer", "jitterbuffer");
+    GstElement *videoptdemux         = gst_element_factory_make("rtpptdemux", "ptdemux");
+    GstElement *videofunnel          = gst_element_factory_make("funnel", "funnel");
+
+    gst_bin_add(GST_BIN(bin), videortpjitterbuffer);
+    gst_bin_add(GST_BIN(bin), videoptdemux);
+    gst_bin_add(GST_BIN(bin), videofunnel);
+
+    g_object_set(G_OBJECT(videortpjitterbuffer), "latency", (unsigned int)get_rtp_latency(), NULL);
+
+    // the fec decoder recovers packets from what the storage kept, when the
+    //   jitter buffer reports them lost
+    GstElement *first = videortpjitterbuffer;
+    if (bins_fec_available()) {
+        GstElement *videoreddec     = gst_element_factory_make("rtpreddec", "reddec");
+        GstElement *videortpstorage = gst_element_factory_make("rtpstorage", "storage");
+        GstElement *videoulpfecdec  = gst_element_factory_make("rtpulpfecdec", "ulpfecdec");
+        gst_bin_add(GST_BIN(bin), videoreddec);
+        gst_bin_add(GST_BIN(bin), videortpstorage);
+        gst_bin_add(GST_BIN(bin), videoulpfecdec);
+        gst_element_link_many(videoreddec, videortpstorage, videortpjitterbuffer, videoulpfecdec, videoptdemux, NULL);
+
+        GObject *storage = nullptr;
+        g_object_set(G_OBJECT(videortpstorage), "size-time", guint64(1000 * GST_MSECOND), NULL);
+        g_object_get(G_OBJECT(videortpstorage), "internal-storage", &storage, NULL);
+        g_object_set(G_OBJECT(videoulpfecdec), "storage", storage, NULL);
+        g_object_unref(storage);
+        g_object_set(G_OBJECT(videortpjitterbuffer), "do-lost", TRUE, NULL);
+        first = videoreddec;
+    } else
+        gst_element_link(videortpjitterbuffer, videoptdemux);
+
+    if (bins_rtx_available()) {
+        GstElement *videortxreceive = gst_element_factory_make("rtprtxreceive", "rtxreceive");
+        gst_bin_add(GST_BIN(bin), videortxreceive);
+        gst_element_link(videortxreceive, first);
+        first = videortxreceive;
+    }
+
+    // fec packets and other codecs come with their own payload types, which
+    //   the jitter buffer won't find in the caps
+    g_signal_connect(G_OBJECT(videortpjitterbuffer), "request-pt-map", G_CALLBACK(videojitterbuffer_request_pt_map),
+                     nullptr);
+
+    GstPad *pad;
+
+    pad = gst_element_get_static_pad(first, "sink");
+    gst_element_add_pad(bin, gst_ghost_pad_new("sink", pad));
+    gst_object_unref(GST_OBJECT(pad));
+
+    pad = gst_element_get_static_pad(videofunnel, "src");
+    gst_element_add_pad(bin, gst_ghost_pad_new("src", pad));
+    gst_object_unref(GST_OBJECT(pad));
+
+    return bin;
+}
+
+GstElement *bins_videodepay_create(const QString &codec)
+{
     GstElement *videodec      = nullptr;
     GstElement *videortpdepay = nullptr;
-    if (!video_codec_get_recv_elements(codec, &videodec, &videortpdepay))
+    if (!video_codec_get_recv_elements(codec, &videodec, &videortpdepay) || !videortpdepay)
         return nullptr;
 
-    GstElement *videortpjitterbuffer = gst_element_factory_make("rtpjitterbuffer", nullptr);
+    // several, one for each payload type seen
+    GstElement *bin = gst_bin_new(nullptr);
+
+    gst_object_set_name(GST_OBJECT(videodec), "video-decoder");
 
-    gst_bin_add(GST_BIN(bin), videortpjitterbuffer);
     gst_bin_add(GST_BIN(bin), videortpdepay);
     gst_bin_add(GST_BIN(bin), videodec);
+    gst_element_link(videortpdepay, videodec);
 
-    gst_element_link_many(videortpjitterbuffer, videortpdepay, videodec, NULL);
-
-    g_object_set(G_OBJECT(videortpjitterbuffer), "latency", (unsigned int)get_rtp_latency(), NULL);
+    // ask for a keyframe upstream when data is missing
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(videortpdepay), "request-keyframe"))
+        g_object_set(G_OBJECT(videortpdepay), "request-keyframe", TRUE, NULL);
 
     GstPad *pad;
 
-    pad = gst_element_get_static_pad(videortpjitterbuffer, "sink");
+    pad = gst_element_get_static_pad(videortpdepay, "sink");
     gst_element_add_pad(bin, gst_ghost_pad_new("sink", pad));
     gst_object_unref(GST_OBJECT(pad));
 
@@ -28,12 +28,47 @@ class QSize;
 
 namespace PsiMedia {
 
+// vp8 is always there, h264 if an encoder, a decoder and the rtp elements
+//   for it are installed
+bool bins_video_codec_available(const QString &codec);
+
 GstElement *bins_videoprep_create(const QSize &size, int fps, bool is_live);
 
 GstElement *bins_audioenc_create(const QString &codec, int id, int rate, int size, int channels);
-GstElement *bins_videoenc_create(const QString &codec, int id, int maxkbps);
+
+// retransmissions need rtprtxsend and rtprtxreceive, which came with
+//   gstreamer 1.6, fec the ulpfec and red elements and rtpstorage, which
+//   came with 1.14.  the video bins go without what is missing.
+bool bins_rtx_available();
+bool bins_fec_available();
+
+// the video encoder bin contains the encoder as "video-encoder", the
+//   payloader as "video-payloader", an rtpulpfecenc as "ulpfecenc", an
+//   rtpredenc as "redenc" and an rtprtxsend as "rtxsend".  the decoder bin
+//   contains an rtprtxreceive as "rtxreceive", an rtpreddec as "reddec" and
+//   an rtpulpfecdec as "ulpfecdec".  those are only there where available.
+//   the decoders are named "audio-decoder" and, in the depayloader bins,
+//   "video-decoder".  retransmission and fec stay off until their payload
+//   types are set.  temporalLayers above 1 enables vp8 temporal
+//   scalability, where supported.  with encoded, the bin takes what the
+//   codec encodes to, and has no encoder.
+GstElement *bins_videoenc_create(const QString &codec, int id, int maxkbps, int temporalLayers, bool encoded = false);
+// a bare decoder, no rtp, for what bins_videoenc_create() takes with encoded
+GstElement *bins_videodecoder_create(const QString &codec);
+
 GstElement *bins_audiodec_create(const QString &codec);
-GstElement *bins_videodec_create(const QString &codec);
+
+// the video decoder bin takes any payload type.  its rtpptdemux, named
+//   "ptdemux", adds a pad for each one it is given caps for, which the
+//   caller links through a depayloader bin of the codec to a request pad
+//   of "funnel", the output of the bin.
+GstElement *bins_videodec_create();
+GstElement *bins_videodepay_create(const QString &codec);
+
+// the decoder bins contain an rtpjitterbuffer named "jitterbuffer".  its
+//   latency is only fixed if PSI_RTP_LATENCY is set, otherwise it should
+//   be retargeted at runtime.
+bool bins_rtp_latency_is_adaptive();
 
 }
 
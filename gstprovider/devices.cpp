@@ -261,18 +261,37 @@ public:
             d.type = PDevice::VideoIn;
 
             auto caps = gst_device_get_caps(gdev);
-            for (guint i = 0; i < gst_caps_get_size(caps); i++) {
+            for (guint i = 0; caps && i < gst_caps_get_size(caps); i++) {
                 auto                    structure = gst_caps_get_structure(caps, i);
                 auto                    mime_type = gst_structure_get_name(structure);
                 PsiMedia::PDevice::Caps mediaCaps;
                 mediaCaps.mime = QString::fromLatin1(mime_type);
-                if (gst_structure_get_int(structure, "width", &mediaCaps.video.width)
-                    && gst_structure_get_int(structure, "height", &mediaCaps.video.height)
-                    && gst_structure_get_fraction(structure, "framerate", &mediaCaps.video.framerate_numerator,
-                                                  &mediaCaps.video.framerate_denominator)) {
+                if (!gst_structure_get_int(structure, "width", &mediaCaps.video.width)
+                    || !gst_structure_get_int(structure, "height", &mediaCaps.video.height))
+                    continue;
+
+                // cameras often offer a mode at several rates.  a range
+                //   is taken at its fastest.
+                const GValue         *framerate = gst_structure_get_value(structure, "framerate");
+                QList<const GValue *> rates;
+                if (framerate && GST_VALUE_HOLDS_LIST(framerate)) {
+                    for (guint n = 0; n < gst_value_list_get_size(framerate); ++n)
+                        rates += gst_value_list_get_value(framerate, n);
+                } else if (framerate && GST_VALUE_HOLDS_FRACTION_RANGE(framerate))
+                    rates += gst_value_get_fraction_range_max(framerate);
+                else if (framerate)
+                    rates += framerate;
+
+                for (const GValue *rate : rates) {
+                    if (!GST_VALUE_HOLDS_FRACTION(rate))
+                        continue;
+                    mediaCaps.video.framerate_numerator   = gst_value_get_fraction_numerator(rate);
+                    mediaCaps.video.framerate_denominator = gst_value_get_fraction_denominator(rate);
                     d.caps.append(mediaCaps);
                 }
             }
+            if (caps)
+                gst_caps_unref(caps);
         }
 
         return d;
@@ -25,8 +25,10 @@
 #include "gstaudiorecordercontext.h"
 #include "gstfeaturescontext.h"
 #include "gstprovider.h"
+#include "gstrtprelaycontext.h"
 #include "gstrtpsessioncontext.h"
 #include "gstthread.h"
+#include "gstvideocompositorcontext.h"
 
 #include <QtPlugin>
 
@@ -43,6 +45,16 @@ GstProvider::GstProvider(const QVariantMap &params)
     auto resourcePath = params.value("resourcePath").toString();
     gstEventLoop      = new GstMainLoop(resourcePath);
     deviceMonitor     = new DeviceMonitor(gstEventLoop);
+
+    // sessions are set up and torn down in parallel up to this many at
+    //   once.  0 leaves them all to the event loop thread.
+    bool ok;
+    int  controlThreads = params.value("controlThreads").toInt(&ok);
+    if (!ok)
+        controlThreads = qEnvironmentVariableIntValue("PSI_CONTROL_THREADS", &ok);
+    if (!ok)
+        controlThreads = qBound(1, QThread::idealThreadCount(), 4);
+    gstEventLoop->setControlThreads(controlThreads);
     gstEventLoop->moveToThread(&gstEventLoopThread);
 
     QMutex waitMutex;
@@ -108,6 +120,10 @@ FeaturesContext *GstProvider::createFeatures() { return new GstFeaturesContext(g
 
 RtpSessionContext *GstProvider::createRtpSession() { return new GstRtpSessionContext(gstEventLoop, deviceMonitor); }
 
+RtpRelayContext *GstProvider::createRtpRelay() { return new GstRtpRelayContext; }
+
+VideoCompositorContext *GstProvider::createVideoCompositor() { return new GstVideoCompositorContext; }
+
 AudioRecorderContext *GstProvider::createAudioRecorder() { return new GstAudioRecorderContext(gstEventLoop); }
 
 }
@@ -41,13 +41,15 @@ public:
 
     GstProvider(const QVariantMap &params = QVariantMap());
     ~GstProvider() override;
-    QObject              *qobject() override;
-    bool                  isInitialized() const override;
-    QString               creditName() const override;
-    QString               creditText() const override;
-    FeaturesContext      *createFeatures() override;
-    RtpSessionContext    *createRtpSession() override;
-    AudioRecorderContext *createAudioRecorder() override;
+    QObject                *qobject() override;
+    bool                    isInitialized() const override;
+    QString                 creditName() const override;
+    QString                 creditText() const override;
+    FeaturesContext        *createFeatures() override;
+    RtpSessionContext      *createRtpSession() override;
+    RtpRelayContext        *createRtpRelay() override;
+    VideoCompositorContext *createVideoCompositor() override;
+    AudioRecorderContext   *createAudioRecorder() override;
 };
 
 }
@@ -80,8 +80,11 @@ void GstRtpChannel::push_packet_for_read(const PRtpPacket &rtp)
         return;
 
     // if the queue is full, bump off the oldest to make room
-    if (pending_in.count() >= QUEUE_PACKET_MAX)
+    if (pending_in.count() >= QUEUE_PACKET_MAX) {
         pending_in.removeFirst();
+        if (stats)
+            ++stats->dropped;
+    }
 
     pending_in += rtp;
 
@@ -29,6 +29,7 @@
 namespace PsiMedia {
 
 class GstRtpSessionContext;
+class StreamStats;
 
 class GstRtpChannel : public QObject, public RtpChannelContext {
     Q_OBJECT
@@ -46,6 +47,9 @@ public:
 
     int written_pending = 0;
 
+    // packets bumped off the queue are counted as dropped
+    StreamStats *stats = nullptr;
+
     GstRtpChannel();
 
     virtual QObject *qobject();
@@ -0,0 +1,389 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "gstrtprelaycontext.h"
+
+#include "gstrtpsessioncontext.h"
+#include "rtcputils.h"
+
+#include <glib.h>
+
+// forwarded packets kept per stream for answering nacks.  at 1000 packets
+//   per second this is about half a second.
+#define RELAY_HISTORY_SIZE 512
+
+// don't ask a sender for a keyframe more often than this, in ms.  every
+//   receiver that lost the picture will ask at about the same time.
+#define RELAY_KEYFRAME_MIN_INTERVAL 300
+
+namespace PsiMedia {
+
+GstRtpRelayContext::GstRtpRelayContext(QObject *parent) : QObject(parent), relaySsrc(g_random_int()) { }
+
+GstRtpRelayContext::~GstRtpRelayContext()
+{
+    for (Leg *leg : std::as_const(legs)) {
+        QMutexLocker locker(&leg->session->write_mutex);
+        if (leg->session->relay == this)
+            leg->session->relay = nullptr;
+    }
+    qDeleteAll(legs);
+}
+
+QObject *GstRtpRelayContext::qobject() { return this; }
+
+void GstRtpRelayContext::addSession(RtpSessionContext *session, bool playLocally)
+{
+    auto s = qobject_cast<GstRtpSessionContext *>(session->qobject());
+    if (!s)
+        return;
+
+    {
+        QMutexLocker locker(&m);
+        Leg         *leg = findLeg(s);
+        if (!leg) {
+            leg          = new Leg;
+            leg->session = s;
+            legs += leg;
+
+            connect(s, SIGNAL(started()), SLOT(session_preferencesUpdated()));
+            connect(s, SIGNAL(preferencesUpdated()), SLOT(session_preferencesUpdated()));
+        }
+        leg->playLocally = playLocally;
+        updatePayloadTypes(leg);
+
+        // the newcomer can't decode anything before the next keyframes
+        for (Leg *other : std::as_const(legs)) {
+            if (other != leg)
+                requestKeyframe(other);
+        }
+    }
+
+    // the lock order is session then relay, so never hold both here
+    QMutexLocker locker(&s->write_mutex);
+    s->relay = this;
+}
+
+void GstRtpRelayContext::removeSession(RtpSessionContext *session)
+{
+    auto s = qobject_cast<GstRtpSessionContext *>(session->qobject());
+    if (!s)
+        return;
+
+    {
+        QMutexLocker locker(&s->write_mutex);
+        if (s->relay == this)
+            s->relay = nullptr;
+    }
+
+    QMutexLocker locker(&m);
+    Leg         *leg = findLeg(s);
+    if (!leg)
+        return;
+
+    legs.removeAll(leg);
+    delete leg;
+    for (Leg *other : std::as_const(legs)) {
+        other->out.remove(qMakePair(s, false));
+        other->out.remove(qMakePair(s, true));
+    }
+    disconnect(s, nullptr, this, nullptr);
+}
+
+void GstRtpRelayContext::setMaximumTemporalLayer(RtpSessionContext *session, int layer)
+{
+    auto s = qobject_cast<GstRtpSessionContext *>(session->qobject());
+    if (!s)
+        return;
+
+    QMutexLocker locker(&m);
+    Leg         *leg = findLeg(s);
+    if (!leg)
+        return;
+
+    bool raised = leg->maxTemporalLayer != -1 && (layer == -1 || layer > leg->maxTemporalLayer);
+    leg->maxTemporalLayer = layer;
+
+    // frames of the layers coming back may refer to ones the receiver
+    //   never got
+    if (raised) {
+        for (Leg *other : std::as_const(legs)) {
+            if (other != leg)
+                requestKeyframe(other);
+        }
+    }
+}
+
+bool GstRtpRelayContext::packetReceived(GstRtpSessionContext *from, bool video, PRtpPacket *rtp)
+{
+    QMutexLocker locker(&m);
+    Leg         *leg = findLeg(from);
+    if (!leg)
+        return false;
+
+    if (rtp->portOffset == 0) {
+        forward(leg, video, *rtp);
+        return !leg->playLocally;
+    }
+    if (rtp->portOffset != 1)
+        return false;
+
+    // what is about our own streams is for the session
+    QList<quint32> forwarded;
+    for (auto it = leg->out.cbegin(); it != leg->out.cend(); ++it) {
+        if (it.key().second == video)
+            forwarded += it->ssrc;
+    }
+    if (forwarded.isEmpty())
+        return false;
+
+    RtcpFeedback feedback;
+    if (video && rtcp_parse_feedback(rtp->rawValue, &feedback) && forwarded.contains(feedback.mediaSsrc))
+        feedbackReceived(leg, feedback);
+
+    rtp->rawValue = rtcp_remove_ssrcs(rtp->rawValue, forwarded);
+    return rtp->rawValue.isEmpty();
+}
+
+void GstRtpRelayContext::session_preferencesUpdated()
+{
+    auto s = static_cast<GstRtpSessionContext *>(sender());
+
+    QMutexLocker locker(&m);
+    Leg         *leg = findLeg(s);
+    if (leg)
+        updatePayloadTypes(leg);
+}
+
+GstRtpRelayContext::Leg *GstRtpRelayContext::findLeg(GstRtpSessionContext *session) const
+{
+    for (Leg *leg : legs) {
+        if (leg->session == session)
+            return leg;
+    }
+    return nullptr;
+}
+
+void GstRtpRelayContext::updatePayloadTypes(Leg *leg)
+{
+    // the session sends what the remote asked for, so the remote's ids
+    //   are also what it receives with
+    leg->audioPt = -1;
+    leg->videoPt = -1;
+    leg->redPt   = -1;
+    leg->rtxPts.clear();
+    for (const PPayloadInfo &pi : std::as_const(leg->session->codecs.remoteAudioPayloadInfo)) {
+        if (pi.name.toUpper() == "OPUS") {
+            leg->audioPt = pi.id;
+            break;
+        }
+    }
+    for (const PPayloadInfo &pi : std::as_const(leg->session->codecs.remoteVideoPayloadInfo)) {
+        if (pi.name.toUpper() == "VP8" && leg->videoPt == -1)
+            leg->videoPt = pi.id;
+        else if (pi.name.toLower() == "red" && leg->redPt == -1)
+            leg->redPt = pi.id;
+        else if (pi.name.toLower() == "rtx") {
+            for (const PPayloadInfo::Parameter &p : pi.parameters) {
+                if (p.name == "apt")
+                    leg->rtxPts[pi.id] = p.value.toInt();
+            }
+        }
+    }
+}
+
+GstRtpRelayContext::OutStream &GstRtpRelayContext::outStream(Leg *dest, Leg *source, bool video,
+                                                             const QByteArray &packet)
+{
+    OutStream &os   = dest->out[qMakePair(source->session, video)];
+    quint32    ssrc = rtp_ssrc(packet);
+    if (os.ssrc == 0) {
+        os.ssrc     = g_random_int();
+        os.seqDelta = quint16(rtp_seq(packet) - quint16(g_random_int()));
+        os.tsOffset = g_random_int();
+        os.history.resize(RELAY_HISTORY_SIZE);
+    } else if (ssrc != os.sourceSsrc) {
+        // the sender restarted, so carry on from where we were
+        os.seqDelta = quint16(rtp_seq(packet) - quint16(os.lastSeq + 1));
+        os.tsOffset = os.lastTs + 1 - rtp_timestamp(packet);
+    }
+    os.sourceSsrc = ssrc;
+    return os;
+}
+
+void GstRtpRelayContext::forward(Leg *source, bool video, const PRtpPacket &rtp)
+{
+    QByteArray packet = rtp.rawValue;
+    int        pt     = rtp_payload_type(packet);
+    if (pt == -1)
+        return;
+
+    int  layer         = -1;
+    bool retransmitted = false;
+    if (video) {
+        // retransmissions are of what we passed on nacks for, and only go
+        //   to the receivers that asked
+        auto rtx = source->rtxPts.constFind(pt);
+        if (rtx != source->rtxPts.constEnd()) {
+            if (!source->videoSsrc || !rtp_unwrap_rtx(&packet, *rtx, source->videoSsrc))
+                return;
+            pt            = *rtx;
+            retransmitted = true;
+        }
+
+        // fec is bound to the sender's sequence numbers, which we rewrite
+        if (pt == source->redPt) {
+            if (!rtp_strip_red(&packet, source->redPt))
+                return;
+            pt = rtp_payload_type(packet);
+        }
+        if (pt != source->videoPt)
+            return;
+
+        layer = rtp_vp8_temporal_layer(packet, pt, -1);
+        if (!retransmitted)
+            source->videoSsrc = rtp_ssrc(packet);
+    } else if (pt != source->audioPt) {
+        return;
+    }
+
+    if (retransmitted) {
+        resend(source, packet, layer);
+        return;
+    }
+
+    for (Leg *dest : std::as_const(legs)) {
+        // the remotes may have picked different ids for the codec, and
+        //   those without it get nothing
+        int destPt = video ? dest->videoPt : dest->audioPt;
+        if (dest == source || destPt == -1)
+            continue;
+
+        OutStream &os = outStream(dest, source, video, packet);
+
+        // close the gap, so the receiver doesn't take it for loss
+        if (layer > 0 && dest->maxTemporalLayer != -1 && layer > dest->maxTemporalLayer) {
+            ++os.seqDelta;
+            continue;
+        }
+
+        QByteArray out = packet;
+        os.lastSeq     = quint16(rtp_seq(packet) - os.seqDelta);
+        os.lastTs      = rtp_timestamp(packet) + os.tsOffset;
+        rtp_rewrite(&out, destPt, os.ssrc, os.lastSeq, os.lastTs);
+        os.history[os.lastSeq % RELAY_HISTORY_SIZE] = out;
+
+        PRtpPacket fwd;
+        fwd.rawValue      = out;
+        fwd.portOffset    = 0;
+        fwd.temporalLayer = layer;
+        if (video)
+            dest->session->videoRtp.push_packet_for_read(fwd);
+        else
+            dest->session->audioRtp.push_packet_for_read(fwd);
+    }
+}
+
+void GstRtpRelayContext::resend(Leg *source, const QByteArray &packet, int layer)
+{
+    quint16 seq = rtp_seq(packet);
+    for (Leg *dest : std::as_const(legs)) {
+        auto it = dest->out.find(qMakePair(source->session, true));
+        if (it == dest->out.end())
+            continue;
+
+        OutStream &os = it.value();
+        auto       r  = os.requested.find(seq);
+        if (r == os.requested.end())
+            continue;
+        quint16 destSeq = r.value();
+        os.requested.erase(r);
+        if (layer > 0 && dest->maxTemporalLayer != -1 && layer > dest->maxTemporalLayer)
+            continue;
+
+        QByteArray out = packet;
+        rtp_rewrite(&out, dest->videoPt, os.ssrc, destSeq, rtp_timestamp(packet) + os.tsOffset);
+        os.history[destSeq % RELAY_HISTORY_SIZE] = out;
+
+        PRtpPacket fwd;
+        fwd.rawValue      = out;
+        fwd.portOffset    = 0;
+        fwd.temporalLayer = layer;
+        dest->session->videoRtp.push_packet_for_read(fwd);
+    }
+}
+
+void GstRtpRelayContext::feedbackReceived(Leg *leg, const RtcpFeedback &feedback)
+{
+    for (auto it = leg->out.begin(); it != leg->out.end(); ++it) {
+        OutStream &os = it.value();
+        if (os.ssrc != feedback.mediaSsrc || !it.key().second)
+            continue;
+
+        Leg *source = findLeg(it.key().first);
+
+        // what we never got goes to the sender, as its own sequence
+        //   numbers.  those of packets left out since then are not known,
+        //   so this may miss.
+        QList<quint16> missing;
+        for (quint16 seq : feedback.nacks) {
+            const QByteArray &packet = os.history[seq % RELAY_HISTORY_SIZE];
+            if (packet.isEmpty() || rtp_seq(packet) != seq) {
+                quint16 sourceSeq = quint16(seq + os.seqDelta);
+                if (os.requested.count() >= RELAY_HISTORY_SIZE)
+                    os.requested.clear();
+                os.requested[sourceSeq] = seq;
+                missing += sourceSeq;
+                continue;
+            }
+
+            PRtpPacket resend;
+            resend.rawValue   = packet;
+            resend.portOffset = 0;
+            leg->session->videoRtp.push_packet_for_read(resend);
+        }
+        if (source && !missing.isEmpty()) {
+            PRtpPacket nack;
+            nack.rawValue   = rtcp_make_nack(relaySsrc, os.sourceSsrc, missing);
+            nack.portOffset = 1;
+            source->session->videoRtp.push_packet_for_read(nack);
+        }
+
+        if (source && feedback.keyframe)
+            requestKeyframe(source);
+        return;
+    }
+}
+
+void GstRtpRelayContext::requestKeyframe(Leg *source)
+{
+    if (!source->videoSsrc)
+        return;
+    if (source->lastKeyframeRequest.isValid() && source->lastKeyframeRequest.elapsed() < RELAY_KEYFRAME_MIN_INTERVAL)
+        return;
+    source->lastKeyframeRequest.start();
+
+    PRtpPacket pli;
+    pli.rawValue   = rtcp_make_pli(relaySsrc, source->videoSsrc);
+    pli.portOffset = 1;
+    source->session->videoRtp.push_packet_for_read(pli);
+}
+
+} // namespace PsiMedia
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef PSIMEDIA_GSTRTPRELAYCONTEXT_H
+#define PSIMEDIA_GSTRTPRELAYCONTEXT_H
+
+#include "psimediaprovider.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+
+namespace PsiMedia {
+
+class GstRtpSessionContext;
+class RtcpFeedback;
+
+//----------------------------------------------------------------------------
+// GstRtpRelayContext
+//----------------------------------------------------------------------------
+// a selective forwarding relay.  nothing here touches gstreamer: packets
+//   written to one session's channels are rewritten and queued for reading
+//   on the channels of the other sessions.  every forwarded stream gets its
+//   own ssrc and a gapless sequence, so upper temporal layers can be left
+//   out per receiver.  rtcp about forwarded streams ends here, so it
+//   doesn't get into the loss adaptation of the receiving session: nacks
+//   are answered from a short history or passed on to the sender, keyframe
+//   requests are merged into one pli to the sender, and reports are
+//   dropped.
+class GstRtpRelayContext : public QObject, public RtpRelayContext {
+    Q_OBJECT
+    Q_INTERFACES(PsiMedia::RtpRelayContext)
+
+public:
+    explicit GstRtpRelayContext(QObject *parent = nullptr);
+    ~GstRtpRelayContext() override;
+
+    QObject *qobject() override;
+
+    void addSession(RtpSessionContext *session, bool playLocally) override;
+    void removeSession(RtpSessionContext *session) override;
+    void setMaximumTemporalLayer(RtpSessionContext *session, int layer) override;
+
+    // session calls this for every packet written to its channels, which
+    //   may be in another thread.  returns true if the packet is not meant
+    //   for the session itself.  what is about forwarded streams is taken
+    //   out of rtcp packets.
+    bool packetReceived(GstRtpSessionContext *from, bool video, PRtpPacket *rtp);
+
+private slots:
+    void session_preferencesUpdated();
+
+private:
+    // one stream forwarded to a session
+    class OutStream {
+    public:
+        quint32             ssrc       = 0;
+        quint32             sourceSsrc = 0;
+        quint16             seqDelta   = 0; // grows with every packet left out
+        quint32             tsOffset   = 0;
+        quint16             lastSeq    = 0;
+        quint32             lastTs     = 0;
+        QVector<QByteArray> history; // by seq, for answering nacks
+
+        // nacks passed on to the sender, by its sequence numbers
+        QHash<quint16, quint16> requested;
+    };
+
+    class Leg {
+    public:
+        GstRtpSessionContext *session          = nullptr;
+        bool                  playLocally      = false;
+        int                   maxTemporalLayer = -1;
+
+        // payload types the session sends and receives with
+        int             audioPt = -1;
+        int             videoPt = -1;
+        int             redPt   = -1;
+        QHash<int, int> rtxPts; // to the payload types they carry
+
+        // incoming video, for keyframe requests
+        quint32       videoSsrc = 0;
+        QElapsedTimer lastKeyframeRequest;
+
+        // streams going out to this session, by source and media
+        QHash<QPair<GstRtpSessionContext *, bool>, OutStream> out;
+    };
+
+    QMutex       m;
+    QList<Leg *> legs;
+    quint32      relaySsrc; // sender ssrc of our own rtcp
+
+    Leg       *findLeg(GstRtpSessionContext *session) const;
+    void       updatePayloadTypes(Leg *leg);
+    void       forward(Leg *source, bool video, const PRtpPacket &rtp);
+    void       resend(Leg *source, const QByteArray &packet, int layer);
+    OutStream &outStream(Leg *dest, Leg *source, bool video, const QByteArray &packet);
+    void       feedbackReceived(Leg *leg, const RtcpFeedback &feedback);
+    void       requestKeyframe(Leg *source);
+};
+
+} // namespace PsiMedia
+
+#endif // PSIMEDIA_GSTRTPRELAYCONTEXT_H
@@ -1,5 +1,7 @@
 #include "gstrtpsessioncontext.h"
 
+#include "gstrtprelaycontext.h"
+#include "pipelineprofiler.h"
 #include "gstthread.h"
 #ifdef QT_GUI_LIB
 #include "gstvideowidget.h"
@@ -17,19 +19,36 @@ GstRtpSessionContext::GstRtpSessionContext(GstMainLoop *_gstLoop, DeviceMonitor
     previewWidget = nullptr;
 #endif
 
+    latencyTracker = std::make_shared<LatencyTracker>();
+    stats          = std::make_shared<SessionStats>();
+
     devices.audioOutVolume = 100;
     devices.audioInVolume  = 100;
+    devices.latencyTracker = latencyTracker;
+    devices.stats          = stats;
 
     codecs.useLocalAudioParams = true;
     codecs.useLocalVideoParams = true;
 
     audioRtp.session = this;
+    audioRtp.stats   = &stats->audioSent;
     videoRtp.session = this;
+    videoRtp.stats   = &stats->videoSent;
 
     connect(&recorder, SIGNAL(stopped()), SLOT(recorder_stopped()));
 }
 
-GstRtpSessionContext::~GstRtpSessionContext() { cleanup(); }
+GstRtpSessionContext::~GstRtpSessionContext()
+{
+    write_mutex.lock();
+    GstRtpRelayContext *r = relay;
+    write_mutex.unlock();
+    if (r)
+        r->removeSession(this);
+
+    cleanup();
+    setPipelineProfilingEnabled(false);
+}
 
 QObject *GstRtpSessionContext::qobject() { return this; }
 
@@ -42,9 +61,11 @@ void GstRtpSessionContext::cleanup()
 
     codecs = RwControlConfigCodecs();
 
-    isStarted      = false;
-    isStopping     = false;
-    pending_status = false;
+    isStarted          = false;
+    isStopping         = false;
+    pending_status     = false;
+    audioJitterLatency = -1;
+    videoJitterLatency = -1;
 
     recorder.control = nullptr;
 
@@ -118,8 +139,10 @@ void GstRtpSessionContext::setVideoOutputWidget(VideoWidgetContext *widget)
     delete outputWidget;
     outputWidget = nullptr;
 
-    if (widget)
-        outputWidget = new GstVideoWidget(widget, this);
+    if (widget) {
+        outputWidget                 = new GstVideoWidget(widget, this);
+        outputWidget->latencyTracker = latencyTracker.get();
+    }
 
     devices.useVideoOut = widget != nullptr;
     if (control)
@@ -169,6 +192,14 @@ void GstRtpSessionContext::setLocalVideoPreferences(const QList<PVideoParams> &p
 
 void GstRtpSessionContext::setMaximumSendingBitrate(int kbps) { codecs.maximumSendingBitrate = kbps; }
 
+void GstRtpSessionContext::setVideoTemporalLayers(int layers) { codecs.videoTemporalLayers = qBound(1, layers, 3); }
+
+void GstRtpSessionContext::setCaptureTimeExtensionId(int id)
+{
+    // 15 is reserved in the one-byte form
+    codecs.captureTimeExtensionId = id >= 1 && id <= 14 ? id : 0;
+}
+
 void GstRtpSessionContext::setRemoteAudioPreferences(const QList<PPayloadInfo> &info)
 {
     codecs.useRemoteAudioPayloadInfo = true;
@@ -181,33 +212,56 @@ void GstRtpSessionContext::setRemoteVideoPreferences(const QList<PPayloadInfo> &
     codecs.remoteVideoPayloadInfo    = info;
 }
 
+void GstRtpSessionContext::prewarm()
+{
+    if (control)
+        return;
+
+    createControl();
+    control->prewarm(devices, codecs);
+}
+
 void GstRtpSessionContext::start()
 {
-    Q_ASSERT(!control && !isStarted);
+    Q_ASSERT(!isStarted && !pending_status);
+
+    // prewarmed, the control is there already
+    if (!control)
+        createControl();
 
+    lastStatus     = RwControlStatus();
+    isStarted      = false;
+    pending_status = true;
+    latencyTracker->reset();
+    stats->reset();
+    lastStatistics = PRtpStatistics();
+    statisticsTime.start();
+    control->start(devices, codecs);
+}
+
+void GstRtpSessionContext::createControl()
+{
     write_mutex.lock();
 
     control = new RwControlLocal(gstLoop, hardwareDeviceMonitor, this);
     connect(control, SIGNAL(statusReady(const RwControlStatus &)), SLOT(control_statusReady(const RwControlStatus &)));
     connect(control, SIGNAL(previewFrame(const QImage &)), SLOT(control_previewFrame(const QImage &)));
-    connect(control, SIGNAL(outputFrame(const QImage &)), SLOT(control_outputFrame(const QImage &)));
+    connect(control, SIGNAL(outputFrame(const QImage &, const FrameTiming &)),
+            SLOT(control_outputFrame(const QImage &, const FrameTiming &)));
     connect(control, SIGNAL(audioOutputIntensityChanged(int)), SLOT(control_audioOutputIntensityChanged(int)));
     connect(control, SIGNAL(audioInputIntensityChanged(int)), SLOT(control_audioInputIntensityChanged(int)));
+    connect(control, SIGNAL(jitterBufferLatencyChanged(int, int)), SLOT(control_jitterBufferLatencyChanged(int, int)));
 
     control->app            = this;
     control->cb_rtpAudioOut = cb_control_rtpAudioOut;
     control->cb_rtpVideoOut = cb_control_rtpVideoOut;
     control->cb_recordData  = cb_control_recordData;
+    control->stats          = stats.get();
 
     allow_writes = true;
     write_mutex.unlock();
 
     recorder.control = control;
-
-    lastStatus     = RwControlStatus();
-    isStarted      = false;
-    pending_status = true;
-    control->start(devices, codecs);
 }
 
 void GstRtpSessionContext::updatePreferences()
@@ -289,16 +343,77 @@ void GstRtpSessionContext::setInputVolume(int level)
         control->updateDevices(devices);
 }
 
+int GstRtpSessionContext::audioJitterBufferLatency() const { return audioJitterLatency; }
+
+int GstRtpSessionContext::videoJitterBufferLatency() const { return videoJitterLatency; }
+
+PVideoLatency GstRtpSessionContext::videoLatency() const { return latencyTracker->latency(); }
+
+// bytes over the time since the previous snapshot.  polled too often, the
+//   bitrate would jump around, so the previous one is kept for a while.
+static void update_bitrate(PStreamStatistics &cur, const PStreamStatistics &prev, qint64 msecs)
+{
+    if (msecs < 500) {
+        cur.bitrate = prev.bitrate;
+        return;
+    }
+    quint64 bytes = cur.bytes >= prev.bytes ? cur.bytes - prev.bytes : cur.bytes;
+    cur.bitrate   = int(bytes * 8 / quint64(msecs));
+}
+
+PRtpStatistics GstRtpSessionContext::statistics()
+{
+    PRtpStatistics out;
+    out.audioSent     = stats->audioSent.snapshot();
+    out.audioReceived = stats->audioReceived.snapshot();
+    out.videoSent     = stats->videoSent.snapshot();
+    out.videoReceived = stats->videoReceived.snapshot();
+
+    if (!statisticsTime.isValid())
+        return out;
+
+    qint64 msecs = statisticsTime.elapsed();
+    update_bitrate(out.audioSent, lastStatistics.audioSent, msecs);
+    update_bitrate(out.audioReceived, lastStatistics.audioReceived, msecs);
+    update_bitrate(out.videoSent, lastStatistics.videoSent, msecs);
+    update_bitrate(out.videoReceived, lastStatistics.videoReceived, msecs);
+
+    // otherwise keep counting from the previous snapshot
+    if (msecs >= 500) {
+        lastStatistics = out;
+        statisticsTime.restart();
+    }
+    return out;
+}
+
 RtpSessionContext::Error GstRtpSessionContext::errorCode() const { return static_cast<Error>(lastStatus.errorCode); }
 
 RtpChannelContext *GstRtpSessionContext::audioRtpChannel() { return &audioRtp; }
 
 RtpChannelContext *GstRtpSessionContext::videoRtpChannel() { return &videoRtp; }
 
+void GstRtpSessionContext::requestKeyframe()
+{
+    if (control)
+        control->requestKeyframe();
+}
+
+void GstRtpSessionContext::setPipelineProfilingEnabled(bool enabled)
+{
+    if (profiling == enabled)
+        return;
+
+    profiling = enabled;
+    if (profiling)
+        PipelineProfiler::acquire();
+    else
+        PipelineProfiler::release();
+}
+
 void GstRtpSessionContext::dumpPipeline(std::function<void(const QStringList &)> callback)
 {
     if (control)
-        control->dumpPipeline(callback);
+        control->dumpPipeline(callback, profiling);
     else
         callback(QStringList());
 }
@@ -306,13 +421,16 @@ void GstRtpSessionContext::dumpPipeline(std::function<void(const QStringList &)>
 void GstRtpSessionContext::push_packet_for_write(GstRtpChannel *from, const PRtpPacket &rtp)
 {
     QMutexLocker locker(&write_mutex);
+    PRtpPacket   packet = rtp;
+    if (relay && relay->packetReceived(this, from == &videoRtp, &packet))
+        return;
     if (!allow_writes || !control)
         return;
 
     if (from == &audioRtp)
-        control->rtpAudioIn(rtp);
+        control->rtpAudioIn(packet);
     else if (from == &videoRtp)
-        control->rtpVideoIn(rtp);
+        control->rtpVideoIn(packet);
 }
 
 void GstRtpSessionContext::control_statusReady(const RwControlStatus &status)
@@ -361,10 +479,10 @@ void GstRtpSessionContext::control_previewFrame(const QImage &img)
         previewWidget->show_frame(img);
 }
 
-void GstRtpSessionContext::control_outputFrame(const QImage &img)
+void GstRtpSessionContext::control_outputFrame(const QImage &img, const FrameTiming &timing)
 {
     if (outputWidget)
-        outputWidget->show_frame(img);
+        outputWidget->show_frame(img, timing);
 }
 
 void GstRtpSessionContext::control_audioOutputIntensityChanged(int intensity)
@@ -377,6 +495,15 @@ void GstRtpSessionContext::control_audioInputIntensityChanged(int intensity)
     emit audioInputIntensityChanged(intensity);
 }
 
+void GstRtpSessionContext::control_jitterBufferLatencyChanged(int audio, int video)
+{
+    if (audio == audioJitterLatency && video == videoJitterLatency)
+        return;
+    audioJitterLatency = audio;
+    videoJitterLatency = video;
+    emit jitterBufferLatencyChanged();
+}
+
 void GstRtpSessionContext::recorder_stopped() { emit stoppedRecording(); }
 
 void GstRtpSessionContext::cb_control_rtpAudioOut(const PRtpPacket &packet, void *app)
@@ -30,6 +30,7 @@
 namespace PsiMedia {
 
 class GstMainLoop;
+class GstRtpRelayContext;
 class GstVideoWidget;
 class DeviceMonitor;
 
@@ -52,6 +53,17 @@ public:
     bool                   isStarted;
     bool                   isStopping;
     bool                   pending_status;
+    int                    audioJitterLatency = -1;
+    int                    videoJitterLatency = -1;
+
+    std::shared_ptr<LatencyTracker> latencyTracker;
+    std::shared_ptr<SessionStats>   stats;
+
+    // the previous statistics, for the bitrates
+    PRtpStatistics lastStatistics;
+    QElapsedTimer  statisticsTime;
+
+    bool profiling = false;
 
 #ifdef QT_GUI_LIB
     GstVideoWidget *outputWidget, *previewWidget;
@@ -65,6 +77,9 @@ public:
     QMutex        write_mutex;
     bool          allow_writes;
 
+    // set by the relay the session is part of, protected by write_mutex
+    GstRtpRelayContext *relay = nullptr;
+
     explicit GstRtpSessionContext(GstMainLoop *_gstLoop, DeviceMonitor *deviceMonitor, QObject *parent = nullptr);
 
     ~GstRtpSessionContext() override;
@@ -89,8 +104,11 @@ public:
     void                setLocalAudioPreferences(const QList<PAudioParams> &params) override;
     void                setLocalVideoPreferences(const QList<PVideoParams> &params) override;
     void                setMaximumSendingBitrate(int kbps) override;
+    void                setVideoTemporalLayers(int layers) override;
+    void                setCaptureTimeExtensionId(int id) override;
     void                setRemoteAudioPreferences(const QList<PPayloadInfo> &info) override;
     void                setRemoteVideoPreferences(const QList<PPayloadInfo> &info) override;
+    void                prewarm() override;
     void                start() override;
     void                updatePreferences() override;
     void                transmitAudio() override;
@@ -110,9 +128,15 @@ public:
     void                setOutputVolume(int level) override;
     int                 inputVolume() const override;
     void                setInputVolume(int level) override;
+    int                 audioJitterBufferLatency() const override;
+    int                 videoJitterBufferLatency() const override;
+    PVideoLatency       videoLatency() const override;
+    PRtpStatistics      statistics() override;
     Error               errorCode() const override;
     RtpChannelContext  *audioRtpChannel() override;
     RtpChannelContext  *videoRtpChannel() override;
+    void                requestKeyframe() override;
+    void                setPipelineProfilingEnabled(bool enabled) override;
     void                dumpPipeline(std::function<void(const QStringList &)> callback) override;
 
     // channel calls this, which may be in another thread
@@ -127,16 +151,20 @@ signals:
     void stopped();
     void finished();
     void error();
+    void jitterBufferLatencyChanged();
 
 private slots:
     void control_statusReady(const RwControlStatus &status);
     void control_previewFrame(const QImage &img);
-    void control_outputFrame(const QImage &img);
+    void control_outputFrame(const QImage &img, const FrameTiming &timing);
     void control_audioOutputIntensityChanged(int intensity);
     void control_audioInputIntensityChanged(int intensity);
+    void control_jitterBufferLatencyChanged(int audio, int video);
     void recorder_stopped();
 
 private:
+    void createControl();
+
     static void cb_control_rtpAudioOut(const PRtpPacket &packet, void *app);
     static void cb_control_rtpVideoOut(const PRtpPacket &packet, void *app);
     static void cb_control_recordData(const QByteArray &packet, void *app);
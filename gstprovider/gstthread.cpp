@@ -33,6 +33,8 @@
 
 #include <atomic>
 
+#include "bins.h"
+
 namespace PsiMedia {
 
 //----------------------------------------------------------------------------
@@ -221,6 +223,12 @@ public:
             g_object_unref(G_OBJECT(e));
         }
 
+        // optional, video just goes without loss recovery
+        if (!bins_rtx_available())
+            qDebug("No rtprtxsend/rtprtxreceive, video is sent without retransmissions.");
+        if (!bins_fec_available())
+            qDebug("No ulpfec/red elements or rtpstorage, video is sent without fec.");
+
         success = true;
     }
 
@@ -247,6 +255,13 @@ public:
         GstMainLoop::Private *d = nullptr;
     };
 
+    struct ControlThread {
+        GThread      *thread   = nullptr;
+        GMainContext *context  = nullptr;
+        GMainLoop    *loop     = nullptr;
+        int           sessions = 0;
+    };
+
     GstMainLoop                                        *q = nullptr;
     QString                                             pluginPath;
     GstSession                                         *gstSession = nullptr;
@@ -260,9 +275,58 @@ public:
     BridgeQueueSource                                  *bridgeSource = nullptr;
     guint                                               bridgeId     = 0;
     QQueue<QPair<GstMainLoop::ContextCallback, void *>> bridgeQueue;
+    QMutex                                              controlMutex;
+    int                                                 controlThreadsMax = 0;
+    QList<ControlThread *>                              controlThreads;
 
     Private(GstMainLoop *q) : q(q), success(false), stopping(false) { }
 
+    static gpointer control_thread_run(gpointer data)
+    {
+        auto t = static_cast<ControlThread *>(data);
+        g_main_context_push_thread_default(t->context);
+        g_main_loop_run(t->loop);
+        g_main_context_pop_thread_default(t->context);
+        return nullptr;
+    }
+
+    static gboolean cb_control_thread_quit(gpointer data)
+    {
+        g_main_loop_quit(static_cast<GMainLoop *>(data));
+        return FALSE;
+    }
+
+    ControlThread *startControlThread()
+    {
+        auto t     = new ControlThread;
+        t->context = g_main_context_new();
+        t->loop    = g_main_loop_new(t->context, FALSE);
+        t->thread  = g_thread_new("GstControl", control_thread_run, t);
+        controlThreads += t;
+        return t;
+    }
+
+    void stopControlThreads()
+    {
+        QMutexLocker locker(&controlMutex);
+        for (auto t : std::as_const(controlThreads)) {
+            // quitting from inside the loop, as a quit before the loop
+            //   gets to run would be lost
+            GSource *source = g_idle_source_new();
+            g_source_set_callback(source, cb_control_thread_quit, t->loop, nullptr);
+            g_source_attach(source, t->context);
+            g_source_unref(source);
+            g_thread_join(t->thread);
+
+            if (t->sessions > 0)
+                qWarning("GstMainLoop: control thread stopped with %d sessions left", t->sessions);
+            g_main_loop_unref(t->loop);
+            g_main_context_unref(t->context);
+            delete t;
+        }
+        controlThreads.clear();
+    }
+
     static gboolean cb_loop_started(gpointer data) { return static_cast<Private *>(data)->loop_started(); }
 
     gboolean loop_started()
@@ -360,6 +424,8 @@ void GstMainLoop::stop()
     d->stopping = true;
     // with locked mutex we come here even after complete or otherwise we don't need to deinit anything
     if (d->success.exchange(false)) {
+        d->stopControlThreads();
+
         QSemaphore stopSem;
         bool       stopped = execInContext(
             [this, &stopSem](void *) {
@@ -394,6 +460,38 @@ bool GstMainLoop::execInContext(const ContextCallback &cb, void *userData)
     return false;
 }
 
+void GstMainLoop::setControlThreads(int count) { d->controlThreadsMax = count; }
+
+GMainContext *GstMainLoop::acquireContext()
+{
+    QMutexLocker locker(&d->controlMutex);
+    if (d->controlThreadsMax < 1 || !d->success)
+        return d->mainContext;
+
+    // the least busy thread, or a new one while none is idle
+    Private::ControlThread *t = nullptr;
+    for (auto c : std::as_const(d->controlThreads)) {
+        if (!t || c->sessions < t->sessions)
+            t = c;
+    }
+    if ((!t || t->sessions > 0) && d->controlThreads.count() < d->controlThreadsMax)
+        t = d->startControlThread();
+
+    ++t->sessions;
+    return t->context;
+}
+
+void GstMainLoop::releaseContext(GMainContext *context)
+{
+    QMutexLocker locker(&d->controlMutex);
+    for (auto t : std::as_const(d->controlThreads)) {
+        if (t->context == context) {
+            --t->sessions;
+            break;
+        }
+    }
+}
+
 bool GstMainLoop::start()
 {
     qDebug("GStreamer thread started");
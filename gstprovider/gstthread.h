@@ -32,6 +32,12 @@ namespace PsiMedia {
 //   starts up a thread, initializes gstreamer, and sets up a glib eventloop
 //   ready for use.  if you want to do stuff in the other thread, set
 //   up a glib timeout of 0 against mainContext(), and go from there.
+//
+// sessions are controlled from a pool of further glib eventloops, each in
+//   a thread of its own, so that setting up one session doesn't wait for
+//   another.  a session takes a context with acquireContext() and keeps it
+//   until it gives it back.  without control threads, all of them share
+//   mainContext().
 
 class GstMainLoop : public QObject {
     Q_OBJECT
@@ -48,6 +54,11 @@ public:
     bool          execInContext(const ContextCallback &cb, void *userData);
     bool          start();
 
+    // how many control threads there may be at most, before start()
+    void          setControlThreads(int count);
+    GMainContext *acquireContext();
+    void          releaseContext(GMainContext *context);
+
 signals:
     void started();
 
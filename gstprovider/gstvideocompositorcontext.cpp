@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "gstvideocompositorcontext.h"
+
+#include "gstrtpsessioncontext.h"
+#ifdef QT_GUI_LIB
+#include "gstvideowidget.h"
+#endif
+#include "pipelinecompositor.h"
+
+#ifdef QT_GUI_LIB
+#include <QWidget>
+#endif
+
+namespace PsiMedia {
+
+GstVideoCompositorContext::GstVideoCompositorContext(QObject *parent) :
+    QObject(parent), compositor(std::make_shared<PipelineCompositor>())
+{
+#ifdef QT_GUI_LIB
+    // frames come from the streaming thread
+    compositor->setFrameCallback([this](const QImage &image) {
+        QMetaObject::invokeMethod(
+            this,
+            [this, image]() {
+                if (outputWidget)
+                    outputWidget->show_frame(image);
+            },
+            Qt::QueuedConnection);
+    });
+#endif
+}
+
+GstVideoCompositorContext::~GstVideoCompositorContext()
+{
+    compositor->setFrameCallback({});
+
+    for (const Member &m : std::as_const(members)) {
+        if (m.session)
+            setSessionCompositor(m.session, -1);
+    }
+}
+
+QObject *GstVideoCompositorContext::qobject() { return this; }
+
+#ifdef QT_GUI_LIB
+void GstVideoCompositorContext::setOutputWidget(VideoWidgetContext *widget)
+{
+    // no change?
+    if (!outputWidget && !widget)
+        return;
+    if (outputWidget && outputWidget->context == widget)
+        return;
+
+    if (outputWidget)
+        disconnect(outputWidget->context->qobject(), nullptr, this, nullptr);
+    delete outputWidget;
+    outputWidget = nullptr;
+
+    if (widget) {
+        outputWidget = new GstVideoWidget(widget, this);
+        connect(widget->qobject(), SIGNAL(resized(const QSize &)), SLOT(widget_resized(const QSize &)));
+        compositor->setOutputSize(widget->qwidget()->size());
+    }
+}
+#endif
+
+void GstVideoCompositorContext::addSession(RtpSessionContext *session)
+{
+    auto s = qobject_cast<GstRtpSessionContext *>(session->qobject());
+    if (!s || findMember(s) != -1)
+        return;
+
+    Member m;
+    m.session = s;
+    m.tile    = compositor->createTile();
+    members += m;
+    setSessionCompositor(s, m.tile);
+}
+
+void GstVideoCompositorContext::removeSession(RtpSessionContext *session)
+{
+    int at = findMember(session);
+    if (at == -1)
+        return;
+
+    Member m = members.takeAt(at);
+    compositor->destroyTile(m.tile);
+    if (m.session)
+        setSessionCompositor(m.session, -1);
+}
+
+void GstVideoCompositorContext::setSessionVisible(RtpSessionContext *session, bool visible)
+{
+    int at = findMember(session);
+    if (at != -1)
+        compositor->setTileVisible(members[at].tile, visible);
+}
+
+void GstVideoCompositorContext::widget_resized(const QSize &newSize) { compositor->setOutputSize(newSize); }
+
+int GstVideoCompositorContext::findMember(RtpSessionContext *session) const
+{
+    for (int n = 0; n < members.count(); ++n) {
+        if (members[n].session && members[n].session->qobject() == session->qobject())
+            return n;
+    }
+    return -1;
+}
+
+void GstVideoCompositorContext::setSessionCompositor(GstRtpSessionContext *session, int tile)
+{
+    if (tile != -1)
+        session->devices.compositor = compositor;
+    else
+        session->devices.compositor.reset();
+    session->devices.compositorTile = tile;
+    if (session->control)
+        session->control->updateDevices(session->devices);
+}
+
+} // namespace PsiMedia
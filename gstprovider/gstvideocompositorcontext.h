@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef PSIMEDIA_GSTVIDEOCOMPOSITORCONTEXT_H
+#define PSIMEDIA_GSTVIDEOCOMPOSITORCONTEXT_H
+
+#include "psimediaprovider.h"
+
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <memory>
+
+namespace PsiMedia {
+
+class GstRtpSessionContext;
+class GstVideoWidget;
+class PipelineCompositor;
+
+//----------------------------------------------------------------------------
+// GstVideoCompositorContext
+//----------------------------------------------------------------------------
+// the sessions hand their decoded video to a compositor in the receive
+//   pipeline, and one frame of the widget's size comes out of it.  this
+//   only keeps track of tiles and passes the frames on to the widget.
+class GstVideoCompositorContext : public QObject, public VideoCompositorContext {
+    Q_OBJECT
+    Q_INTERFACES(PsiMedia::VideoCompositorContext)
+
+public:
+    explicit GstVideoCompositorContext(QObject *parent = nullptr);
+    ~GstVideoCompositorContext() override;
+
+    QObject *qobject() override;
+
+#ifdef QT_GUI_LIB
+    void setOutputWidget(VideoWidgetContext *widget) override;
+#endif
+
+    void addSession(RtpSessionContext *session) override;
+    void removeSession(RtpSessionContext *session) override;
+    void setSessionVisible(RtpSessionContext *session, bool visible) override;
+
+private slots:
+    void widget_resized(const QSize &newSize);
+
+private:
+    class Member {
+    public:
+        QPointer<GstRtpSessionContext> session;
+        int                            tile;
+    };
+
+    std::shared_ptr<PipelineCompositor> compositor;
+    QList<Member>                       members;
+
+#ifdef QT_GUI_LIB
+    GstVideoWidget *outputWidget = nullptr;
+#endif
+
+    int  findMember(RtpSessionContext *session) const;
+    void setSessionCompositor(GstRtpSessionContext *session, int tile);
+};
+
+} // namespace PsiMedia
+
+#endif // PSIMEDIA_GSTVIDEOCOMPOSITORCONTEXT_H
@@ -37,9 +37,10 @@ GstVideoWidget::GstVideoWidget(VideoWidgetContext *_context, QObject *parent) :
     connect(context->qobject(), SIGNAL(paintEvent(QPainter *)), SLOT(context_paintEvent(QPainter *)));
 }
 
-void GstVideoWidget::show_frame(const QImage &image)
+void GstVideoWidget::show_frame(const QImage &image, const FrameTiming &timing)
 {
-    curImage = image;
+    curImage  = image;
+    curTiming = timing;
     context->qwidget()->update();
 }
 
@@ -71,6 +72,13 @@ void GstVideoWidget::context_paintEvent(QPainter *p)
         i = curImage;
 
     p->drawImage(xoff, yoff, i);
+
+    // only the first paint of a frame counts, later ones are for resizes
+    //   and the like
+    if (latencyTracker && curTiming.pulled != -1) {
+        latencyTracker->framePainted(curTiming);
+        curTiming = FrameTiming();
+    }
 }
 
 } // namespace PsiMedia
@@ -23,6 +23,7 @@
 
 #include "psimediaprovider.h"
 
+#include "latencytracker.h"
 #include <QImage>
 
 namespace PsiMedia {
@@ -36,10 +37,12 @@ class GstVideoWidget : public QObject {
 public:
     VideoWidgetContext *context;
     QImage              curImage;
+    FrameTiming         curTiming;                // until painted
+    LatencyTracker     *latencyTracker = nullptr; // told when frames are painted
 
     explicit GstVideoWidget(VideoWidgetContext *_context, QObject *parent = nullptr);
 
-    void show_frame(const QImage &image);
+    void show_frame(const QImage &image, const FrameTiming &timing = FrameTiming());
 
 private Q_SLOTS:
     void context_resized(const QSize &newSize);
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "jitterestimator.h"
+
+#include <QtGlobal>
+#include <algorithm>
+#include <cmath>
+
+// extra room on top of the measured delay spread, in ms
+#define TARGET_HEADROOM 10
+
+// extra room while packets are getting lost, in ms
+#define LOSS_HEADROOM 20
+
+// loss percentage at which LOSS_HEADROOM kicks in
+#define LOSS_THRESHOLD 2
+
+namespace PsiMedia {
+
+JitterEstimator::JitterEstimator(int clockRate, int initialTarget, int minTarget, int maxTarget) :
+    clockRate(clockRate), minTarget(minTarget), maxTarget(maxTarget), target_(initialTarget)
+{
+    clock.start();
+}
+
+void JitterEstimator::packetReceived(const QByteArray &rtp, bool timing)
+{
+    auto p = reinterpret_cast<const quint8 *>(rtp.constData());
+    if (rtp.size() < 12 || (p[0] >> 6) != 2)
+        return;
+
+    quint16 seq     = quint16((p[2] << 8) | p[3]);
+    quint32 ts      = (quint32(p[4]) << 24) | (quint32(p[5]) << 16) | (quint32(p[6]) << 8) | quint32(p[7]);
+    double  arrival = double(clock.nsecsElapsed()) / 1000000;
+
+    QMutexLocker locker(&m);
+    if (!started) {
+        started       = true;
+        maxSeq        = seq;
+        baseSeq       = seq;
+        received      = 1;
+        expectedPrior = 0;
+        receivedPrior = 0;
+    } else {
+        // sequence tracking as in rfc 3550 appendix a.1, minus the
+        //   probation.  reordered and duplicated packets are just counted
+        //   as received.
+        quint16 delta = quint16(seq - maxSeq);
+        if (delta < 0x8000) {
+            if (seq < maxSeq)
+                cycles += 0x10000;
+            maxSeq = seq;
+        }
+        ++received;
+    }
+
+    if (!timing)
+        return;
+    if (!timed) {
+        timed       = true;
+        lastTs      = ts;
+        extTs       = 0;
+        lastTransit = arrival;
+        return;
+    }
+
+    // the rtp timestamp of the first packet is our zero
+    extTs += qint32(ts - lastTs);
+    lastTs = ts;
+
+    double transit = arrival - double(extTs) * 1000 / clockRate;
+    double d       = std::fabs(transit - lastTransit);
+    lastTransit    = transit;
+    jitter_ += (d - jitter_) / 16;
+
+    delays[delaysAt] = transit;
+    delaysAt         = (delaysAt + 1) % JITTER_DELAY_WINDOW;
+    if (delaysCount < JITTER_DELAY_WINDOW)
+        ++delaysCount;
+}
+
+int JitterEstimator::updateTarget()
+{
+    QMutexLocker locker(&m);
+    if (!started || delaysCount < 2)
+        return target_;
+
+    qint64 expected         = cycles + maxSeq - baseSeq + 1;
+    qint64 expectedInterval = expected - expectedPrior;
+    qint64 receivedInterval = received - receivedPrior;
+    expectedPrior           = expected;
+    receivedPrior           = received;
+    qint64 lostInterval     = expectedInterval - receivedInterval;
+    if (expectedInterval > 0 && lostInterval > 0)
+        loss = int(lostInterval * 100 / expectedInterval);
+    else
+        loss = 0;
+
+    double sorted[JITTER_DELAY_WINDOW];
+    std::copy(delays, delays + delaysCount, sorted);
+    std::sort(sorted, sorted + delaysCount);
+    int spread = int(sorted[(delaysCount - 1) * 95 / 100] - sorted[0]);
+
+    int wanted = qMax(spread, int(jitter_ * 3)) + TARGET_HEADROOM;
+    if (loss >= LOSS_THRESHOLD)
+        wanted += LOSS_HEADROOM;
+    wanted = qBound(minTarget, wanted, maxTarget);
+
+    // grow right away, shrink a quarter of the way per update
+    if (wanted > target_)
+        target_ = wanted;
+    else
+        target_ -= (target_ - wanted + 3) / 4;
+
+    return target_;
+}
+
+int JitterEstimator::target() const
+{
+    QMutexLocker locker(&m);
+    return target_;
+}
+
+int JitterEstimator::jitter() const
+{
+    QMutexLocker locker(&m);
+    return int(jitter_);
+}
+
+int JitterEstimator::lossPercent() const
+{
+    QMutexLocker locker(&m);
+    return loss;
+}
+
+}
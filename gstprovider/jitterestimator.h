@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef PSI_JITTERESTIMATOR_H
+#define PSI_JITTERESTIMATOR_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMutex>
+
+// number of transit delays kept for the percentile estimate
+#define JITTER_DELAY_WINDOW 256
+
+namespace PsiMedia {
+
+// watches an incoming rtp stream and derives a jitter buffer latency from
+//   it.  the target covers the 95th percentile of the transit delay spread
+//   seen recently, grows immediately when the network gets worse and
+//   shrinks slowly when it gets better.
+//
+// packetReceived() is safe to call from any thread.
+class JitterEstimator {
+public:
+    JitterEstimator(int clockRate, int initialTarget, int minTarget, int maxTarget);
+
+    JitterEstimator(const JitterEstimator &)            = delete;
+    JitterEstimator &operator=(const JitterEstimator &) = delete;
+
+    // packets without timing, like fec, only count for the loss
+    void packetReceived(const QByteArray &rtp, bool timing = true);
+
+    // recalculates and returns the target latency in ms.  call this
+    //   periodically, loss is measured between calls.
+    int updateTarget();
+
+    int target() const;
+    int jitter() const;      // rfc 3550 interarrival jitter, in ms
+    int lossPercent() const; // during the last update interval
+
+private:
+    mutable QMutex m;
+    QElapsedTimer  clock;
+    int            clockRate;
+    int            minTarget;
+    int            maxTarget;
+    int            target_;
+
+    bool    started       = false;
+    quint16 maxSeq        = 0;
+    qint64  cycles        = 0;
+    qint64  baseSeq       = 0;
+    qint64  received      = 0;
+    qint64  expectedPrior = 0;
+    qint64  receivedPrior = 0;
+    int     loss          = 0;
+
+    bool    timed       = false;
+    quint32 lastTs      = 0;
+    qint64  extTs       = 0;
+    double  lastTransit = 0;
+    double  jitter_     = 0;
+
+    double delays[JITTER_DELAY_WINDOW];
+    int    delaysAt    = 0;
+    int    delaysCount = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "latencytracker.h"
+
+// frames in flight at most, from arrival of the first packet until pulled
+//   out of the pipeline.  at 30fps this is a good two seconds.
+#define MAX_FRAMES 64
+
+// averages are over windows of this many us
+#define WINDOW_USEC 1000000
+
+namespace PsiMedia {
+
+void LatencyTracker::Stage::add(qint64 usec, qint64 now)
+{
+    if (windowStart == -1)
+        windowStart = now;
+
+    // remote clocks may be a little ahead of ours
+    sum += qMax(usec, qint64(0));
+    ++count;
+
+    if (now - windowStart >= WINDOW_USEC) {
+        average     = int((sum / count + 500) / 1000);
+        sum         = 0;
+        count       = 0;
+        windowStart = now;
+    }
+}
+
+qint64 LatencyTracker::now() { return g_get_real_time(); }
+
+void LatencyTracker::frameSent(qint64 capture)
+{
+    qint64       t = now();
+    QMutexLocker locker(&m);
+    encode.add(t - capture, t);
+}
+
+void LatencyTracker::packetReceived(quint32 timestamp, bool marker, qint64 capture)
+{
+    qint64       t = now();
+    QMutexLocker locker(&m);
+    auto         it = findByTimestamp(timestamp);
+    if (it == frames.end()) {
+        if (frames.size() >= MAX_FRAMES)
+            frames.pop_front();
+        Frame frame;
+        frame.timestamp = timestamp;
+        frames.push_back(frame);
+        it = frames.end() - 1;
+    }
+
+    if (capture != -1)
+        it->capture = capture;
+    it->arrived = t;
+
+    if (marker && it->capture != -1)
+        network.add(t - it->capture, t);
+}
+
+void LatencyTracker::packetDequeued(quint32 timestamp, bool marker, GstClockTime pts)
+{
+    qint64       t = now();
+    QMutexLocker locker(&m);
+    auto         it = findByTimestamp(timestamp);
+    if (it == frames.end())
+        return;
+
+    it->pts      = pts;
+    it->dequeued = t;
+
+    if (marker && it->arrived != -1)
+        jitterBuffer.add(t - it->arrived, t);
+}
+
+void LatencyTracker::frameDecoded(GstClockTime pts)
+{
+    qint64       t = now();
+    QMutexLocker locker(&m);
+    auto         it = findByPts(pts);
+    if (it == frames.end())
+        return;
+
+    if (it->dequeued != -1)
+        decode.add(t - it->dequeued, t);
+    it->decoded = t;
+}
+
+FrameTiming LatencyTracker::framePulled(GstClockTime pts)
+{
+    FrameTiming  timing;
+    qint64       t = now();
+    QMutexLocker locker(&m);
+    timing.pulled = t;
+
+    auto it = findByPts(pts);
+    if (it == frames.end())
+        return timing;
+
+    timing.capture = it->capture;
+    if (it->decoded != -1)
+        convert.add(t - it->decoded, t);
+
+    // whatever came before won't show up anymore
+    frames.erase(frames.begin(), it + 1);
+    return timing;
+}
+
+void LatencyTracker::framePainted(const FrameTiming &timing)
+{
+    qint64       t = now();
+    QMutexLocker locker(&m);
+    if (timing.pulled != -1)
+        render.add(t - timing.pulled, t);
+    if (timing.capture != -1)
+        total.add(t - timing.capture, t);
+}
+
+PVideoLatency LatencyTracker::latency() const
+{
+    QMutexLocker  locker(&m);
+    PVideoLatency out;
+    out.encode       = encode.average;
+    out.network      = network.average;
+    out.jitterBuffer = jitterBuffer.average;
+    out.decode       = decode.average;
+    out.convert      = convert.average;
+    out.render       = render.average;
+    out.total        = total.average;
+    return out;
+}
+
+void LatencyTracker::reset()
+{
+    QMutexLocker locker(&m);
+    frames.clear();
+    encode       = Stage();
+    network      = Stage();
+    jitterBuffer = Stage();
+    decode       = Stage();
+    convert      = Stage();
+    render       = Stage();
+    total        = Stage();
+}
+
+std::deque<LatencyTracker::Frame>::iterator LatencyTracker::findByTimestamp(quint32 timestamp)
+{
+    // the frame being received is usually the newest one
+    for (auto it = frames.end(); it != frames.begin();) {
+        --it;
+        if (it->timestamp == timestamp)
+            return it;
+    }
+    return frames.end();
+}
+
+std::deque<LatencyTracker::Frame>::iterator LatencyTracker::findByPts(GstClockTime pts)
+{
+    if (!GST_CLOCK_TIME_IS_VALID(pts))
+        return frames.end();
+
+    // and the frame coming out of the pipeline the oldest
+    for (auto it = frames.begin(); it != frames.end(); ++it) {
+        if (it->pts == pts)
+            return it;
+    }
+    return frames.end();
+}
+
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef PSI_LATENCYTRACKER_H
+#define PSI_LATENCYTRACKER_H
+
+#include "psimediaprovider.h"
+#include <QMutex>
+#include <deque>
+#include <gst/gst.h>
+
+namespace PsiMedia {
+
+// what a received video frame takes along to the widget showing it.  times
+//   are microseconds since the epoch, -1 if unknown.  the capture time is
+//   the remote's, from the abs-capture-time header extension.
+class FrameTiming {
+public:
+    qint64 capture = -1;
+    qint64 pulled  = -1; // out of the pipeline
+};
+
+// follows video frames through the stages of the pipelines, and keeps the
+//   average time spent in each.  all times are taken from the wall clock,
+//   so they can be compared to capture times of the remote.
+//
+// received packets are matched up with their frame by rtp timestamp, and
+//   once out of the jitter buffer by pts, which the depayloader and decoder
+//   keep.  frames that never make it to the end are forgotten after a while.
+//
+// everything may be called from any thread.
+class LatencyTracker {
+public:
+    LatencyTracker() = default;
+
+    LatencyTracker(const LatencyTracker &)            = delete;
+    LatencyTracker &operator=(const LatencyTracker &) = delete;
+
+    static qint64 now();
+
+    // sent video: a frame captured at capture was just packetized
+    void frameSent(qint64 capture);
+
+    // received video, in the order a frame goes through the stages.  the
+    //   marker bit tells the last packet of a frame.  capture is -1 if the
+    //   packet doesn't say.
+    void        packetReceived(quint32 timestamp, bool marker, qint64 capture);
+    void        packetDequeued(quint32 timestamp, bool marker, GstClockTime pts);
+    void        frameDecoded(GstClockTime pts);
+    FrameTiming framePulled(GstClockTime pts);
+    void        framePainted(const FrameTiming &timing);
+
+    PVideoLatency latency() const;
+    void          reset();
+
+private:
+    // average over windows of about a second
+    class Stage {
+    public:
+        qint64 sum         = 0;
+        int    count       = 0;
+        qint64 windowStart = -1;
+        int    average     = -1; // ms
+
+        void add(qint64 usec, qint64 now);
+    };
+
+    class Frame {
+    public:
+        quint32      timestamp = 0;
+        GstClockTime pts       = GST_CLOCK_TIME_NONE;
+        qint64       capture   = -1;
+        qint64       arrived   = -1; // the last packet so far
+        qint64       dequeued  = -1; // out of the jitter buffer, likewise
+        qint64       decoded   = -1;
+    };
+
+    mutable QMutex    m;
+    std::deque<Frame> frames; // oldest first
+    Stage             encode;
+    Stage             network;
+    Stage             jitterBuffer;
+    Stage             decode;
+    Stage             convert;
+    Stage             render;
+    Stage             total;
+
+    std::deque<Frame>::iterator findByTimestamp(quint32 timestamp);
+    std::deque<Frame>::iterator findByPts(GstClockTime pts);
+};
+
+}
+
+#endif
@@ -20,6 +20,8 @@
 
 #include "modes.h"
 
+#include "bins.h"
+
 // #include <gst/gst.h>
 
 namespace PsiMedia {
@@ -54,7 +56,7 @@ static bool have_h263p()
     return have_codec("ffenc_h263p", "ffdec_h263", "rtph263ppay", "rtph263pdepay");
 }*/
 
-// opus, vp8 are guaranteed to exist
+// opus, vp8 are guaranteed to exist, h264 may be
 
 QList<PAudioParams> modes_supportedAudio()
 {
@@ -118,6 +120,18 @@ QList<PVideoParams> modes_supportedVideo()
         list += p;
     }
 
+    // cameras often encode h264 themselves, which can then be sent as is
+    if (bins_video_codec_available("h264")) {
+        PVideoParams p;
+        p.codec = "h264";
+        p.size  = QSize(640, 480);
+        p.fps   = 30;
+        list += p;
+
+        p.size = { 1280, 720 };
+        list += p;
+    }
+
     return list;
 }
 
@@ -23,11 +23,12 @@
 #include "devices.h"
 
 #include <QList>
+#include <QMutex>
 #include <QSet>
 #include <gst/gst.h>
 
 #include <algorithm>
-#include <ranges>
+#include <optional>
 
 // FIXME: this file is heavily commented out and a mess, mainly because
 //   all of my attempts at a dynamic pipeline were futile.  someday we
@@ -43,6 +44,12 @@
 
 #define WEBRTCDSP_RATE 48000
 
+// format remote streams are mixed in before they go to an audio output.  it
+//   is what the echo probe wants, so the mix is converted only once after
+//   that, if at all.  audiomixer has simd (orc) code for s16.
+#define MIXER_RATE WEBRTCDSP_RATE
+#define MIXER_CHANNELS 2
+
 namespace PsiMedia {
 
 static int get_fixed_rate()
@@ -107,7 +114,7 @@ static void videosrcbin_pad_added(GstElement *element, GstPad *pad, gpointer dat
 }
 
 static GstStaticPadTemplate videosrcbin_template
-    = GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS("video/x-raw"));
+    = GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS("video/x-raw; video/x-h264"));
 
 static GstCaps *filter_for_capture_size(const QSize &size)
 {
@@ -115,42 +122,78 @@ static GstCaps *filter_for_capture_size(const QSize &size)
                                                size.height(), nullptr),
                              gst_structure_new("image/jpeg", "width", G_TYPE_INT, size.width(), "height", G_TYPE_INT,
                                                size.height(), nullptr),
-                             gst_structure_new("video/h264", "width", G_TYPE_INT, size.width(), "height", G_TYPE_INT,
+                             gst_structure_new("video/x-h264", "width", G_TYPE_INT, size.width(), "height", G_TYPE_INT,
                                                size.height(), nullptr),
                              nullptr);
 }
 
-static GstCaps *filter_for_desired_size(GstDevice *dev, const QSize &size)
+// relative cost per pixel of decoding what a camera gives.  raw needs no
+//   decoding, but moves the most data.
+static double capture_decode_cost(const QString &mime)
 {
-    static std::array mime_prioriry { QLatin1String { "video/x-raw" }, QLatin1String { "image/jpeg" },
-                                      QLatin1String("video/h264") };
-    namespace views   = std::ranges::views;
-    auto desiredScore = double(size.width()) * size.height();
-    auto capsScore    = [&desiredScore](const auto &c) { // less is better
-        auto it = std::find(mime_prioriry.begin(), mime_prioriry.end(), c.mime);
-        return std::abs(double(c.video.width) * c.video.height - desiredScore)
-            + (it == mime_prioriry.end() ? mime_prioriry.size()
-                                            : std::distance(mime_prioriry.begin(), mime_prioriry.end()));
-    };
-
-    std::vector<std::pair<double, PDevice::Caps>> srcCaps;
-    std::ranges::copy(dev->caps | views::filter([](auto const &c) { return c.video.framerate_numerator >= 24; })
-                          | views::transform([&](auto const &c) { return std::make_pair(capsScore(c), c); }),
-                      std::back_inserter(srcCaps));
-    std::ranges::sort(srcCaps, [](const auto &a, const auto &b) { return a.first < b.first; });
-
-    GstCaps *caps = gst_caps_new_empty();
-    if (srcCaps.empty()) {
-        // try to get at least something starting from those usually having good bitrate
-        gst_caps_append_structure(caps, gst_structure_new_empty("image/jpeg"));
-        gst_caps_append_structure(caps, gst_structure_new_empty("video/h264"));
-        gst_caps_append_structure(caps, gst_structure_new_empty("video/x-raw"));
-        return caps;
-    } else {
-        auto const &selected = srcCaps[0].second;
-        return gst_caps_new_simple(selected.mime.toLatin1().constData(), "width", G_TYPE_INT, selected.video.width,
-                                   "height", G_TYPE_INT, selected.video.height, nullptr);
+    if (mime == QLatin1String("video/x-raw"))
+        return 0;
+    if (mime == QLatin1String("image/jpeg"))
+        return 1;
+    if (mime == QLatin1String("video/x-h264"))
+        return 2;
+    return 3; // decodebin finds something, maybe
+}
+
+static double capture_bytes_per_pixel(const QString &mime)
+{
+    return mime == QLatin1String("video/x-raw") ? 2 : 0.1; // yuy2 usually, compressed a lot less
+}
+
+// how much smaller or slower than wanted a mode is, 0 if not at all
+static double capture_shortfall(const PDevice::Caps &c, const QSize &size, int fps)
+{
+    double rate = double(c.video.framerate_numerator) / c.video.framerate_denominator;
+    return qMax(0.0, 1 - double(c.video.width) / size.width()) + qMax(0.0, 1 - double(c.video.height) / size.height())
+        + qMax(0.0, 1 - rate / fps);
+}
+
+// less is better.  a mode smaller or slower than wanted shows, so any
+//   shortfall weighs more than what the rest costs: decoding, moving the
+//   data, and scaling or dropping what's more than wanted.
+static double capture_caps_score(const PDevice::Caps &c, const QSize &size, int fps)
+{
+    double rate   = double(c.video.framerate_numerator) / c.video.framerate_denominator;
+    double pixels = double(c.video.width) * c.video.height;
+    double wanted = double(size.width()) * size.height();
+
+    double perPixel = capture_decode_cost(c.mime) + capture_bytes_per_pixel(c.mime) / 4;
+    double excess   = qMax(0.0, pixels - wanted) * qMin(rate, double(fps)) / 4;
+    return capture_shortfall(c, size, fps) * 1e12 + pixels * rate * perPixel + excess;
+}
+
+// the cheapest of the modes the camera advertises, if any.  with mime, only
+//   modes of that type count.
+static std::optional<PDevice::Caps> select_capture_caps(const QList<PDevice::Caps> &caps, const QSize &size, int fps,
+                                                        const QString &mime = QString())
+{
+    std::optional<PDevice::Caps> best;
+    double                       bestScore = 0;
+    for (const auto &c : caps) {
+        if (c.video.width <= 0 || c.video.height <= 0 || c.video.framerate_numerator <= 0
+            || c.video.framerate_denominator <= 0)
+            continue;
+        if (!mime.isEmpty() && c.mime != mime)
+            continue;
+        double score = capture_caps_score(c, size, fps);
+        if (!best || score < bestScore) {
+            best      = c;
+            bestScore = score;
+        }
     }
+    return best;
+}
+
+static GstCaps *filter_for_capture_caps(const PDevice::Caps &c)
+{
+    return gst_caps_new_simple(c.mime.toLatin1().constData(), "width", G_TYPE_INT, c.video.width, "height",
+                               G_TYPE_INT, c.video.height, "framerate", GST_TYPE_FRACTION, c.video.framerate_numerator,
+                               c.video.framerate_denominator, nullptr);
 }
 
 static GstElement *make_webrtcdsp_filter()
@@ -175,13 +218,163 @@ class PipelineDeviceContextPrivate {
 public:
     PipelineContext      *pipeline = nullptr;
     PipelineDevice       *device   = nullptr;
-    PipelineDeviceOptions opts;
+    PipelineDeviceOptions opts; // protected by m, for the caps probe
     bool                  activated = false;
+    QMutex                m;
 
-    // queue for srcs, adder for sinks
+    // bin with a queue for srcs, converter bin (or the device itself if it
+    //   can't be shared) for sinks
     GstElement *element = nullptr;
+
+    // for srcs, the queue in element, and the pad on the device tee while
+    //   linked to it.  once the device gives something other than what was
+    //   asked for, the queue is followed by a decoder, videorate and
+    //   videoscale, and a capsfilter for the options.
+    GstElement *queue      = nullptr;
+    GstPad     *teepad     = nullptr;
+    GstElement *convfilter = nullptr;
+
+    // for sinks, the pad on the device mixer
+    GstPad *mixerpad = nullptr;
 };
 
+static GstElement *make_h264_decoder()
+{
+    GstElement *e = gst_element_factory_make("avdec_h264", nullptr);
+    return e ? e : gst_element_factory_make("openh264dec", nullptr);
+}
+
+// the camera's h264 is only sent as is if the camera encodes the profile
+//   receivers are offered, and gives keyframes when asked.  v4l2src does
+//   neither, uvch264src sets up the camera's encoder for both.  its h264
+//   comes out of "vidsrc", "vfsrc" must be linked as well.
+static GstElement *make_uvch264src(GstElement *v4l2src)
+{
+    if (!g_object_class_find_property(G_OBJECT_GET_CLASS(v4l2src), "device"))
+        return nullptr;
+
+    gchar *path = nullptr;
+    g_object_get(G_OBJECT(v4l2src), "device", &path, nullptr);
+    GstElement *e = path ? gst_element_factory_make("uvch264src", nullptr) : nullptr;
+    if (e) {
+        g_object_set(G_OBJECT(e), "device", path, "auto-start", TRUE, nullptr);
+        gst_util_set_object_arg(G_OBJECT(e), "mode", "mode-video");
+    }
+    g_free(path);
+    return e;
+}
+
+// what a consumer with opts wants, and any video consumer takes raw video
+static GstCaps *consumer_caps(const PipelineDeviceOptions &opts)
+{
+    GstCaps *caps = gst_caps_new_empty_simple("video/x-raw");
+    if (opts.videoSize.isValid())
+        gst_caps_set_simple(caps, "width", G_TYPE_INT, opts.videoSize.width(), "height", G_TYPE_INT,
+                            opts.videoSize.height(), nullptr);
+    if (opts.fps > 0)
+        gst_caps_set_simple(caps, "framerate", GST_TYPE_FRACTION, opts.fps, 1, nullptr);
+    return caps;
+}
+
+// whether a consumer with opts can take what the device gives as is
+static bool consumer_takes(const PipelineDeviceOptions &opts, GstCaps *caps)
+{
+    GstStructure *cs = gst_caps_get_structure(caps, 0);
+    if (gst_structure_has_name(cs, "video/x-h264"))
+        return opts.h264;
+
+    int w = 0, h = 0, num = 0, den = 1;
+    gst_structure_get_int(cs, "width", &w);
+    gst_structure_get_int(cs, "height", &h);
+    gst_structure_get_fraction(cs, "framerate", &num, &den);
+    if (opts.videoSize.isValid() && QSize(w, h) != opts.videoSize)
+        return false;
+    if (opts.fps > 0 && (den == 0 || num != opts.fps * den))
+        return false;
+    return true;
+}
+
+// a video consumer gets what the device gives, until the first caps it
+//   can't take as is.  from then on it is converted, for good, which costs
+//   little once the caps match again.  to be called in the queue thread,
+//   with the context locked, so the branch can be relinked.
+static bool insert_conversion(PipelineDeviceContextPrivate *context, GstCaps *caps)
+{
+    if (context->convfilter || consumer_takes(context->opts, caps))
+        return false;
+
+    QList<GstElement *> chain;
+    if (gst_structure_has_name(gst_caps_get_structure(caps, 0), "video/x-h264")) {
+        GstElement *decoder = make_h264_decoder();
+        if (!decoder) {
+            qWarning("no h264 decoder for a consumer wanting raw video");
+            return false;
+        }
+        chain += decoder;
+    }
+    if (context->opts.fps > 0)
+        chain += gst_element_factory_make("videorate", nullptr);
+    if (context->opts.videoSize.isValid())
+        chain += gst_element_factory_make("videoscale", nullptr);
+
+    context->convfilter = gst_element_factory_make("capsfilter", nullptr);
+    GstCaps *filter     = consumer_caps(context->opts);
+    g_object_set(G_OBJECT(context->convfilter), "caps", filter, nullptr);
+    gst_caps_unref(filter);
+    chain += context->convfilter;
+
+    GstBin *bin   = GST_BIN(context->element);
+    GstPad *ghost = gst_element_get_static_pad(context->element, "src");
+    gst_ghost_pad_set_target(GST_GHOST_PAD(ghost), nullptr);
+
+    GstElement *prev = context->queue;
+    for (GstElement *e : std::as_const(chain)) {
+        gst_bin_add(bin, e);
+        gst_element_link(prev, e);
+        prev = e;
+    }
+    GstPad *target = gst_element_get_static_pad(context->convfilter, "src");
+    gst_ghost_pad_set_target(GST_GHOST_PAD(ghost), target);
+    gst_object_unref(target);
+    gst_object_unref(ghost);
+
+    for (GstElement *e : std::as_const(chain))
+        gst_element_sync_state_with_parent(e);
+    return true;
+}
+
+// sees the caps before they go out
+static GstPadProbeReturn consumer_caps_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    Q_UNUSED(pad);
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) != GST_EVENT_CAPS)
+        return GST_PAD_PROBE_OK;
+
+    auto     context = static_cast<PipelineDeviceContextPrivate *>(data);
+    GstCaps *caps    = nullptr;
+    gst_event_parse_caps(event, &caps);
+
+    QMutexLocker locker(&context->m);
+    if (context->convfilter)
+        return GST_PAD_PROBE_REMOVE;
+    return insert_conversion(context, caps) ? GST_PAD_PROBE_REMOVE : GST_PAD_PROBE_OK;
+}
+
+// options changed while the caps stay the same
+static GstPadProbeReturn consumer_idle_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    Q_UNUSED(info);
+    auto     context = static_cast<PipelineDeviceContextPrivate *>(data);
+    GstCaps *caps    = gst_pad_get_current_caps(pad);
+    if (caps) {
+        QMutexLocker locker(&context->m);
+        insert_conversion(context, caps);
+        gst_caps_unref(caps);
+    }
+    return GST_PAD_PROBE_REMOVE;
+}
+
 class PipelineDevice {
 public:
     int           refs = 0;
@@ -190,16 +383,23 @@ public:
     GstElement   *pipeline   = nullptr;
     GstElement   *device_bin = nullptr;
     bool          activated  = false;
+    bool          encoded    = false;  // video in giving the camera's own h264
     QString       webrtcEchoProbeName; // initialized when we modify already running AudioIn dev
 
     QSet<PipelineDeviceContextPrivate *> contexts;
 
+    // video in: what the device bin captures for, the most any ref asked
+    //   for.  see renegotiate().
+    DeviceMonitor        *deviceMonitor = nullptr;
+    PipelineDeviceOptions captureOptions;
+
     // for srcs
     GstElement *tee                  = nullptr;
     GstElement *aindev               = nullptr;
     bool        webrtcdspInitialized = false;
 
     // for sinks (audio only, video sinks are always unshared)
+    GstElement *mixer         = nullptr;
     GstElement *audioconvert  = nullptr;
     GstElement *audioresample = nullptr;
     GstElement *webrtcprobe   = nullptr;
@@ -259,8 +459,28 @@ private:
 
             auto device = deviceMonitor->device(id);
             if (!device) {
-                gst_object_unref(deviceElement);
-                return nullptr;
+                // not a camera we know of, but a launch line giving raw
+                //   video, like "videotestsrc is-live=true"
+                gst_bin_add(GST_BIN(bin), deviceElement);
+
+                GstElement *last = deviceElement;
+                QSize       size = captureSize.isValid() ? captureSize : options.videoSize;
+                if (size.isValid()) {
+                    GstElement *capsfilter = gst_element_factory_make("capsfilter", nullptr);
+                    GstCaps    *caps       = gst_caps_new_simple("video/x-raw", "width", G_TYPE_INT, size.width(),
+                                                                 "height", G_TYPE_INT, size.height(), nullptr);
+                    g_object_set(G_OBJECT(capsfilter), "caps", caps, nullptr);
+                    gst_caps_unref(caps);
+
+                    gst_bin_add(GST_BIN(bin), capsfilter);
+                    gst_element_link(deviceElement, capsfilter);
+                    last = capsfilter;
+                }
+
+                GstPad *pad = gst_element_get_static_pad(last, "src");
+                gst_element_add_pad(bin, gst_ghost_pad_new("src", pad));
+                gst_object_unref(GST_OBJECT(pad));
+                return bin;
             }
 
 #ifdef Q_OS_MAC
@@ -279,37 +499,90 @@ private:
             // (yuy2 -> Y42B for rtp and yuy2 for preview. while w/o it we have i420 on input and conert only for
             // preview)
 
-            /* TODO we need approach similar to
-gst-launch-1.0 -v autovideosrc ! switchbin num-paths=3 \
-path0::caps="video/x-h264" path0::element="h264parse ! avdec_h264" \
-path1::caps="image/jpeg"   path1::element="jpegdec" \
-path2::caps="video/x-raw" \
-! videoconvert ! autovideosink
-*/
-
-            GstCaps *capsfilter = nullptr;
+            // pin the cheapest mode that gives what's wanted, and decode only
+            //   that.  without a size to go for, or modes to choose from,
+            //   decodebin has to work it out.
+            int                          fps = options.fps > 0 ? options.fps : 30;
+            std::optional<PDevice::Caps> selected;
+            GstCaps                     *capsfilter = nullptr;
             if (captureSize.isValid())
                 capsfilter = filter_for_capture_size(captureSize);
-            else if (options.videoSize.isValid())
-                capsfilter = filter_for_desired_size(device, options.videoSize);
+            else if (options.videoSize.isValid()) {
+                // the camera's own h264 is taken as is, if it is good enough,
+                //   otherwise it is encoded by us
+                if (options.h264) {
+                    selected = select_capture_caps(device->caps, options.videoSize, fps, "video/x-h264");
+                    if (selected && !encoded && capture_shortfall(*selected, options.videoSize, fps) > 0)
+                        selected.reset();
+                    GstElement *uvc = selected ? make_uvch264src(deviceElement) : nullptr;
+                    if (uvc) {
+                        gst_object_unref(gst_object_ref_sink(deviceElement));
+                        deviceElement = uvc;
+                    } else
+                        selected.reset();
+                    encoded = selected.has_value();
+                }
+                if (!selected)
+                    selected = select_capture_caps(device->caps, options.videoSize, fps);
+                if (selected)
+                    capsfilter = filter_for_capture_caps(*selected);
+            }
 
             gst_bin_add(GST_BIN(bin), deviceElement);
 
+            const char *devicePad = nullptr;
+            if (encoded) {
+                // the profile h264_set_bitrate_and_profile() gives encoded
+                //   video, for the same receivers
+                gst_caps_set_simple(capsfilter, "profile", G_TYPE_STRING, "constrained-baseline", nullptr);
+                devicePad = "vidsrc";
+
+                GstElement *viewfinder = gst_element_factory_make("fakesink", nullptr);
+                g_object_set(G_OBJECT(viewfinder), "sync", FALSE, "async", FALSE, nullptr);
+                gst_bin_add(GST_BIN(bin), viewfinder);
+                gst_element_link_pads(deviceElement, "vfsrc", viewfinder, nullptr);
+            }
+
             GstPad *binPad
                 = gst_ghost_pad_new_no_target_from_template("src", gst_static_pad_template_get(&videosrcbin_template));
             gst_element_add_pad(bin, binPad);
 
             QList<GstElement *> toLink;
-            // find best suitable caps
-            if (std::any_of(device->caps.begin(), device->caps.end(),
-                            [](const auto &c) { return c.mime == QStringLiteral("image/jpeg"); })) {
+            QString             mime = selected ? selected->mime : QString();
+            if (mime == QLatin1String("video/x-raw")) {
+                // nothing to decode, the filter is all there is
+                GstElement *filter = gst_element_factory_make("capsfilter", nullptr);
+                g_object_set(G_OBJECT(filter), "caps", capsfilter, nullptr);
+                gst_caps_unref(capsfilter);
+                capsfilter = nullptr;
+                gst_bin_add(GST_BIN(bin), filter);
+                toLink.append(filter);
+                gst_ghost_pad_set_target(GST_GHOST_PAD(binPad), gst_element_get_static_pad(filter, "src"));
+
+            } else if (mime == QLatin1String("image/jpeg")) {
                 GstElement *jpegdec = gst_element_factory_make("jpegdec", nullptr);
-                Q_ASSERT(gst_bin_add(GST_BIN(bin), jpegdec));
+                gst_bin_add(GST_BIN(bin), jpegdec);
                 toLink.append(jpegdec);
-                Q_ASSERT(gst_ghost_pad_set_target(GST_GHOST_PAD(binPad), gst_element_get_static_pad(jpegdec, "src")));
+                gst_ghost_pad_set_target(GST_GHOST_PAD(binPad), gst_element_get_static_pad(jpegdec, "src"));
 
-            } else if (std::any_of(device->caps.begin(), device->caps.end(),
-                                   [](const auto &c) { return c.mime == QStringLiteral("video/x-h264"); })) {
+            } else if (encoded) {
+                // parsed into whole access units, parameter sets in front of
+                //   each idr, as the payloader and a late decoder want it
+                GstElement *h264parse = gst_element_factory_make("h264parse", nullptr);
+                g_object_set(G_OBJECT(h264parse), "config-interval", -1, nullptr);
+                gst_bin_add(GST_BIN(bin), h264parse);
+                toLink.append(h264parse);
+
+                GstElement *filter = gst_element_factory_make("capsfilter", nullptr);
+                GstCaps    *caps   = gst_caps_new_simple("video/x-h264", "stream-format", G_TYPE_STRING, "byte-stream",
+                                                         "alignment", G_TYPE_STRING, "au", nullptr);
+                g_object_set(G_OBJECT(filter), "caps", caps, nullptr);
+                gst_caps_unref(caps);
+                gst_bin_add(GST_BIN(bin), filter);
+                toLink.append(filter);
+                gst_ghost_pad_set_target(GST_GHOST_PAD(binPad), gst_element_get_static_pad(filter, "src"));
+
+            } else if (mime == QLatin1String("video/x-h264")) {
                 GstElement *h264parse = gst_element_factory_make("h264parse", nullptr);
                 gst_bin_add(GST_BIN(bin), h264parse);
                 toLink.append(h264parse);
@@ -326,24 +599,15 @@ path2::caps="video/x-raw" \
                 g_signal_connect(G_OBJECT(decodebin), "pad-added", G_CALLBACK(videosrcbin_pad_added), binPad);
             }
 
-            //             GstElement *switchbin = gst_parse_launch(R"GST(switchbin num-paths=3
-            // path0::caps="video/x-h264" path0::element="h264parse ! avdec_h264"
-            // path1::caps="image/jpeg"   path1::element="jpegdec"
-            // path2::caps="video/x-raw")GST",
-            //                                                      nullptr);
-            //             gst_bin_add(GST_BIN(bin), switchbin);
-
             if (capsfilter) {
-                Q_ASSERT(gst_element_link_filtered(deviceElement, toLink[0], capsfilter));
+                if (!gst_element_link_pads_filtered(deviceElement, devicePad, toLink[0], nullptr, capsfilter))
+                    qWarning("Failed to link video source");
                 gst_caps_unref(capsfilter);
             } else {
                 gst_element_link(deviceElement, toLink[0]);
             }
-            if (toLink.size() > 1) {
-                for (int i = 1; i < toLink.size(); i++) {
-                    Q_ASSERT(gst_element_link(toLink[i - 1], toLink[i]));
-                }
-            }
+            for (int i = 1; i < toLink.size(); i++)
+                gst_element_link(toLink[i - 1], toLink[i]);
         } else // AudioOut
         {
             GstElement *audioconvert  = gst_element_factory_make("audioconvert", nullptr);
@@ -394,7 +658,7 @@ path2::caps="video/x-raw" \
 
 public:
     PipelineDevice(const QString &_id, PDevice::Type _type, PipelineDeviceContextPrivate *context,
-                   DeviceMonitor *deviceMonitor) : refs(0), id(_id), type(_type)
+                   DeviceMonitor *_deviceMonitor) : refs(0), id(_id), type(_type), deviceMonitor(_deviceMonitor)
     {
         pipeline = context->pipeline->element();
 
@@ -403,8 +667,8 @@ public:
             qWarning("Failed to create device");
             return;
         }
-
-        // TODO: use context->opts.fps?
+        captureOptions      = context->opts;
+        captureOptions.h264 = encoded;
 
         if (type == PDevice::AudioIn || type == PDevice::VideoIn) {
             tee = gst_element_factory_make("tee", nullptr);
@@ -418,6 +682,29 @@ public:
         {
             gst_bin_add(GST_BIN(pipeline), device_bin);
 
+            // all refs are mixed into the one device, so any number of
+            //   remote streams cost one conversion, one echo probe and one
+            //   device write
+            mixer = gst_element_factory_make("audiomixer", nullptr);
+            if (mixer) {
+                gst_bin_add(GST_BIN(pipeline), mixer);
+
+                GstCaps *caps = gst_caps_new_simple("audio/x-raw", "rate", G_TYPE_INT, MIXER_RATE, "format",
+                                                    G_TYPE_STRING, "S16LE", "channels", G_TYPE_INT, MIXER_CHANNELS,
+                                                    "layout", G_TYPE_STRING, "interleaved", nullptr);
+                gst_element_link_filtered(mixer, device_bin, caps);
+                gst_caps_unref(caps);
+            } else {
+                qWarning("Failed to create GStreamer audiomixer element instance. Audio output can't be shared");
+            }
+
+            // the pipeline may be running for other devices
+            if (GST_STATE_TARGET(pipeline) == GST_STATE_PLAYING) {
+                gst_element_sync_state_with_parent(device_bin);
+                if (mixer)
+                    gst_element_sync_state_with_parent(mixer);
+            }
+
             // sink starts out activated
             activated = true;
         }
@@ -433,14 +720,22 @@ public:
             return;
 
         if (type == PDevice::AudioIn || type == PDevice::VideoIn) {
+            gst_element_set_state(device_bin, GST_STATE_NULL);
             gst_bin_remove(GST_BIN(pipeline), device_bin);
 
-            if (tee)
+            if (tee) {
+                gst_element_set_state(tee, GST_STATE_NULL);
                 gst_bin_remove(GST_BIN(pipeline), tee);
+            }
         } else // AudioOut
         {
             gst_element_set_state(device_bin, GST_STATE_NULL);
             gst_bin_remove(GST_BIN(pipeline), device_bin);
+
+            if (mixer) {
+                gst_element_set_state(mixer, GST_STATE_NULL);
+                gst_bin_remove(GST_BIN(pipeline), mixer);
+            }
         }
     }
 
@@ -448,20 +743,59 @@ public:
     {
         Q_ASSERT(!contexts.contains(context));
 
-        // TODO: consider context->opts for refs after first
-
         if (type == PDevice::AudioIn || type == PDevice::VideoIn) {
-            // create a queue from the tee, and hand it off.  app
-            //   uses this queue element as if it were the actual
-            //   device
-            GstElement *queue
+            // create a branch off the tee, and hand it off.  app uses
+            //   this element as if it were the actual device
+            GstElement *bin = gst_bin_new(nullptr);
+            context->queue
                 = gst_element_factory_make("queue", type == PDevice::AudioIn ? "queue_audioin" : "queue_videoin");
-            context->element = queue;
-            // gst_element_set_locked_state(queue, TRUE);
-            gst_bin_add(GST_BIN(pipeline), queue);
-            gst_element_link(tee, queue);
-        } else // AudioOut
+            gst_bin_add(GST_BIN(bin), context->queue);
+
+            GstPad *pad = gst_element_get_static_pad(context->queue, "src");
+            gst_element_add_pad(bin, gst_ghost_pad_new("src", pad));
+            if (type == PDevice::VideoIn && !(encoded && context->opts.h264))
+                gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, consumer_caps_probe, context, nullptr);
+            gst_object_unref(GST_OBJECT(pad));
+
+            context->element = bin;
+            gst_bin_add(GST_BIN(pipeline), bin);
+        } else if (mixer) // AudioOut
         {
+            // streams of any format can be linked to the converter.  the
+            //   mixer can't resample, but for streams already in the mixer
+            //   format both elements do nothing.
+            GstElement *convert       = gst_element_factory_make("audioconvert", nullptr);
+            GstElement *audioresample = gst_element_factory_make("audioresample", nullptr);
+            GstElement *bin           = gst_bin_new(nullptr);
+            gst_bin_add(GST_BIN(bin), convert);
+            gst_bin_add(GST_BIN(bin), audioresample);
+            gst_element_link(convert, audioresample);
+
+            GstPad *pad = gst_element_get_static_pad(convert, "sink");
+            gst_element_add_pad(bin, gst_ghost_pad_new("sink", pad));
+            gst_object_unref(GST_OBJECT(pad));
+            pad = gst_element_get_static_pad(audioresample, "src");
+            gst_element_add_pad(bin, gst_ghost_pad_new("src", pad));
+            gst_object_unref(GST_OBJECT(pad));
+
+            context->element = bin;
+            gst_bin_add(GST_BIN(pipeline), bin);
+
+#if GST_CHECK_VERSION(1, 20, 0)
+            context->mixerpad = gst_element_request_pad_simple(mixer, "sink_%u");
+#else
+            context->mixerpad = gst_element_get_request_pad(mixer, "sink_%u");
+#endif
+            pad = gst_element_get_static_pad(bin, "src");
+            gst_pad_link(pad, context->mixerpad);
+            gst_object_unref(GST_OBJECT(pad));
+
+            // the pipeline may be running for other refs already
+            gst_element_sync_state_with_parent(bin);
+
+            // sink starts out activated
+            context->activated = true;
+        } else {
             context->element = device_bin;
             // sink starts out activated
             context->activated = true;
@@ -469,130 +803,201 @@ public:
 
         contexts += context;
         ++refs;
+
+        if (type == PDevice::AudioIn || type == PDevice::VideoIn) {
+            // the device captures for the most demanding ref
+            renegotiate();
+
+            // joining a running pipeline, the ref waits until linked
+            if (GST_STATE_TARGET(pipeline) == GST_STATE_PLAYING)
+                gst_element_set_locked_state(context->element, TRUE);
+            else
+                activate(context);
+        }
     }
 
     void removeRef(PipelineDeviceContextPrivate *context)
     {
         Q_ASSERT(contexts.contains(context));
 
-        // TODO: recalc video properties
-
         if (type == PDevice::AudioIn || type == PDevice::VideoIn) {
             // deactivate if not done so already
             deactivate(context);
 
-            GstElement *queue = context->element;
-            gst_bin_remove(GST_BIN(pipeline), queue);
+            gst_element_set_locked_state(context->element, FALSE);
+            gst_bin_remove(GST_BIN(pipeline), context->element);
+            context->element = nullptr;
+            context->queue   = nullptr;
+        } else if (context->mixerpad) // AudioOut
+        {
+            GstElement *bin = context->element;
+            gst_element_set_state(bin, GST_STATE_NULL);
+            gst_bin_remove(GST_BIN(pipeline), bin);
+
+            gst_element_release_request_pad(mixer, context->mixerpad);
+            gst_object_unref(context->mixerpad);
+            context->mixerpad = nullptr;
         }
 
         contexts.remove(context);
         --refs;
+
+        // those left may do with less
+        if (refs > 0)
+            renegotiate();
     }
 
+    // links a src ref to the tee again, and starts the device if it was
+    //   stopped.  sinks are always active.
     void activate(PipelineDeviceContextPrivate *context)
     {
-        // activate the context
+        if (type == PDevice::AudioOut) {
+            context->activated = true;
+            activated          = true;
+            return;
+        }
+
         if (!context->activated) {
-            // GstElement *queue = context->element;
-            // gst_element_set_locked_state(queue, FALSE);
-            // gst_element_set_state(queue, GST_STATE_PLAYING);
+#if GST_CHECK_VERSION(1, 20, 0)
+            context->teepad = gst_element_request_pad_simple(tee, "src_%u");
+#else
+            context->teepad = gst_element_get_request_pad(tee, "src_%u");
+#endif
+            GstPad *pad = gst_element_get_static_pad(context->queue, "sink");
+            gst_pad_link(context->teepad, pad);
+            gst_object_unref(GST_OBJECT(pad));
+
+            gst_element_set_locked_state(context->element, FALSE);
+            gst_element_sync_state_with_parent(context->element);
             context->activated = true;
         }
 
-        // activate the device
         if (!activated) {
-            // gst_element_set_locked_state(tee, FALSE);
-            // gst_element_set_locked_state(bin, FALSE);
-            // gst_element_set_state(tee, GST_STATE_PLAYING);
-            // gst_element_set_state(bin, GST_STATE_PLAYING);
+            gst_element_set_locked_state(device_bin, FALSE);
+            gst_element_sync_state_with_parent(tee);
+            gst_element_sync_state_with_parent(device_bin);
             activated = true;
         }
     }
 
+    // unlinks a src ref from the tee and stops it, so its elements can be
+    //   unlinked.  with no active ref left the device is stopped as well,
+    //   which closes it.
     void deactivate(PipelineDeviceContextPrivate *context)
     {
-#if 0
-        if(activated && refs == 1)
-        {
-            if(type == PDevice::AudioIn || type == PDevice::VideoIn)
-            {
-                gst_element_set_locked_state(bin, TRUE);
+        if (type == PDevice::AudioOut)
+            return;
 
-                if(speexdsp)
-                    gst_element_set_locked_state(speexdsp, TRUE);
+        if (context->activated) {
+            GstPad *pad = gst_element_get_static_pad(context->queue, "sink");
+            gst_pad_unlink(context->teepad, pad);
+            gst_object_unref(GST_OBJECT(pad));
+            gst_element_release_request_pad(tee, context->teepad);
+            gst_object_unref(context->teepad);
+            context->teepad = nullptr;
 
-                if(tee)
-                    gst_element_set_locked_state(tee, TRUE);
-            }
+            gst_element_set_locked_state(context->element, TRUE);
+            gst_element_set_state(context->element, GST_STATE_NULL);
+            context->activated = false;
         }
 
-        if(context->activated)
-        {
-            if(type == PDevice::AudioIn || type == PDevice::VideoIn)
-            {
-                GstElement *queue = context->element;
-                gst_element_set_locked_state(queue, TRUE);
-            }
+        bool inUse = std::any_of(contexts.begin(), contexts.end(),
+                                 [](PipelineDeviceContextPrivate *c) { return c->activated; });
+        if (activated && !inUse) {
+            gst_element_set_locked_state(device_bin, TRUE);
+            gst_element_set_state(device_bin, GST_STATE_NULL);
+            activated = false;
         }
+    }
 
-        if(activated && refs == 1)
-        {
-            if(type == PDevice::AudioIn || type == PDevice::VideoIn)
-            {
-                gst_element_set_state(bin, GST_STATE_NULL);
-                gst_element_get_state(bin, nullptr, nullptr, GST_CLOCK_TIME_NONE);
-
-                //qDebug("set to null");
-                if(speexdsp)
-                {
-                    gst_element_set_state(speexdsp, GST_STATE_NULL);
-                    gst_element_get_state(speexdsp, nullptr, nullptr, GST_CLOCK_TIME_NONE);
-                }
-NULL
-                if(tee)
-                {
-                    gst_element_set_state(tee, GST_STATE_NULL);
-                    gst_element_get_state(tee, nullptr, nullptr, GST_CLOCK_TIME_NONE);
-                }
-            }
+    // video in: the most any ref asks for.  the device stays encoded or
+    //   not, as refs were handed out for that.
+    PipelineDeviceOptions wantedOptions() const
+    {
+        PipelineDeviceOptions opts = captureOptions;
+        opts.videoSize             = QSize();
+        opts.fps                   = -1;
+        for (PipelineDeviceContextPrivate *c : contexts) {
+            QMutexLocker locker(&c->m);
+            if (c->opts.videoSize.isValid())
+                opts.videoSize = opts.videoSize.expandedTo(c->opts.videoSize);
+            opts.fps = qMax(opts.fps, c->opts.fps);
         }
+        opts.h264 = encoded;
+        return opts;
+    }
 
-        if(context->activated)
-        {
-            if(type == PDevice::AudioIn || type == PDevice::VideoIn)
-            {
-                GstElement *queue = context->element;
-
-                // FIXME: until we fix this, we only support 1 ref
-                // get tee and prepare srcpad
-                /*GstPad *sinkpad = gst_element_get_pad(queue, "sink");
-                GstPad *srcpad = gst_pad_get_peer(sinkpad);
-                gst_object_unref(GST_OBJECT(sinkpad));
-                gst_element_release_request_pad(tee, srcpad);
-                gst_object_unref(GST_OBJECT(srcpad));*/
+    // video in: captures in another mode if the refs want more or less than
+    //   what is captured.  a camera can't be opened twice, so the device
+    //   bin is replaced, closing the camera before opening it again.  refs
+    //   adapt to the new caps on their own.
+    void renegotiate()
+    {
+        if (type != PDevice::VideoIn)
+            return;
 
-                // set queue to null state
-                gst_element_set_state(queue, GST_STATE_NULL);
-                gst_element_get_state(queue, nullptr, nullptr, GST_CLOCK_TIME_NONE);
+        PipelineDeviceOptions wanted = wantedOptions();
+        if (wanted.videoSize == captureOptions.videoSize && wanted.fps == captureOptions.fps)
+            return;
 
-                context->activated = false;
-            }
+        bool        wasEncoded = encoded;
+        GstElement *bin        = makeDeviceBin(wanted, deviceMonitor);
+        if (bin && encoded != wasEncoded) {
+            // refs were handed out for the other
+            gst_object_unref(bin);
+            bin = nullptr;
         }
-
-        if(activated && refs == 1)
-        {
-            if(type == PDevice::AudioIn || type == PDevice::VideoIn)
-                activated = false;
+        encoded = wasEncoded;
+        if (!bin) {
+            qWarning("Failed to renegotiate %s:[%s], capturing as before", type_to_str(type), qPrintable(id));
+            return;
         }
+
+#ifdef PIPELINE_DEBUG
+        qDebug("Renegotiating %s:[%s] for %dx%d at %d fps", type_to_str(type), qPrintable(id), wanted.videoSize.width(),
+               wanted.videoSize.height(), wanted.fps);
 #endif
-        // FIXME
-        context->activated = false;
-        activated          = false;
+        gst_element_set_locked_state(device_bin, TRUE);
+        gst_element_set_state(device_bin, GST_STATE_NULL);
+        gst_element_unlink(device_bin, tee);
+        gst_bin_remove(GST_BIN(pipeline), device_bin);
+
+        device_bin     = bin;
+        captureOptions = wanted;
+        gst_bin_add(GST_BIN(pipeline), device_bin);
+        gst_element_link(device_bin, tee);
+        if (activated)
+            gst_element_sync_state_with_parent(device_bin);
+        else
+            gst_element_set_locked_state(device_bin, TRUE);
     }
 
     void update(const PipelineDeviceContext &ctx)
     {
-        // TODO: change video properties based on options
+        if (type == PDevice::VideoIn) {
+            // a converting ref converts to the new options right away, any
+            //   other one once it is idle
+            auto context    = ctx.d;
+            bool converting = false;
+            {
+                QMutexLocker locker(&context->m);
+                if (context->convfilter) {
+                    GstCaps *caps = consumer_caps(context->opts);
+                    g_object_set(G_OBJECT(context->convfilter), "caps", caps, nullptr);
+                    gst_caps_unref(caps);
+                    converting = true;
+                }
+            }
+            // an idle pad calls the probe right away, which locks as well
+            if (!converting && !(encoded && context->opts.h264)) {
+                GstPad *pad = gst_element_get_static_pad(context->queue, "src");
+                gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_IDLE, consumer_idle_probe, context, nullptr);
+                gst_object_unref(GST_OBJECT(pad));
+            }
+            renegotiate();
+            return;
+        }
+
         if (type == PDevice::AudioIn && ctx.options().aec && !webrtcdspInitialized) {
             // seems like we want to enable AEC. for this we have to modify already running pipeline
             if (!aindev) {
@@ -675,8 +1080,8 @@ public:
     void deactivate()
     {
         if (activated) {
+            // going down, the state is reached before set_state() returns
             gst_element_set_state(pipeline, GST_STATE_NULL);
-            gst_element_get_state(pipeline, nullptr, nullptr, GST_CLOCK_TIME_NONE);
             activated = false;
         }
     }
@@ -725,10 +1130,15 @@ PipelineDeviceContext *PipelineDeviceContext::create(PipelineContext *pipeline,
         that->d->opts.echoProberName = dev->echoProbeName();
 
         pipeline->d->devices += dev;
-    } else {
-        // FIXME: make sharing work
-        // dev->addRef(that->d);
+    } else if (type != PDevice::AudioOut || dev->mixer) {
+        dev->addRef(that->d);
+        that->d->opts.echoProberName = dev->echoProbeName();
 
+        // echo cancellation may be wanted by this ref only
+        if (type == PDevice::AudioIn)
+            dev->update(*that);
+    } else {
+        // without a mixer the sink can't be shared
         delete that;
         return nullptr;
     }
@@ -765,12 +1175,19 @@ void PipelineDeviceContext::deactivate() { d->device->deactivate(d); }
 
 GstElement *PipelineDeviceContext::element() { return d->element; }
 
+QString PipelineDeviceContext::id() const { return d->device->id; }
+
 void PipelineDeviceContext::setOptions(const PipelineDeviceOptions &opts)
 {
-    d->opts = opts;
+    {
+        QMutexLocker locker(&d->m);
+        d->opts = opts;
+    }
     d->device->update(*this);
 }
 
 PipelineDeviceOptions PipelineDeviceContext::options() const { return d->opts; }
 
+bool PipelineDeviceContext::isEncoded() const { return d->device->encoded && d->opts.h264; }
+
 }
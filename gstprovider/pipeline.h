@@ -67,8 +67,14 @@ public:
     int     fps = -1;
     bool    aec = false; // echo cancellation (will be enabled when prober is available)
     QString echoProberName;
+    bool    h264 = false; // a camera's own h264 is welcome, see isEncoded()
 };
 
+// a device may be created any number of times.  the streams linked to the
+//   elements of an audio output are mixed.  an input is captured once, for
+//   the most any ref asks for, and each ref gets its own branch of it, which
+//   scales, rates or decodes only if the ref's options ask for less than
+//   what is captured.  the capture mode follows as refs come and go.
 class PipelineDeviceContext {
 public:
     static PipelineDeviceContext *create(PipelineContext *pipeline, const QString &id, PDevice::Type type,
@@ -79,28 +85,33 @@ public:
     PipelineDeviceContext(const PipelineDeviceContext &)            = delete;
     PipelineDeviceContext &operator=(const PipelineDeviceContext &) = delete;
 
-    // after creation, the device element is in the NULL state, and
-    //   potentially not linked to dependent internal elements.  call
-    //   activate() to cause internals to be finalized and set to
-    //   PLAYING.  the purpose of the activate() call is to give you time
-    //   to get your own elements into the pipeline, linked, and perhaps
-    //   set to PLAYING before the device starts working.
+    // elements start out activated, an input's following the state of the
+    //   pipeline.  an input element created while the pipeline is playing
+    //   however stays in the NULL state, unlinked from the device, until
+    //   activate().  this gives you time to get your own elements into the
+    //   pipeline, linked, and set to PLAYING before data flows.
     //
-    // note: this only applies to input (src) elements.  output (sink)
-    //   elements start out activated.
-    // FIXME: this function currently does nothing
+    // activate() also links an input element to the device again after
+    //   deactivate(), and restarts the device if it was stopped.
     void activate();
 
-    // call this in order to stop the device element.  it will be safely
-    //   set to the NULL state, so that you may then unlink your own
-    //   elements from it.
-    // FIXME: this function currently does nothing
+    // call this in order to stop the element of an input.  it will be
+    //   unlinked from the device and set to the NULL state, so that you
+    //   may then unlink your own elements from it.  the device itself is
+    //   stopped, closing it, once no ref is active.
     void deactivate();
 
     GstElement           *element();
+    QString               id() const;
     void                  setOptions(const PipelineDeviceOptions &opts);
     PipelineDeviceOptions options() const;
 
+    // a video input giving h264 (byte-stream, whole access units) instead
+    //   of raw video.  only if asked for in the options, and the camera
+    //   encodes a mode good enough, in constrained baseline, and takes
+    //   keyframe requests, which needs uvch264src.
+    bool isEncoded() const;
+
 private:
     PipelineDeviceContext();
 
@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "pipelinecompositor.h"
+
+#include "rtpworker.h"
+
+#include <QtMath>
+
+// until the output size is known
+#define COMPOSITOR_DEFAULT_WIDTH 640
+#define COMPOSITOR_DEFAULT_HEIGHT 480
+
+// frames per second delivered, whatever the streams have
+#define COMPOSITOR_FPS 30
+
+namespace PsiMedia {
+
+PipelineCompositor::PipelineCompositor() : outputSize(COMPOSITOR_DEFAULT_WIDTH, COMPOSITOR_DEFAULT_HEIGHT) { }
+
+PipelineCompositor::~PipelineCompositor() { destroyElements(); }
+
+int PipelineCompositor::createTile()
+{
+    QMutexLocker locker(&m);
+    Tile         t;
+    t.id = nextTile++;
+    tiles += t;
+    return t.id;
+}
+
+void PipelineCompositor::destroyTile(int tile)
+{
+    QMutexLocker locker(&m);
+    Tile        *t = findTile(tile);
+    if (!t)
+        return;
+
+    if (t->pad) {
+        t->destroyed = true;
+        t->visible   = false;
+        updateLayout();
+        return;
+    }
+
+    removeTile(tile);
+}
+
+void PipelineCompositor::setTileVisible(int tile, bool visible)
+{
+    QMutexLocker locker(&m);
+    Tile        *t = findTile(tile);
+    if (!t || t->destroyed || t->visible == visible)
+        return;
+
+    t->visible = visible;
+    updateLayout();
+}
+
+void PipelineCompositor::setOutputSize(const QSize &size)
+{
+    if (size.isEmpty())
+        return;
+
+    QMutexLocker locker(&m);
+    if (size == outputSize)
+        return;
+
+    outputSize = size;
+    updateCaps();
+    updateLayout();
+}
+
+void PipelineCompositor::setFrameCallback(std::function<void(const QImage &)> &&callback)
+{
+    QMutexLocker locker(&callback_mutex);
+    frameCallback = std::move(callback);
+}
+
+bool PipelineCompositor::addStream(GstElement *pipeline, int tile, GstPad *src)
+{
+    QMutexLocker locker(&m);
+    Tile        *t = findTile(tile);
+    if (!t || t->destroyed || t->pad)
+        return false;
+
+    if (!compositor) {
+        if (!createElements(pipeline))
+            return false;
+    } else if (pipeline != this->pipeline)
+        return false;
+
+#if GST_CHECK_VERSION(1, 20, 0)
+    t->pad = gst_element_request_pad_simple(compositor, "sink_%u");
+#else
+    t->pad = gst_element_get_request_pad(compositor, "sink_%u");
+#endif
+
+    // tiles rarely have the aspect ratio of the video
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(t->pad), "sizing-policy"))
+        gst_util_set_object_arg(G_OBJECT(t->pad), "sizing-policy", "keep-aspect-ratio");
+
+    if (gst_pad_link(src, t->pad) != GST_PAD_LINK_OK) {
+        gst_element_release_request_pad(compositor, t->pad);
+        gst_object_unref(t->pad);
+        t->pad = nullptr;
+
+        bool inUse = false;
+        for (const Tile &i : std::as_const(tiles))
+            inUse |= i.pad != nullptr;
+        if (!inUse)
+            destroyElements();
+        return false;
+    }
+
+    updateLayout();
+    return true;
+}
+
+void PipelineCompositor::removeStream(int tile)
+{
+    QMutexLocker locker(&m);
+    Tile        *t = findTile(tile);
+    if (!t || !t->pad)
+        return;
+
+    GstPad *peer = gst_pad_get_peer(t->pad);
+    if (peer) {
+        gst_pad_unlink(peer, t->pad);
+        gst_object_unref(peer);
+    }
+    gst_element_release_request_pad(compositor, t->pad);
+    gst_object_unref(t->pad);
+    t->pad = nullptr;
+
+    if (t->destroyed)
+        removeTile(tile);
+
+    bool inUse = false;
+    for (const Tile &i : std::as_const(tiles))
+        inUse |= i.pad != nullptr;
+    if (inUse)
+        updateLayout();
+    else
+        destroyElements();
+}
+
+PipelineCompositor::Tile *PipelineCompositor::findTile(int id)
+{
+    for (Tile &t : tiles) {
+        if (t.id == id)
+            return &t;
+    }
+    return nullptr;
+}
+
+void PipelineCompositor::removeTile(int id)
+{
+    for (int n = 0; n < tiles.count(); ++n) {
+        if (tiles[n].id == id) {
+            tiles.removeAt(n);
+            return;
+        }
+    }
+}
+
+bool PipelineCompositor::createElements(GstElement *_pipeline)
+{
+    compositor = gst_element_factory_make("compositor", nullptr);
+    if (!compositor) {
+        qWarning("Failed to create GStreamer compositor element instance. Video can't be tiled");
+        return false;
+    }
+    gst_util_set_object_arg(G_OBJECT(compositor), "background", "black");
+
+    capsfilter = gst_element_factory_make("capsfilter", nullptr);
+    appsink    = gst_element_factory_make("appsink", nullptr);
+
+    GstAppSinkCallbacks callbacks {};
+    callbacks.new_sample = cb_new_sample;
+    gst_app_sink_set_callbacks(GST_APP_SINK(appsink), &callbacks, this, nullptr);
+
+    pipeline = _pipeline;
+    updateCaps();
+
+    gst_bin_add_many(GST_BIN(pipeline), compositor, capsfilter, appsink, nullptr);
+    gst_element_link_many(compositor, capsfilter, appsink, nullptr);
+
+    // the pipeline may be playing the streams of other sessions already
+    gst_element_sync_state_with_parent(appsink);
+    gst_element_sync_state_with_parent(capsfilter);
+    gst_element_sync_state_with_parent(compositor);
+    return true;
+}
+
+// callback_mutex must not be locked, or this waits for the streaming thread
+//   forever
+void PipelineCompositor::destroyElements()
+{
+    if (!compositor)
+        return;
+
+    for (GstElement *e : { compositor, capsfilter, appsink }) {
+        gst_element_set_state(e, GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(pipeline), e);
+    }
+
+    compositor = nullptr;
+    capsfilter = nullptr;
+    appsink    = nullptr;
+    pipeline   = nullptr;
+}
+
+void PipelineCompositor::updateLayout()
+{
+    QList<Tile *> shown;
+    for (Tile &t : tiles) {
+        if (!t.pad)
+            continue;
+
+        if (t.visible)
+            shown += &t;
+        else
+            g_object_set(G_OBJECT(t.pad), "alpha", 0.0, nullptr);
+    }
+    if (shown.isEmpty())
+        return;
+
+    int cols = qCeil(qSqrt(shown.count()));
+    int rows = (int(shown.count()) + cols - 1) / cols;
+    int w    = outputSize.width() / cols;
+    int h    = outputSize.height() / rows;
+    for (int n = 0; n < shown.count(); ++n) {
+        g_object_set(G_OBJECT(shown[n]->pad), "xpos", (n % cols) * w, "ypos", (n / cols) * h, "width", w, "height",
+                     h, "alpha", 1.0, nullptr);
+    }
+}
+
+void PipelineCompositor::updateCaps()
+{
+    if (!capsfilter)
+        return;
+
+    GstCaps *caps = gst_caps_new_simple("video/x-raw", "format", G_TYPE_STRING, "BGRx", "width", G_TYPE_INT,
+                                        outputSize.width(), "height", G_TYPE_INT, outputSize.height(), "framerate",
+                                        GST_TYPE_FRACTION, COMPOSITOR_FPS, 1, "pixel-aspect-ratio",
+                                        GST_TYPE_FRACTION, 1, 1, nullptr);
+    g_object_set(G_OBJECT(capsfilter), "caps", caps, nullptr);
+    gst_caps_unref(caps);
+}
+
+GstFlowReturn PipelineCompositor::cb_new_sample(GstAppSink *appsink, gpointer data)
+{
+    auto             self  = static_cast<PipelineCompositor *>(data);
+    RtpWorker::Frame frame = RtpWorker::Frame::pullFromSink(appsink);
+
+    QMutexLocker locker(&self->callback_mutex);
+    if (self->frameCallback && !frame.image.isNull())
+        self->frameCallback(frame.image);
+    return GST_FLOW_OK;
+}
+
+}
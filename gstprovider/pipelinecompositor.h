@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef PSI_PIPELINECOMPOSITOR_H
+#define PSI_PIPELINECOMPOSITOR_H
+
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QSize>
+#include <functional>
+#include <gst/app/gstappsink.h>
+#include <gst/gst.h>
+
+namespace PsiMedia {
+
+// tiles the decoded video of several streams into one frame of the output
+//   size.  each stream is scaled once, by the compositor straight into its
+//   tile, and frames of hidden tiles are not converted at all.  the elements
+//   go into the pipeline with the first stream and are taken out again with
+//   the last one.
+//
+// everything but addStream() and removeStream() may be called from any
+//   thread.
+class PipelineCompositor {
+public:
+    PipelineCompositor();
+    ~PipelineCompositor();
+
+    PipelineCompositor(const PipelineCompositor &)            = delete;
+    PipelineCompositor &operator=(const PipelineCompositor &) = delete;
+
+    // tiles are laid out in a grid, in the order they were created.  a
+    //   tile destroyed while a stream is linked to it is hidden until the
+    //   stream is removed.
+    int  createTile();
+    void destroyTile(int tile);
+    void setTileVisible(int tile, bool visible);
+    void setOutputSize(const QSize &size);
+
+    // called from the streaming thread with every composited frame
+    void setFrameCallback(std::function<void(const QImage &)> &&callback);
+
+    // link src, a pad of an element in pipeline (or a ghost pad of one),
+    //   to the tile.  returns false if that is not possible, e.g. because
+    //   the elements are in another pipeline already.
+    bool addStream(GstElement *pipeline, int tile, GstPad *src);
+
+    // the element of the stream must be out of the pipeline already
+    void removeStream(int tile);
+
+private:
+    class Tile {
+    public:
+        int     id;
+        bool    visible   = true;
+        bool    destroyed = false;
+        GstPad *pad       = nullptr; // on the compositor, while a stream is linked
+    };
+
+    QMutex      m;
+    QList<Tile> tiles;
+    int         nextTile = 0;
+    QSize       outputSize;
+
+    GstElement *pipeline   = nullptr;
+    GstElement *compositor = nullptr;
+    GstElement *capsfilter = nullptr;
+    GstElement *appsink    = nullptr;
+
+    // separate, so the streaming thread never waits for state changes
+    QMutex                              callback_mutex;
+    std::function<void(const QImage &)> frameCallback;
+
+    Tile *findTile(int id);
+    void  removeTile(int id);
+    bool  createElements(GstElement *pipeline);
+    void  destroyElements();
+    void  updateLayout();
+    void  updateCaps();
+
+    static GstFlowReturn cb_new_sample(GstAppSink *appsink, gpointer data);
+};
+
+}
+
+#endif
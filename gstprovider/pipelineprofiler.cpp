@@ -0,0 +1,555 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "pipelineprofiler.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QStringList>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+namespace PsiMedia {
+
+class ElementProfile {
+public:
+    quint64 procCount    = 0;
+    quint64 procSum      = 0; // ns
+    quint64 procMax      = 0;
+    quint64 latCount     = 0;
+    quint64 latSum       = 0; // ns
+    quint64 latMax       = 0;
+    quint64 queueCount   = 0;
+    quint64 buffersSum   = 0;
+    quint64 buffersMax   = 0;
+    quint64 queueTimeSum = 0; // ns
+    quint64 queueTimeMax = 0;
+    quint64 thread       = 0; // the last one seen pushing its buffers
+};
+
+class ThreadProfile {
+public:
+    quint64 loadSum   = 0; // per mille
+    quint64 loadCount = 0;
+};
+
+// factories and the parameters their tracers get.  proctime and queuelevel
+//   come with gst-shark.
+static const char *const tracers[][2] = {
+    { "latency", "flags=pipeline+element" },
+    { "proctime", nullptr },
+    { "queuelevel", nullptr },
+    { "rusage", nullptr },
+};
+
+class Profiler {
+public:
+    QMutex        m;
+    int           refs = 0;
+    QElapsedTimer since;
+
+    // latency records carry the element's address as its id, the
+    //   gst-shark ones just the name
+    QHash<QString, ElementProfile> byId;
+    QHash<QString, ElementProfile> byName;
+    QHash<quint64, ThreadProfile>  threads;
+    ThreadProfile                  process;
+
+    // the tracers and the log function are installed the first time and
+    //   stay.  the log function only takes the records while active.
+    bool               installed = false;
+    QStringList        missing; // tracers not available
+    QList<GstObject *> tracerObjects;
+
+    GstDebugCategory          *category = nullptr;
+    std::atomic<bool>          active { false };
+    std::atomic<GstDebugLevel> savedThreshold { GST_LEVEL_NONE };
+    std::atomic<bool>          hadDefaultLog { false };
+};
+
+static Profiler *profiler()
+{
+    static Profiler p;
+    return &p;
+}
+
+static quint64 current_thread() { return quint64(quintptr(g_thread_self())); }
+
+// the tracers spell their fields differently, with dashes or underscores
+static const GValue *get_field(const GstStructure *s, const char *name)
+{
+    const GValue *v = gst_structure_get_value(s, name);
+    if (v)
+        return v;
+
+    QByteArray alt(name);
+    alt.replace('-', '_');
+    return gst_structure_get_value(s, alt.constData());
+}
+
+static const char *get_string(const GstStructure *s, const char *name)
+{
+    const GValue *v = get_field(s, name);
+    return v && G_VALUE_HOLDS_STRING(v) ? g_value_get_string(v) : nullptr;
+}
+
+// numbers, or times formatted as strings, which some tracers log
+static bool get_number(const GstStructure *s, const char *name, quint64 *out)
+{
+    const GValue *v = get_field(s, name);
+    if (!v)
+        return false;
+
+    if (G_VALUE_HOLDS_UINT64(v))
+        *out = g_value_get_uint64(v);
+    else if (G_VALUE_HOLDS_INT64(v))
+        *out = quint64(qMax(g_value_get_int64(v), gint64(0)));
+    else if (G_VALUE_HOLDS_UINT(v))
+        *out = g_value_get_uint(v);
+    else if (G_VALUE_HOLDS_INT(v))
+        *out = quint64(qMax(g_value_get_int(v), 0));
+    else if (G_VALUE_HOLDS_STRING(v)) {
+        unsigned int h, m, sec, ns;
+        if (!g_value_get_string(v) || sscanf(g_value_get_string(v), "%u:%u:%u.%u", &h, &m, &sec, &ns) != 4)
+            return false;
+        *out = ((quint64(h) * 60 + m) * 60 + sec) * GST_SECOND + ns;
+    } else
+        return false;
+    return true;
+}
+
+static void add_sample(quint64 value, quint64 *count, quint64 *sum, quint64 *max)
+{
+    ++(*count);
+    *sum += value;
+    *max = qMax(*max, value);
+}
+
+static void profiler_record(Profiler *p, const GstStructure *s)
+{
+    const char *record = gst_structure_get_name(s);
+    quint64     value  = 0;
+
+    if (!strcmp(record, "proctime")) {
+        const char *name = get_string(s, "element");
+        if (!name || !get_number(s, "time", &value))
+            return;
+
+        QMutexLocker    locker(&p->m);
+        ElementProfile &e = p->byName[QString::fromUtf8(name)];
+        add_sample(value, &e.procCount, &e.procSum, &e.procMax);
+        e.thread = current_thread();
+    } else if (!strcmp(record, "element-latency")) {
+        const char *id = get_string(s, "element-id");
+        if (!id || !get_number(s, "time", &value))
+            return;
+
+        QMutexLocker    locker(&p->m);
+        ElementProfile &e = p->byId[QString::fromUtf8(id)];
+        add_sample(value, &e.latCount, &e.latSum, &e.latMax);
+        e.thread = current_thread();
+    } else if (!strcmp(record, "queuelevel") || !strcmp(record, "queue-level")) {
+        const char *name = get_string(s, "queue");
+        if (!name)
+            name = get_string(s, "element");
+        quint64 buffers = 0, time = 0;
+        if (!name || !get_number(s, "size-buffers", &buffers))
+            return;
+        get_number(s, "size-time", &time);
+
+        QMutexLocker    locker(&p->m);
+        ElementProfile &e = p->byName[QString::fromUtf8(name)];
+        add_sample(buffers, &e.queueCount, &e.buffersSum, &e.buffersMax);
+        e.queueTimeSum += time;
+        e.queueTimeMax = qMax(e.queueTimeMax, time);
+    } else if (!strcmp(record, "thread-rusage")) {
+        quint64 thread = 0;
+        if (!get_number(s, "thread-id", &thread) || !get_number(s, "current-cpuload", &value))
+            return;
+
+        QMutexLocker   locker(&p->m);
+        ThreadProfile &t = p->threads[thread];
+        t.loadSum += value;
+        ++t.loadCount;
+    } else if (!strcmp(record, "proc-rusage")) {
+        if (!get_number(s, "current-cpuload", &value))
+            return;
+
+        QMutexLocker locker(&p->m);
+        p->process.loadSum += value;
+        ++p->process.loadCount;
+    }
+}
+
+// takes over from the default log function while profiling, so the tracer
+//   records don't end up on stderr.  what would have been logged anyway,
+//   by GST_DEBUG, still is.
+static void profiler_log(GstDebugCategory *category, GstDebugLevel level, const gchar *file, const gchar *function,
+                         gint line, GObject *object, GstDebugMessage *message, gpointer user_data)
+{
+    auto p = static_cast<Profiler *>(user_data);
+    if (!p->active)
+        return;
+
+    bool wanted = category != p->category || level <= p->savedThreshold;
+    if (wanted && p->hadDefaultLog)
+        gst_debug_log_default(category, level, file, function, line, object, message, nullptr);
+    if (category != p->category)
+        return;
+
+    GstStructure *s = gst_structure_from_string(gst_debug_message_get(message), nullptr);
+    if (!s)
+        return;
+    profiler_record(p, s);
+    gst_structure_free(s);
+}
+
+static GstDebugCategory *find_category(const char *name)
+{
+    GstDebugCategory *out  = nullptr;
+    GSList           *list = gst_debug_get_all_categories();
+    for (GSList *i = list; i; i = i->next) {
+        auto c = static_cast<GstDebugCategory *>(i->data);
+        if (!strcmp(gst_debug_category_get_name(c), name)) {
+            out = c;
+            break;
+        }
+    }
+    g_slist_free(list);
+    return out;
+}
+
+static bool tracer_is_active(GType type)
+{
+    bool found = false;
+#if GST_CHECK_VERSION(1, 18, 0)
+    GList *active = gst_tracing_get_active_tracers();
+    for (GList *i = active; i; i = i->next) {
+        if (G_OBJECT_TYPE(i->data) == type)
+            found = true;
+    }
+    g_list_free_full(active, gst_object_unref);
+#else
+    Q_UNUSED(type);
+#endif
+    return found;
+}
+
+// tracers already set up by GST_TRACERS are left alone
+static bool create_tracer(Profiler *p, const char *name, const char *params)
+{
+    GstPluginFeature *feature = gst_registry_find_feature(gst_registry_get(), name, GST_TYPE_TRACER_FACTORY);
+    if (!feature)
+        return false;
+    GstPluginFeature *loaded = gst_plugin_feature_load(feature);
+    gst_object_unref(feature);
+    if (!loaded)
+        return false;
+    GType type = gst_tracer_factory_get_tracer_type(GST_TRACER_FACTORY(loaded));
+    gst_object_unref(loaded);
+    if (!type)
+        return false;
+
+    if (!tracer_is_active(type)) {
+        auto tracer = static_cast<GstObject *>(g_object_new(type, "params", params, nullptr));
+        p->tracerObjects += static_cast<GstObject *>(gst_object_ref_sink(tracer));
+    }
+    return true;
+}
+
+void PipelineProfiler::acquire()
+{
+    Profiler    *p = profiler();
+    QMutexLocker locker(&p->m);
+    if (p->refs++ > 0)
+        return;
+
+    if (!p->installed) {
+        p->installed = true;
+        for (const auto &tracer : tracers) {
+            if (!create_tracer(p, tracer[0], tracer[1]))
+                p->missing += QString::fromLatin1(tracer[0]);
+        }
+        p->category = find_category("GST_TRACER");
+        gst_debug_add_log_function(profiler_log, p, nullptr);
+    }
+
+    // the tracers log at trace level, into their own category
+    if (p->category) {
+        p->savedThreshold = gst_debug_category_get_threshold(p->category);
+        gst_debug_category_set_threshold(p->category, GST_LEVEL_TRACE);
+    }
+    p->hadDefaultLog = gst_debug_remove_log_function(gst_debug_log_default) > 0;
+    p->active        = true;
+
+    p->since.start();
+}
+
+void PipelineProfiler::release()
+{
+    Profiler    *p = profiler();
+    QMutexLocker locker(&p->m);
+    if (--p->refs > 0)
+        return;
+
+    // the last one out puts the default log function back
+    p->active = false;
+    if (p->hadDefaultLog)
+        gst_debug_add_log_function(gst_debug_log_default, nullptr, nullptr);
+    if (p->category)
+        gst_debug_category_set_threshold(p->category, p->savedThreshold);
+
+    p->byId.clear();
+    p->byName.clear();
+    p->threads.clear();
+    p->process = ThreadProfile();
+}
+
+static void collect_element(const GValue *value, gpointer data)
+{
+    auto e = static_cast<GstElement *>(g_value_get_object(value));
+    static_cast<QList<GstElement *> *>(data)->append(e);
+}
+
+// every element of the pipeline, but the bins
+static QList<GstElement *> pipeline_elements(GstElement *pipeline)
+{
+    QList<GstElement *> list;
+    GstIterator        *it = gst_bin_iterate_recurse(GST_BIN(pipeline));
+    gst_iterator_foreach(it, collect_element, &list);
+    gst_iterator_free(it);
+
+    list.erase(std::remove_if(list.begin(), list.end(), [](GstElement *e) { return GST_IS_BIN(e); }), list.end());
+    return list;
+}
+
+// the names found only once among the elements
+static QSet<QString> unique_names(const QList<GstElement *> &elements)
+{
+    QSet<QString> seen, shared;
+    for (GstElement *element : elements) {
+        QString name = QString::fromUtf8(GST_OBJECT_NAME(element));
+        if (seen.contains(name))
+            shared += name;
+        seen += name;
+    }
+    return seen - shared;
+}
+
+// what was logged of the element.  false if nothing.
+static bool element_profile(const Profiler *p, GstElement *element, const QSet<QString> &unique, ElementProfile *out)
+{
+    bool found = false;
+
+    // the latency tracer formats the address as an id
+    auto it = p->byId.constFind(QString::asprintf("%p", static_cast<void *>(element)));
+    if (it != p->byId.constEnd()) {
+        *out  = *it;
+        found = true;
+    }
+
+    QString name = QString::fromUtf8(GST_OBJECT_NAME(element));
+    it           = unique.contains(name) ? p->byName.constFind(name) : p->byName.constEnd();
+    if (it != p->byName.constEnd()) {
+        out->procCount    = it->procCount;
+        out->procSum      = it->procSum;
+        out->procMax      = it->procMax;
+        out->queueCount   = it->queueCount;
+        out->buffersSum   = it->buffersSum;
+        out->buffersMax   = it->buffersMax;
+        out->queueTimeSum = it->queueTimeSum;
+        out->queueTimeMax = it->queueTimeMax;
+        if (it->procCount)
+            out->thread = it->thread;
+        found = true;
+    }
+    return found;
+}
+
+static double average_load(const ThreadProfile &t)
+{
+    return t.loadCount ? double(t.loadSum) / double(t.loadCount) / 10 : -1;
+}
+
+// the load of the thread, by the share of its processing time
+static double element_load(const Profiler *p, const ElementProfile &e)
+{
+    auto t = p->threads.constFind(e.thread);
+    if (!e.procSum || t == p->threads.constEnd() || !t->loadCount)
+        return -1;
+
+    quint64 threadSum = 0;
+    for (const auto &other : p->byName) {
+        if (other.thread == e.thread)
+            threadSum += other.procSum;
+    }
+    return average_load(*t) * double(e.procSum) / double(threadSum);
+}
+
+static QString format_ms(quint64 sum, quint64 count, quint64 max)
+{
+    if (!count)
+        return QStringLiteral("-");
+    return QString::asprintf("%.2f/%.2f", double(sum) / double(count) / 1000000, double(max) / 1000000);
+}
+
+// a line per element, the busiest first
+class ReportLine {
+public:
+    QString name;
+    double  load;
+    QString line;
+};
+
+QString PipelineProfiler::report(GstElement *pipeline, const QString &title)
+{
+    // walking the bins takes their locks, which the streaming threads may
+    //   hold while logging
+    QList<GstElement *> elements = pipeline_elements(pipeline);
+    QSet<QString>       unique   = unique_names(elements);
+
+    Profiler    *p = profiler();
+    QStringList  out;
+    QMutexLocker locker(&p->m);
+    if (!p->refs)
+        return QString();
+
+    out += QString::asprintf("%s, profiled for %.1f s", qPrintable(title), double(p->since.elapsed()) / 1000);
+    if (!p->missing.isEmpty())
+        out += QStringLiteral("tracers not available: ") + p->missing.join(QStringLiteral(", "));
+    if (!p->category)
+        out += QStringLiteral("gstreamer has no debug logging, nothing to trace");
+    double processLoad = average_load(p->process);
+    if (processLoad >= 0)
+        out += QString::asprintf("process cpu %.1f%%", processLoad);
+
+    out += QString::asprintf("%-32s %7s %18s %18s %14s", "element", "cpu %", "proctime ms", "latency ms",
+                             "thread");
+    QList<ReportLine> lines;
+    QStringList       queues;
+    for (GstElement *element : elements) {
+        ElementProfile e;
+        if (!element_profile(p, element, unique, &e))
+            continue;
+
+        // the path tells apart elements of the same name
+        gchar  *path = gst_object_get_path_string(GST_OBJECT(element));
+        QString name = QString::fromUtf8(path);
+        g_free(path);
+
+        if (e.procCount || e.latCount) {
+            ReportLine l;
+            l.name       = name;
+            l.load       = element_load(p, e);
+            QString load = l.load >= 0 ? QString::asprintf("%.1f", l.load) : QStringLiteral("-");
+            l.line       = QString::asprintf("%-32s %7s %18s %18s %#14llx", qPrintable(name), qPrintable(load),
+                                             qPrintable(format_ms(e.procSum, e.procCount, e.procMax)),
+                                             qPrintable(format_ms(e.latSum, e.latCount, e.latMax)),
+                                             static_cast<unsigned long long>(e.thread));
+            lines += l;
+        }
+        if (e.queueCount) {
+            queues += QString::asprintf("%-32s %12.1f/%-5llu %18s", qPrintable(name),
+                                        double(e.buffersSum) / double(e.queueCount),
+                                        static_cast<unsigned long long>(e.buffersMax),
+                                        qPrintable(format_ms(e.queueTimeSum, e.queueCount, e.queueTimeMax)));
+        }
+    }
+    std::stable_sort(lines.begin(), lines.end(),
+                     [](const ReportLine &a, const ReportLine &b) { return a.load > b.load; });
+    for (const auto &l : lines)
+        out += l.line;
+
+    if (!queues.isEmpty()) {
+        out += QString::asprintf("%-32s %18s %18s", "queue", "buffers", "level ms");
+        out += queues;
+    }
+    return out.join(QLatin1Char('\n'));
+}
+
+// the cluster gst_debug_bin_to_dot_data() makes of an element
+static QByteArray dot_cluster(GstElement *element)
+{
+    gchar *name = g_strdup_printf("%s_%p", GST_OBJECT_NAME(element), static_cast<void *>(element));
+    g_strcanon(name, G_CSET_A_2_Z G_CSET_a_2_z G_CSET_DIGITS "_", '_');
+    QByteArray out = QByteArray("subgraph cluster_") + name + " {";
+    g_free(name);
+    return out;
+}
+
+// appends text to the label of the cluster, which ends with the first
+//   unescaped quote
+static void dot_annotate(QByteArray *dot, const QByteArray &cluster, const QString &text)
+{
+    int at = dot->indexOf(cluster);
+    if (at == -1)
+        return;
+    at = dot->indexOf("label=\"", at);
+    if (at == -1)
+        return;
+    for (at += 7; at < dot->size(); ++at) {
+        if (dot->at(at) == '\\')
+            ++at;
+        else if (dot->at(at) == '"')
+            break;
+    }
+    if (at < dot->size())
+        dot->insert(at, "\\n" + text.toUtf8());
+}
+
+QString PipelineProfiler::graph(GstElement *pipeline)
+{
+    gchar     *data = gst_debug_bin_to_dot_data(GST_BIN(pipeline), GST_DEBUG_GRAPH_SHOW_ALL);
+    QByteArray dot(data);
+    g_free(data);
+
+    QList<GstElement *> elements = pipeline_elements(pipeline);
+    QSet<QString>       unique   = unique_names(elements);
+
+    Profiler    *p = profiler();
+    QMutexLocker locker(&p->m);
+    for (GstElement *element : elements) {
+        ElementProfile e;
+        if (!element_profile(p, element, unique, &e))
+            continue;
+
+        QStringList text;
+        double      load = element_load(p, e);
+        if (load >= 0)
+            text += QString::asprintf("cpu %.1f%%", load);
+        if (e.procCount)
+            text += QStringLiteral("proctime ") + format_ms(e.procSum, e.procCount, e.procMax) + " ms";
+        if (e.latCount)
+            text += QStringLiteral("latency ") + format_ms(e.latSum, e.latCount, e.latMax) + " ms";
+        if (e.queueCount)
+            text += QString::asprintf("level %.1f/%llu buffers", double(e.buffersSum) / double(e.queueCount),
+                                      static_cast<unsigned long long>(e.buffersMax));
+        if (!text.isEmpty())
+            dot_annotate(&dot, dot_cluster(element), text.join(QStringLiteral("\\n")));
+    }
+    return QString::fromUtf8(dot);
+}
+
+}
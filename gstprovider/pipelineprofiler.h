@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef PSI_PIPELINEPROFILER_H
+#define PSI_PIPELINEPROFILER_H
+
+#include <QString>
+#include <gst/gst.h>
+
+namespace PsiMedia {
+
+// collects what the latency, proctime, queuelevel and rusage tracers log,
+//   per element, while at least one session wants it.  latencies come
+//   with the element's address.  processing times and queue levels only
+//   come with its name, so they are left out for elements sharing their
+//   name with another one in the pipeline, as those of several sessions
+//   do.
+//
+// nothing is installed until the first acquire().  the tracers and a log
+//   function are installed then, and stay registered for the rest of the
+//   process, as gstreamer has no way of removing tracers.  after the last
+//   release() their logs are turned off again, which leaves little more
+//   than the hooks being called, and the default log function is back.
+//
+// everything may be called from any thread.
+class PipelineProfiler {
+public:
+    static void acquire();
+    static void release();
+
+    // per element of the pipeline: processing time and latency, queue
+    //   levels, and the cpu load of the thread it runs in
+    static QString report(GstElement *pipeline, const QString &title);
+
+    // the graph of the pipeline in dot format, elements labeled with
+    //   their timings
+    static QString graph(GstElement *pipeline);
+};
+
+}
+
+#endif
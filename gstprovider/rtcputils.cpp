@@ -0,0 +1,461 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "rtcputils.h"
+
+#include <algorithm>
+#include <gst/rtp/gstrtcpbuffer.h>
+
+#define RTCP_MTU 1200
+
+// seconds from 1900, where ntp time starts, to 1970
+#define NTP_UNIX_OFFSET G_GINT64_CONSTANT(2208988800)
+
+namespace PsiMedia {
+
+static GstBuffer *wrap_packet(const QByteArray &packet)
+{
+    return gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, (gpointer)packet.constData(), gsize(packet.size()), 0,
+                                       gsize(packet.size()), nullptr, nullptr);
+}
+
+static QByteArray unwrap_buffer(GstBuffer *buffer)
+{
+    QByteArray out(int(gst_buffer_get_size(buffer)), 0);
+    gst_buffer_extract(buffer, 0, out.data(), gsize(out.size()));
+    gst_buffer_unref(buffer);
+    return out;
+}
+
+int rtcp_fraction_lost(const QByteArray &packet)
+{
+    GstBuffer *buffer = wrap_packet(packet);
+    if (!gst_rtcp_buffer_validate_reduced(buffer)) {
+        gst_buffer_unref(buffer);
+        return -1;
+    }
+
+    int           percent = -1;
+    GstRTCPBuffer rtcp    = GST_RTCP_BUFFER_INIT;
+    GstRTCPPacket rp;
+    gst_rtcp_buffer_map(buffer, GST_MAP_READ, &rtcp);
+    for (gboolean more = gst_rtcp_buffer_get_first_packet(&rtcp, &rp); more; more = gst_rtcp_packet_move_to_next(&rp)) {
+        GstRTCPType type = gst_rtcp_packet_get_type(&rp);
+        if ((type != GST_RTCP_TYPE_SR && type != GST_RTCP_TYPE_RR) || gst_rtcp_packet_get_rb_count(&rp) == 0)
+            continue;
+
+        guint32 ssrc, exthighestseq, jitter, lsr, dlsr;
+        guint8  fractionlost;
+        gint32  packetslost;
+        gst_rtcp_packet_get_rb(&rp, 0, &ssrc, &fractionlost, &packetslost, &exthighestseq, &jitter, &lsr, &dlsr);
+        percent = fractionlost * 100 / 256;
+        break;
+    }
+    gst_rtcp_buffer_unmap(&rtcp);
+    gst_buffer_unref(buffer);
+    return percent;
+}
+
+bool rtcp_parse_feedback(const QByteArray &packet, RtcpFeedback *feedback)
+{
+    GstBuffer *buffer = wrap_packet(packet);
+    if (!gst_rtcp_buffer_validate_reduced(buffer)) {
+        gst_buffer_unref(buffer);
+        return false;
+    }
+
+    *feedback = RtcpFeedback();
+
+    bool          found = false;
+    GstRTCPBuffer rtcp  = GST_RTCP_BUFFER_INIT;
+    GstRTCPPacket rp;
+    gst_rtcp_buffer_map(buffer, GST_MAP_READ, &rtcp);
+    for (gboolean more = gst_rtcp_buffer_get_first_packet(&rtcp, &rp); more; more = gst_rtcp_packet_move_to_next(&rp)) {
+        GstRTCPType type = gst_rtcp_packet_get_type(&rp);
+        if (type != GST_RTCP_TYPE_RTPFB && type != GST_RTCP_TYPE_PSFB)
+            continue;
+
+        GstRTCPFBType fbtype = gst_rtcp_packet_fb_get_type(&rp);
+        guint8       *fci    = gst_rtcp_packet_fb_get_fci(&rp);
+        guint         words  = gst_rtcp_packet_fb_get_fci_length(&rp);
+
+        if (type == GST_RTCP_TYPE_RTPFB && fbtype == GST_RTCP_RTPFB_TYPE_NACK) {
+            // each word is a packet id and a bitmask of the 16 following
+            feedback->mediaSsrc = gst_rtcp_packet_fb_get_media_ssrc(&rp);
+            for (guint n = 0; n < words; ++n, fci += 4) {
+                quint16 pid = GST_READ_UINT16_BE(fci);
+                quint16 blp = GST_READ_UINT16_BE(fci + 2);
+                feedback->nacks += pid;
+                for (int bit = 0; bit < 16; ++bit) {
+                    if (blp & (1 << bit))
+                        feedback->nacks += quint16(pid + bit + 1);
+                }
+            }
+            found = true;
+        } else if (type == GST_RTCP_TYPE_PSFB && fbtype == GST_RTCP_PSFB_TYPE_PLI) {
+            feedback->mediaSsrc = gst_rtcp_packet_fb_get_media_ssrc(&rp);
+            feedback->keyframe  = true;
+            found               = true;
+        } else if (type == GST_RTCP_TYPE_PSFB && fbtype == GST_RTCP_PSFB_TYPE_FIR && words >= 2) {
+            // the media ssrc is in the fci for fir
+            feedback->mediaSsrc = GST_READ_UINT32_BE(fci);
+            feedback->keyframe  = true;
+            found               = true;
+        }
+    }
+    gst_rtcp_buffer_unmap(&rtcp);
+    gst_buffer_unref(buffer);
+    return found;
+}
+
+QByteArray rtcp_make_nack(quint32 senderSsrc, quint32 mediaSsrc, const QList<quint16> &seqnums)
+{
+    QList<quint16> sorted = seqnums;
+    std::sort(sorted.begin(), sorted.end());
+
+    // pack into pid/blp words
+    QList<quint32> words;
+    for (int n = 0; n < sorted.count();) {
+        quint16 pid = sorted[n++];
+        quint16 blp = 0;
+        while (n < sorted.count() && quint16(sorted[n] - pid) <= 16) {
+            if (sorted[n] != pid)
+                blp |= 1 << (quint16(sorted[n] - pid) - 1);
+            ++n;
+        }
+        words += (quint32(pid) << 16) | blp;
+    }
+
+    GstBuffer    *buffer = gst_rtcp_buffer_new(RTCP_MTU);
+    GstRTCPBuffer rtcp   = GST_RTCP_BUFFER_INIT;
+    GstRTCPPacket rp;
+    gst_rtcp_buffer_map(buffer, GST_MAP_READWRITE, &rtcp);
+    gst_rtcp_buffer_add_packet(&rtcp, GST_RTCP_TYPE_RTPFB, &rp);
+    gst_rtcp_packet_fb_set_type(&rp, GST_RTCP_RTPFB_TYPE_NACK);
+    gst_rtcp_packet_fb_set_sender_ssrc(&rp, senderSsrc);
+    gst_rtcp_packet_fb_set_media_ssrc(&rp, mediaSsrc);
+    if (gst_rtcp_packet_fb_set_fci_length(&rp, guint16(words.count()))) {
+        guint8 *fci = gst_rtcp_packet_fb_get_fci(&rp);
+        for (quint32 word : std::as_const(words)) {
+            GST_WRITE_UINT32_BE(fci, word);
+            fci += 4;
+        }
+    }
+    gst_rtcp_buffer_unmap(&rtcp);
+    return unwrap_buffer(buffer);
+}
+
+QByteArray rtcp_make_pli(quint32 senderSsrc, quint32 mediaSsrc)
+{
+    GstBuffer    *buffer = gst_rtcp_buffer_new(RTCP_MTU);
+    GstRTCPBuffer rtcp   = GST_RTCP_BUFFER_INIT;
+    GstRTCPPacket rp;
+    gst_rtcp_buffer_map(buffer, GST_MAP_READWRITE, &rtcp);
+    gst_rtcp_buffer_add_packet(&rtcp, GST_RTCP_TYPE_PSFB, &rp);
+    gst_rtcp_packet_fb_set_type(&rp, GST_RTCP_PSFB_TYPE_PLI);
+    gst_rtcp_packet_fb_set_sender_ssrc(&rp, senderSsrc);
+    gst_rtcp_packet_fb_set_media_ssrc(&rp, mediaSsrc);
+    gst_rtcp_buffer_unmap(&rtcp);
+    return unwrap_buffer(buffer);
+}
+
+QByteArray rtcp_remove_ssrcs(const QByteArray &packet, const QList<quint32> &ssrcs)
+{
+    auto       p      = reinterpret_cast<const quint8 *>(packet.constData());
+    int        len    = packet.size();
+    bool       useful = false;
+    QByteArray out;
+    for (int at = 0; at < len;) {
+        const quint8 *h = p + at;
+        if (at + 4 > len || (h[0] >> 6) != 2)
+            return QByteArray();
+        int size = (GST_READ_UINT16_BE(h + 2) + 1) * 4;
+        if (at + size > len)
+            return QByteArray();
+        at += size;
+
+        int type  = h[1];
+        int count = h[0] & 0x1f;
+        if (type == GST_RTCP_TYPE_SR || type == GST_RTCP_TYPE_RR) {
+            // the sender's ssrc and, of an sr, the sender info, then the
+            //   report blocks and profile extensions
+            int fixed = type == GST_RTCP_TYPE_SR ? 28 : 8;
+            if (fixed + count * 24 > size)
+                return QByteArray();
+
+            QByteArray kept(reinterpret_cast<const char *>(h), fixed);
+            int        blocks = 0;
+            for (int n = 0; n < count; ++n) {
+                const quint8 *rb = h + fixed + n * 24;
+                if (ssrcs.contains(GST_READ_UINT32_BE(rb)))
+                    continue;
+                kept.append(reinterpret_cast<const char *>(rb), 24);
+                ++blocks;
+            }
+            kept.append(reinterpret_cast<const char *>(h) + fixed + count * 24, size - fixed - count * 24);
+
+            auto k = reinterpret_cast<quint8 *>(kept.data());
+            k[0]   = quint8((h[0] & 0xe0) | blocks);
+            GST_WRITE_UINT16_BE(k + 2, quint16(kept.size() / 4 - 1));
+            out += kept;
+            // the sender info of an sr is about the remote's own stream
+            useful |= type == GST_RTCP_TYPE_SR || blocks > 0;
+        } else if (type == GST_RTCP_TYPE_RTPFB || type == GST_RTCP_TYPE_PSFB) {
+            if (size < 12)
+                return QByteArray();
+
+            // the media ssrc is in the fci for fir
+            quint32 media = GST_READ_UINT32_BE(h + 8);
+            if (type == GST_RTCP_TYPE_PSFB && count == GST_RTCP_PSFB_TYPE_FIR && size >= 16)
+                media = GST_READ_UINT32_BE(h + 12);
+            if (ssrcs.contains(media))
+                continue;
+            out.append(reinterpret_cast<const char *>(h), size);
+            useful = true;
+        } else
+            out.append(reinterpret_cast<const char *>(h), size);
+    }
+    return useful ? out : QByteArray();
+}
+
+// size of the fixed header, csrcs and header extension, or -1
+static int rtp_header_size(const QByteArray &packet)
+{
+    auto p   = reinterpret_cast<const quint8 *>(packet.constData());
+    int  len = packet.size();
+    if (len < 12 || (p[0] >> 6) != 2)
+        return -1;
+
+    int at = 12 + (p[0] & 0x0f) * 4;
+    if (p[0] & 0x10) {
+        if (at + 4 > len)
+            return -1;
+        at += 4 + GST_READ_UINT16_BE(p + at + 2) * 4;
+    }
+    return at <= len ? at : -1;
+}
+
+// offset of the primary block of a red payload starting at at, and its
+//   payload type.  false if malformed.
+static bool red_primary_block(const QByteArray &packet, int at, int *blockAt, int *blockPt)
+{
+    auto p      = reinterpret_cast<const quint8 *>(packet.constData());
+    int  len    = packet.size();
+    int  blocks = 0;
+    while (at < len && (p[at] & 0x80)) {
+        if (at + 4 > len)
+            return false;
+        blocks += GST_READ_UINT16_BE(p + at + 2) & 0x03ff;
+        at += 4;
+    }
+    if (at >= len || at + 1 + blocks > len)
+        return false;
+    *blockPt = p[at] & 0x7f;
+    *blockAt = at + 1 + blocks;
+    return true;
+}
+
+quint32 rtp_ssrc(const QByteArray &packet)
+{
+    auto p = reinterpret_cast<const quint8 *>(packet.constData());
+    if (packet.size() < 12 || (p[0] >> 6) != 2)
+        return 0;
+    return GST_READ_UINT32_BE(p + 8);
+}
+
+int rtp_payload_type(const QByteArray &packet)
+{
+    auto p = reinterpret_cast<const quint8 *>(packet.constData());
+    if (packet.size() < 12 || (p[0] >> 6) != 2)
+        return -1;
+    return p[1] & 0x7f;
+}
+
+int rtp_media_payload_type(const QByteArray &packet, int redpt)
+{
+    int at = rtp_header_size(packet);
+    if (at == -1)
+        return -1;
+
+    int pt = packet[1] & 0x7f;
+    if (pt != redpt)
+        return pt;
+
+    int blockAt, blockPt;
+    if (!red_primary_block(packet, at, &blockAt, &blockPt))
+        return -1;
+    return blockPt;
+}
+
+quint16 rtp_seq(const QByteArray &packet)
+{
+    auto p = reinterpret_cast<const quint8 *>(packet.constData());
+    return packet.size() >= 12 ? GST_READ_UINT16_BE(p + 2) : 0;
+}
+
+quint32 rtp_timestamp(const QByteArray &packet)
+{
+    auto p = reinterpret_cast<const quint8 *>(packet.constData());
+    return packet.size() >= 12 ? GST_READ_UINT32_BE(p + 4) : 0;
+}
+
+bool rtp_marker(const QByteArray &packet)
+{
+    auto p = reinterpret_cast<const quint8 *>(packet.constData());
+    return packet.size() >= 12 && (p[1] & 0x80);
+}
+
+void rtp_rewrite(QByteArray *packet, int pt, quint32 ssrc, quint16 seq, quint32 timestamp)
+{
+    if (packet->size() < 12)
+        return;
+    auto p = reinterpret_cast<quint8 *>(packet->data());
+    p[1]   = quint8((p[1] & 0x80) | (pt & 0x7f));
+    GST_WRITE_UINT16_BE(p + 2, seq);
+    GST_WRITE_UINT32_BE(p + 4, timestamp);
+    GST_WRITE_UINT32_BE(p + 8, ssrc);
+}
+
+QByteArray rtp_header_extension(const QByteArray &packet, int id)
+{
+    auto p   = reinterpret_cast<const quint8 *>(packet.constData());
+    int  end = rtp_header_size(packet);
+    if (end == -1 || !(p[0] & 0x10) || id < 1)
+        return QByteArray();
+
+    int     at      = 12 + (p[0] & 0x0f) * 4;
+    quint16 profile = GST_READ_UINT16_BE(p + at);
+    bool    oneByte = profile == 0xbede;
+    if (!oneByte && (profile & 0xfff0) != 0x1000)
+        return QByteArray();
+
+    at += 4;
+    while (at < end) {
+        // padding
+        if (p[at] == 0) {
+            ++at;
+            continue;
+        }
+
+        int elementId, size;
+        if (oneByte) {
+            elementId = p[at] >> 4;
+            size      = (p[at] & 0x0f) + 1;
+            if (elementId == 15) // reserved, ends the extension
+                break;
+            at += 1;
+        } else {
+            if (at + 2 > end)
+                break;
+            elementId = p[at];
+            size      = p[at + 1];
+            at += 2;
+        }
+        if (at + size > end)
+            break;
+        if (elementId == id)
+            return packet.mid(at, size);
+        at += size;
+    }
+    return QByteArray();
+}
+
+quint64 ntp_from_unix_usec(qint64 usec)
+{
+    quint64 secs = quint64(usec / 1000000 + NTP_UNIX_OFFSET);
+    quint64 frac = (quint64(usec % 1000000) << 32) / 1000000;
+    return (secs << 32) | frac;
+}
+
+qint64 ntp_to_unix_usec(quint64 ntp)
+{
+    qint64 secs = qint64(ntp >> 32) - NTP_UNIX_OFFSET;
+    qint64 frac = qint64(((ntp & 0xffffffff) * 1000000) >> 32);
+    return secs * 1000000 + frac;
+}
+
+bool rtp_strip_red(QByteArray *packet, int redpt)
+{
+    int at = rtp_header_size(*packet);
+    if (at == -1)
+        return false;
+    if (rtp_payload_type(*packet) != redpt)
+        return true;
+
+    int blockAt, blockPt;
+    if (!red_primary_block(*packet, at, &blockAt, &blockPt))
+        return false;
+
+    QByteArray out = packet->left(at) + packet->mid(blockAt);
+    out[1]         = char((out[1] & 0x80) | blockPt);
+    *packet        = out;
+    return true;
+}
+
+bool rtp_unwrap_rtx(QByteArray *packet, int pt, quint32 ssrc)
+{
+    int at = rtp_header_size(*packet);
+    if (at == -1 || at + 2 > packet->size())
+        return false;
+
+    // the original sequence number comes first in the payload
+    auto       p   = reinterpret_cast<const quint8 *>(packet->constData());
+    quint16    osn = GST_READ_UINT16_BE(p + at);
+    QByteArray out = packet->left(at) + packet->mid(at + 2);
+    rtp_rewrite(&out, pt, ssrc, osn, rtp_timestamp(*packet));
+    *packet = out;
+    return true;
+}
+
+int rtp_vp8_temporal_layer(const QByteArray &packet, int pt, int redpt)
+{
+    auto p   = reinterpret_cast<const quint8 *>(packet.constData());
+    int  len = packet.size();
+    int  at  = rtp_header_size(packet);
+    if (at == -1)
+        return -1;
+
+    // red: look at the primary block
+    int payloadType = p[1] & 0x7f;
+    if (payloadType == redpt && !red_primary_block(packet, at, &at, &payloadType))
+        return -1;
+    if (payloadType != pt || at >= len)
+        return -1;
+
+    // vp8 payload descriptor (rfc 7741): X, then I, L, T and K
+    quint8 b = p[at++];
+    if (!(b & 0x80) || at >= len)
+        return -1;
+    quint8 ext = p[at++];
+    if (!(ext & 0x20))
+        return -1;
+    if (ext & 0x80) {
+        if (at >= len)
+            return -1;
+        at += (p[at] & 0x80) ? 2 : 1;
+    }
+    if (ext & 0x40)
+        ++at;
+    if (at >= len)
+        return -1;
+    return p[at] >> 6;
+}
+
+}
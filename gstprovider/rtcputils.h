@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef PSI_RTCPUTILS_H
+#define PSI_RTCPUTILS_H
+
+#include <QByteArray>
+#include <QList>
+
+// we don't run an rtp session, so the bits of rtcp we need are picked out
+//   of and put into packets by hand.
+
+namespace PsiMedia {
+
+// feedback found in a compound rtcp packet (rfc 4585, rfc 5104)
+class RtcpFeedback {
+public:
+    quint32        mediaSsrc = 0;
+    QList<quint16> nacks;            // sequence numbers to retransmit
+    bool           keyframe = false; // pli or fir
+};
+
+// the fraction lost of the first report block in an sr/rr, as a
+//   percentage.  -1 if there is none.
+int rtcp_fraction_lost(const QByteArray &packet);
+
+// returns false if the packet is not rtcp or carries no feedback
+bool rtcp_parse_feedback(const QByteArray &packet, RtcpFeedback *feedback);
+
+// reduced size feedback packets (rfc 5506)
+QByteArray rtcp_make_nack(quint32 senderSsrc, quint32 mediaSsrc, const QList<quint16> &seqnums);
+QByteArray rtcp_make_pli(quint32 senderSsrc, quint32 mediaSsrc);
+
+// a compound rtcp packet without the report blocks and feedback about any
+//   of ssrcs.  empty if no sender info, report blocks or feedback are
+//   left, or if the packet is malformed.
+QByteArray rtcp_remove_ssrcs(const QByteArray &packet, const QList<quint32> &ssrcs);
+
+// header fields of an rtp packet.  the ssrc is 0 and the payload type -1
+//   if the packet is not rtp.
+quint32 rtp_ssrc(const QByteArray &packet);
+int     rtp_payload_type(const QByteArray &packet);
+quint16 rtp_seq(const QByteArray &packet);
+quint32 rtp_timestamp(const QByteArray &packet);
+bool    rtp_marker(const QByteArray &packet);
+void    rtp_rewrite(QByteArray *packet, int pt, quint32 ssrc, quint16 seq, quint32 timestamp);
+
+// data of the header extension element id (rfc 8285), in the one-byte or
+//   the two-byte form.  empty if the packet carries none.
+QByteArray rtp_header_extension(const QByteArray &packet, int id);
+
+// 64-bit ntp timestamps, as in rtcp sender reports and the abs-capture-time
+//   header extension, to and from microseconds since the unix epoch
+quint64 ntp_from_unix_usec(qint64 usec);
+qint64  ntp_to_unix_usec(quint64 ntp);
+
+// turn a red packet (rfc 2198) of payload type redpt into a plain one
+//   carrying its primary block.  other packets are left alone.  returns
+//   false if the packet is malformed.
+bool rtp_strip_red(QByteArray *packet, int redpt);
+
+// turn a retransmission (rfc 4588) back into the packet it carries, of
+//   payload type pt and the media's ssrc.  false if malformed.
+bool rtp_unwrap_rtx(QByteArray *packet, int pt, quint32 ssrc);
+
+// payload type of an rtp packet, or of the primary block of a red packet
+//   (rfc 2198) of payload type redpt.  -1 if not rtp or malformed.
+int rtp_media_payload_type(const QByteArray &packet, int redpt);
+
+// temporal layer id (tid) from the vp8 payload descriptor of an rtp packet
+//   of payload type pt, looking into red (rfc 2198) if redpt matches.  -1
+//   for other payloads or if the packet carries no layer id.
+int rtp_vp8_temporal_layer(const QByteArray &packet, int pt, int redpt);
+
+}
+
+#endif
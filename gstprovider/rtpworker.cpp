@@ -22,20 +22,72 @@
 
 #include <QDir>
 #include <QElapsedTimer>
+#include <QRecursiveMutex>
 #include <QStringList>
+#include <algorithm>
 #include <cstring>
+#include <iterator>
 #include <gst/app/gstappsrc.h>
+#include <gst/audio/audio.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <gst/video/video.h>
 
 #include "bins.h"
 // #include "devices.h"
+#include "jitterestimator.h"
 #include "payloadinfo.h"
 #include "pipeline.h"
+#include "pipelinecompositor.h"
+#include "pipelineprofiler.h"
+#include "rtcputils.h"
+#include "timescaler.h"
 
 // TODO: support playing from bytearray
 // TODO: support recording
 
 #define RTPWORKER_DEBUG
 
+// bounds of the adaptive jitter buffer latency, in ms
+#define ADAPTIVE_LATENCY_MIN 20
+#define ADAPTIVE_LATENCY_MAX 500
+
+// don't bother the jitter buffer with changes smaller than this, in ms
+#define ADAPTIVE_LATENCY_STEP 5
+
+// how often to retarget the jitter buffers, in ms
+#define ADAPTIVE_LATENCY_INTERVAL 500
+
+// packetization time used when the remote doesn't ask for one, in ms
+#define OPUS_DEFAULT_PTIME 20
+
+// longest packetization opusdec can take, in ms (rfc 7587)
+#define OPUS_MAX_PTIME 120
+
+// at or below this sending bitrate, in kbps, audio is packed into as few
+//   packets as the remote allows.  a 60ms packet has a third of the
+//   header overhead of three 20ms ones.
+#define OPUS_CONSTRAINED_BITRATE 128
+
+// ulpfec overhead, in percent of the media packets, is twice the loss but
+//   at least FEC_MIN_PERCENTAGE once there is any.  capped so that fec
+//   can't crowd out the video it protects.
+#define FEC_MIN_PERCENTAGE 10
+#define FEC_MAX_PERCENTAGE 50
+
+// honor keyframe requests at most this often, in ms.  receivers tend to
+//   repeat them until the keyframe arrives.  we ask at most as often, the
+//   depayloader asks on every incomplete frame.
+#define KEYFRAME_MIN_INTERVAL 300
+
+// audio latency changes are played in or out by the time scaler in steps of
+//   at most this, in ms.  keep it well below the alignment threshold of the
+//   audio sink (40ms by default), so the sink never resyncs.
+#define ADAPTIVE_LATENCY_SCALE_STEP 10
+
+// growing by more than this happens at once, there is no point in slowly
+//   catching up with a spike
+#define ADAPTIVE_LATENCY_JUMP 40
+
 namespace PsiMedia {
 
 static GstStaticPadTemplate raw_audio_src_template
@@ -47,6 +99,10 @@ static GstStaticPadTemplate raw_audio_sink_template
 static GstStaticPadTemplate raw_video_sink_template
     = GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS("video/x-raw"));
 
+static GstStaticPadTemplate h264_video_sink_template
+    = GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS("video/x-h264"));
+
+#ifdef RTPWORKER_DEBUG
 static const char *state_to_str(GstState state)
 {
     switch (state) {
@@ -63,55 +119,240 @@ static const char *state_to_str(GstState state)
         return nullptr;
     }
 }
+#endif
 
-class Stats {
-public:
-    QString       name;
-    int           calls;
-    int           sizes[30];
-    int           sizes_at;
-    QElapsedTimer calltime;
+static int get_jitterbuffer_latency(GstElement *jitterbuffer)
+{
+    guint latency = 0;
+    if (!jitterbuffer)
+        return -1;
+    g_object_get(G_OBJECT(jitterbuffer), "latency", &latency, nullptr);
+    return int(latency);
+}
 
-    Stats(const QString &_name) : name(_name), calls(-1), sizes_at(0)
-    {
-        for (int k = 0; k < 30; ++k)
-            sizes[k] = 0;
+static bool set_jitterbuffer_latency(GstElement *jitterbuffer, int target, int *current)
+{
+    if (qAbs(target - *current) < ADAPTIVE_LATENCY_STEP)
+        return false;
+    g_object_set(G_OBJECT(jitterbuffer), "latency", guint(target), nullptr);
+    *current = target;
+    return true;
+}
+
+// with a time scaler, the scaler first plays the change in or out, and only
+//   then it is applied to the jitter buffer.  this way the audio sink never
+//   sees the jump in timestamps.
+static bool step_jitterbuffer_latency(GstElement *jitterbuffer, TimeScaler *scaler, int target, int *current,
+                                      int *next)
+{
+    bool changed = false;
+    if (*next != -1) {
+        if (scaler->pending() != 0)
+            return false;
+        g_object_set(G_OBJECT(jitterbuffer), "latency", guint(*next), nullptr);
+        *current = *next;
+        *next    = -1;
+        changed  = true;
     }
 
-    void print_stats(int current_size)
-    {
-        // -2 means quit
-        if (calls == -2)
-            return;
+    int delta = target - *current;
+    if (qAbs(delta) < ADAPTIVE_LATENCY_STEP)
+        return changed;
+    if (delta > ADAPTIVE_LATENCY_JUMP)
+        return set_jitterbuffer_latency(jitterbuffer, target, current) || changed;
 
-        if (sizes_at >= 30) {
-            memmove(sizes, sizes + 1, sizeof(int) * quintptr(sizes_at - 1));
-            --sizes_at;
-        }
-        sizes[sizes_at++] = current_size;
+    delta = qBound(-ADAPTIVE_LATENCY_SCALE_STEP, delta, ADAPTIVE_LATENCY_SCALE_STEP);
+    scaler->adjust(delta);
+    *next = *current + delta;
+    return changed;
+}
+
+static QString payload_parameter(const PPayloadInfo &info, const QString &name)
+{
+    for (const PPayloadInfo::Parameter &p : info.parameters) {
+        if (p.name == name)
+            return p.value;
+    }
+    return QString();
+}
+
+// id of the first payload with the given name, or -1
+static int find_payload(const QList<PPayloadInfo> &list, const QString &name)
+{
+    for (const PPayloadInfo &pi : list) {
+        if (pi.name.compare(name, Qt::CaseInsensitive) == 0)
+            return pi.id;
+    }
+    return -1;
+}
+
+// whether a payload type is of a codec, rather than red, fec or
+//   retransmissions
+static bool is_media_payload(const QList<PPayloadInfo> &list, int id)
+{
+    for (const PPayloadInfo &pi : list) {
+        if (pi.id != id)
+            continue;
+        QString name = pi.name.toLower();
+        return name != "red" && name != "ulpfec" && name != "rtx";
+    }
+    return false;
+}
+
+// index of the first video payload in a codec we have, or -1
+static int find_video_codec(const QList<PPayloadInfo> &list)
+{
+    for (int n = 0; n < list.count(); ++n) {
+        const PPayloadInfo &ri = list[n];
+        if (ri.clockrate != 90000)
+            continue;
+        QString codec = ri.name.toLower();
+        if ((codec == "vp8" || codec == "h264") && bins_video_codec_available(codec))
+            return n;
+    }
+    return -1;
+}
+
+// the remote's id for a payload if it has one and it is free, otherwise
+//   the first free dynamic id
+static int choose_payload_id(int remoteId, const QList<PPayloadInfo> &taken)
+{
+    auto isTaken = [&taken](int id) {
+        return std::any_of(taken.begin(), taken.end(), [id](const PPayloadInfo &pi) { return pi.id == id; });
+    };
+
+    if (remoteId != -1 && !isTaken(remoteId))
+        return remoteId;
+    for (int id = 96; id < 128; ++id) {
+        if (!isTaken(id))
+            return id;
+    }
+    return -1;
+}
+
+// id of the rtx payload (rfc 4588) associated with apt, or -1
+static int find_rtx_payload(const QList<PPayloadInfo> &list, int apt)
+{
+    for (const PPayloadInfo &pi : list) {
+        if (pi.name.toLower() == "rtx" && payload_parameter(pi, "apt").toInt() == apt)
+            return pi.id;
+    }
+    return -1;
+}
+
+// rtprtxsend maps the original payload type to the rtx one, rtprtxreceive
+//   the other way around
+static void set_rtx_payload_map(GstElement *rtx, int from, int to)
+{
+    GstStructure *map = gst_structure_new_empty("application/x-rtp-pt-map");
+    gst_structure_set(map, QByteArray::number(from).constData(), G_TYPE_UINT, guint(to), nullptr);
+    g_object_set(G_OBJECT(rtx), "payload-type-map", map, nullptr);
+    gst_structure_free(map);
+}
 
-        // set timer on first call
-        if (calls == -1) {
-            calls = 0;
-            calltime.start();
+static guint fec_percentage(int loss)
+{
+    if (loss <= 0)
+        return 0;
+    return guint(qBound(FEC_MIN_PERCENTAGE, loss * 2, FEC_MAX_PERCENTAGE));
+}
+
+static void set_payload_parameter(PPayloadInfo *info, const QString &name, const QString &value)
+{
+    for (PPayloadInfo::Parameter &p : info->parameters) {
+        if (p.name == name) {
+            p.value = value;
+            return;
         }
+    }
+    PPayloadInfo::Parameter p;
+    p.name  = name;
+    p.value = value;
+    info->parameters += p;
+}
 
-        // print bitrate after 10 seconds
-        if (calltime.elapsed() >= 10000) {
-            int avg = 0;
-            for (int n = 0; n < sizes_at; ++n)
-                avg += sizes[n];
-            avg /= sizes_at;
-            int bytesPerSec = (calls * avg) / 10;
-            int bps         = bytesPerSec * 10;
-            int kbps        = bps / 1000;
-            calls           = -2;
-            calltime.restart();
-            qDebug("%s: average packet size=%d, kbps=%d", qPrintable(name), avg, kbps);
-        } else
-            ++calls;
+// pick the opusenc frame size for a remote ptime/maxptime, in ms
+static int opus_frame_size(int ptime, int maxptime, bool constrained)
+{
+    // sizes opusenc supports, leaving out 2.5
+    static const int sizes[] = { 60, 40, 20, 10, 5 };
+
+    int want = ptime > 0 ? ptime : OPUS_DEFAULT_PTIME;
+    if (constrained)
+        want = qMax(want, sizes[0]);
+    if (maxptime > 0)
+        want = qMin(want, maxptime);
+
+    for (int size : sizes) {
+        if (size <= want)
+            return size;
+    }
+    return sizes[std::size(sizes) - 1];
+}
+
+static GstPadProbeReturn scale_audio_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    auto scaler = static_cast<TimeScaler *>(data);
+    if (scaler->pending() == 0)
+        return GST_PAD_PROBE_OK;
+
+    GstAudioInfo ainfo;
+    GstCaps     *caps = gst_pad_get_current_caps(pad);
+    bool         ok   = caps && gst_audio_info_from_caps(&ainfo, caps);
+    if (caps)
+        gst_caps_unref(caps);
+    if (!ok || GST_AUDIO_INFO_FORMAT(&ainfo) != GST_AUDIO_FORMAT_S16
+        || GST_AUDIO_INFO_LAYOUT(&ainfo) != GST_AUDIO_LAYOUT_INTERLEAVED)
+        return GST_PAD_PROBE_OK;
+
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ))
+        return GST_PAD_PROBE_OK;
+
+    int             rate     = GST_AUDIO_INFO_RATE(&ainfo);
+    int             channels = GST_AUDIO_INFO_CHANNELS(&ainfo);
+    int             frames   = int(map.size) / GST_AUDIO_INFO_BPF(&ainfo);
+    QVector<qint16> out;
+    bool scaled = scaler->process(reinterpret_cast<const qint16 *>(map.data), frames, channels, rate, &out);
+    gst_buffer_unmap(buffer, &map);
+    if (!scaled)
+        return GST_PAD_PROBE_OK;
+
+    // the timestamp stays, the sink lines the samples up
+    gsize      size      = gsize(out.size()) * sizeof(qint16);
+    GstBuffer *outbuffer = gst_buffer_new_allocate(nullptr, size, nullptr);
+    gst_buffer_fill(outbuffer, 0, out.constData(), size);
+    gst_buffer_copy_into(outbuffer, buffer, GstBufferCopyFlags(GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS), 0,
+                         size_t(-1));
+    GST_BUFFER_DURATION(outbuffer)   = gst_util_uint64_scale_int(out.size() / channels, GST_SECOND, rate);
+    GST_BUFFER_OFFSET_END(outbuffer) = GST_BUFFER_OFFSET_NONE;
+
+    gst_buffer_unref(buffer);
+    GST_PAD_PROBE_INFO_DATA(info) = outbuffer;
+    return GST_PAD_PROBE_OK;
+}
+
+static void scale_audio_probe_destroy(gpointer data) { delete static_cast<TimeScaler *>(data); }
+
+// adds the abs-capture-time header extension, if id is set.  only the
+//   capture time is sent, not the optional clock offset.  returns the
+//   marker bit, which is set on the last packet of a frame.
+static bool stamp_capture_time(GstBuffer *buffer, int id, qint64 capture)
+{
+    GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+    if (!gst_rtp_buffer_map(buffer, id ? GST_MAP_READWRITE : GST_MAP_READ, &rtp))
+        return false;
+
+    if (id) {
+        guint8 data[8];
+        GST_WRITE_UINT64_BE(data, ntp_from_unix_usec(capture));
+        gst_rtp_buffer_add_extension_onebyte_header(&rtp, guint8(id), data, sizeof(data));
     }
-};
+    bool marker = gst_rtp_buffer_get_marker(&rtp);
+    gst_rtp_buffer_unmap(&rtp);
+    return marker;
+}
 
 #ifdef RTPWORKER_DEBUG
 static void dump_pipeline(GstElement *in, int indent = 1);
@@ -144,17 +385,24 @@ static GstElement      *spipeline            = nullptr;
 static GstElement      *rpipeline            = nullptr;
 // static GstBus *sbus = 0;
 static bool send_in_use = false;
-static bool recv_in_use = false;
+static int  recv_refs   = 0; // sessions receiving, they share rpipeline
 
-static bool      use_shared_clock     = true;
-static GstClock *shared_clock         = nullptr;
-static bool      send_clock_is_shared = false;
-// static bool recv_clock_is_shared = false;
+// both pipelines run on this one from their creation, so that neither
+//   has to be restarted when the other comes or goes
+static GstClock *shared_clock = nullptr;
+
+// workers run in the threads of the control pool, each taking this for
+//   as long as it touches any of the above, the shared pipelines or the
+//   devices in them.  a session's own bins are built and torn down
+//   without it, so sessions don't wait for each other.
+static QRecursiveMutex pipelines_mutex;
 
 RtpWorker::RtpWorker(GMainContext *mainContext, DeviceMonitor *hardwareDeviceMonitor) :
-    mainContext_(mainContext), hardwareDeviceMonitor_(hardwareDeviceMonitor), audioStats(new Stats("audio")),
-    videoStats(new Stats("video"))
+    mainContext_(mainContext), hardwareDeviceMonitor_(hardwareDeviceMonitor)
 {
+    feedbackSsrc = g_random_int();
+
+    QMutexLocker locker(&pipelines_mutex);
     if (worker_refs == 0) {
         send_pipelineContext = new PipelineContext;
         recv_pipelineContext = new PipelineContext;
@@ -162,6 +410,15 @@ RtpWorker::RtpWorker(GMainContext *mainContext, DeviceMonitor *hardwareDeviceMon
         spipeline = send_pipelineContext->element();
         rpipeline = recv_pipelineContext->element();
 
+        if (qgetenv("PSI_NO_SHARED_CLOCK").isEmpty()) {
+            // an instance of our own, the global system clock may be
+            //   reconfigured by anyone in the process
+            shared_clock = GST_CLOCK(gst_object_ref_sink(
+                g_object_new(GST_TYPE_SYSTEM_CLOCK, "clock-type", GST_CLOCK_TYPE_MONOTONIC, nullptr)));
+            gst_pipeline_use_clock(GST_PIPELINE(spipeline), shared_clock);
+            gst_pipeline_use_clock(GST_PIPELINE(rpipeline), shared_clock);
+        }
+
 #ifdef RTPWORKER_DEBUG
         /*sbus = gst_pipeline_get_bus(GST_PIPELINE(spipeline));
         GSource *source = gst_bus_create_watch(bus);
@@ -169,10 +426,6 @@ RtpWorker::RtpWorker(GMainContext *mainContext, DeviceMonitor *hardwareDeviceMon
         g_source_set_callback(source, (GSourceFunc)cb_bus_call, this, nullptr);
         g_source_attach(source, mainContext_);*/
 #endif
-
-        QByteArray val = qgetenv("PSI_NO_SHARED_CLOCK");
-        if (!val.isEmpty())
-            use_shared_clock = false;
     }
 
     ++worker_refs;
@@ -193,6 +446,7 @@ RtpWorker::~RtpWorker()
 
     cleanup();
 
+    QMutexLocker locker(&pipelines_mutex);
     --worker_refs;
     if (worker_refs == 0) {
         delete send_pipelineContext;
@@ -201,11 +455,13 @@ RtpWorker::~RtpWorker()
         delete recv_pipelineContext;
         recv_pipelineContext = nullptr;
 
+        if (shared_clock) {
+            gst_object_unref(shared_clock);
+            shared_clock = nullptr;
+        }
+
         // sbus = 0;
     }
-
-    delete audioStats;
-    delete videoStats;
 }
 
 void RtpWorker::cleanup()
@@ -221,20 +477,99 @@ void RtpWorker::cleanup()
     volumeout = nullptr;
     volumeout_mutex.unlock();
 
+    opusenc_mutex.lock();
+    if (opusenc) {
+        gst_object_unref(opusenc);
+        opusenc = nullptr;
+    }
+    audioPacketLoss    = -1;
+    remoteLossReported = false;
+    opusenc_mutex.unlock();
+
+    videoenc_mutex.lock();
+    if (videoencoder) {
+        gst_object_unref(videoencoder);
+        videoencoder = nullptr;
+    }
+    if (ulpfecenc) {
+        gst_object_unref(ulpfecenc);
+        ulpfecenc = nullptr;
+    }
+    if (redenc) {
+        gst_object_unref(redenc);
+        redenc = nullptr;
+    }
+    if (rtxsend) {
+        gst_object_unref(rtxsend);
+        rtxsend = nullptr;
+    }
+    lastForcedKeyframe.invalidate();
+    videoPassthrough        = false;
+    useFec                  = false;
+    videoPt                 = -1;
+    videoRedPt              = -1;
+    videoPacketLoss         = -1;
+    videoRemoteLossReported = false;
+    videoenc_mutex.unlock();
+
     audiortpsrc_mutex.lock();
     audiortpsrc = nullptr;
+    delete audioJitter;
+    audioJitter = nullptr;
     audiortpsrc_mutex.unlock();
 
     videortpsrc_mutex.lock();
     videortpsrc = nullptr;
+    delete videoJitter;
+    videoJitter     = nullptr;
+    videoRecvRedPt  = -1;
+    videoRecvFecPt  = -1;
+    videoRemoteSsrc = 0;
+    lastRequestedKeyframe.invalidate();
     videortpsrc_mutex.unlock();
 
+    if (latencyTimer) {
+        g_source_destroy(latencyTimer);
+        g_source_unref(latencyTimer);
+        latencyTimer = nullptr;
+    }
+
+    if (audiojitterbuffer) {
+        gst_object_unref(audiojitterbuffer);
+        audiojitterbuffer = nullptr;
+    }
+
+    if (videojitterbuffer) {
+        gst_object_unref(videojitterbuffer);
+        videojitterbuffer = nullptr;
+    }
+
+    if (videoptdemux) {
+        gst_object_unref(videoptdemux);
+        videoptdemux = nullptr;
+    }
+
+    audioScaler      = nullptr;
+    audioLatency     = -1;
+    audioLatencyNext = -1;
+    videoLatency     = -1;
+
     rtpaudioout_mutex.lock();
     rtpaudioout = false;
+    holdAudio(false);
+    if (audioHoldPad) {
+        gst_object_unref(audioHoldPad);
+        audioHoldPad = nullptr;
+    }
     rtpaudioout_mutex.unlock();
 
     rtpvideoout_mutex.lock();
     rtpvideoout = false;
+    holdVideo(false);
+    if (videoHoldPad) {
+        gst_object_unref(videoHoldPad);
+        videoHoldPad = nullptr;
+    }
     rtpvideoout_mutex.unlock();
 
     // if(pd_audiosrc)
@@ -243,72 +578,62 @@ void RtpWorker::cleanup()
     // if(pd_videosrc)
     //    pd_videosrc->deactivate();
 
-    if (sendbin) {
-        if (shared_clock && send_clock_is_shared) {
-            gst_object_unref(shared_clock);
-            shared_clock         = nullptr;
-            send_clock_is_shared = false;
-
-            if (recv_in_use) {
-                qDebug("recv clock reverts to auto");
-                gst_element_set_state(rpipeline, GST_STATE_READY);
-                gst_element_get_state(rpipeline, nullptr, nullptr, GST_CLOCK_TIME_NONE);
-                gst_pipeline_auto_clock(GST_PIPELINE(rpipeline));
-
-                // only restart the receive pipeline if it is
-                //   owned by a separate session
-                if (!recvbin) {
-                    gst_element_set_state(rpipeline, GST_STATE_PLAYING);
-                    // gst_element_get_state(rpipeline, nullptr, nullptr, GST_CLOCK_TIME_NONE);
-                }
-            }
-        }
+    cancelSendWait();
+    cancelPrewarm();
 
+    QMutexLocker locker(&pipelines_mutex);
+    if (sendbin) {
         send_pipelineContext->deactivate();
-        gst_pipeline_auto_clock(GST_PIPELINE(spipeline));
         // gst_element_set_state(sendbin, GST_STATE_NULL);
         // gst_element_get_state(sendbin, nullptr, nullptr, GST_CLOCK_TIME_NONE);
         gst_bin_remove(GST_BIN(spipeline), sendbin);
         sendbin     = nullptr;
         send_in_use = false;
+        unwatchSendBus();
     }
 
     if (recvbin) {
-        // NOTE: commenting this out because recv clock is no longer
-        //  ever shared
-        /*if(shared_clock && recv_clock_is_shared)
-        {
-            gst_object_unref(shared_clock);
-            shared_clock = 0;
-            recv_clock_is_shared = false;
-
-            if(send_in_use)
-            {
-                // FIXME: do we really need to restart the pipeline?
-
-                qDebug("send clock becomes master");
-                send_pipelineContext->deactivate();
-                gst_pipeline_auto_clock(GST_PIPELINE(spipeline));
-                send_pipelineContext->activate();
-                //gst_element_get_state(spipeline, nullptr, nullptr, GST_CLOCK_TIME_NONE);
-
-                // send clock becomes shared
-                shared_clock = gst_pipeline_get_clock(GST_PIPELINE(spipeline));
-                gst_object_ref(GST_OBJECT(shared_clock));
-                gst_pipeline_use_clock(GST_PIPELINE(spipeline), shared_clock);
-                send_clock_is_shared = true;
+        // cut the bin loose from the mixer and the compositor, which other
+        //   sessions keep using
+        if (linkedCompositor) {
+            linkedCompositor->removeStream(linkedTile);
+            linkedCompositor.reset();
+            linkedTile = -1;
+        }
+        GstPad *pad = gst_element_get_static_pad(recvbin, "src");
+        if (pad) {
+            GstPad *peer = gst_pad_get_peer(pad);
+            if (peer) {
+                gst_pad_unlink(pad, peer);
+                gst_object_unref(peer);
             }
-        }*/
+            gst_object_unref(pad);
+        }
 
-        recv_pipelineContext->deactivate();
-        gst_pipeline_auto_clock(GST_PIPELINE(rpipeline));
-        // gst_element_set_state(recvbin, GST_STATE_NULL);
-        // gst_element_get_state(recvbin, nullptr, nullptr, GST_CLOCK_TIME_NONE);
-        gst_bin_remove(GST_BIN(rpipeline), recvbin);
-        recvbin     = nullptr;
-        recv_in_use = false;
+        // keep playing what other sessions receive.  once out of the
+        //   pipeline, where nothing else can reach it, our bin is stopped
+        //   without the lock.
+        int refs = recv_refs--;
+        if (refs > 1) {
+            gst_object_ref(recvbin);
+            gst_element_set_locked_state(recvbin, TRUE);
+            gst_bin_remove(GST_BIN(rpipeline), recvbin);
+            locker.unlock();
+            gst_element_set_state(recvbin, GST_STATE_NULL);
+            gst_object_unref(recvbin);
+            locker.relock();
+        } else {
+            recv_pipelineContext->deactivate();
+            // gst_element_set_state(recvbin, GST_STATE_NULL);
+            // gst_element_get_state(recvbin, nullptr, nullptr, GST_CLOCK_TIME_NONE);
+            gst_bin_remove(GST_BIN(rpipeline), recvbin);
+        }
+        recvbin = nullptr;
     }
 
+    // with nothing flowing anymore, devices being switched can go
+    cancelSwitches();
+
     if (pd_audiosrc) {
         delete pd_audiosrc;
         pd_audiosrc = nullptr;
@@ -351,26 +676,71 @@ void RtpWorker::transmitAudio()
 {
     QMutexLocker locker(&rtpaudioout_mutex);
     rtpaudioout = true;
+    holdAudio(false);
 }
 
 void RtpWorker::transmitVideo()
 {
-    QMutexLocker locker(&rtpvideoout_mutex);
-    rtpvideoout = true;
+    {
+        QMutexLocker locker(&rtpvideoout_mutex);
+        rtpvideoout = true;
+        if (!videoHold)
+            return;
+        holdVideo(false);
+    }
+
+    // the remote has nothing to decode from until the next keyframe
+    QMutexLocker locker(&videoenc_mutex);
+    if (videoencoder) {
+        lastForcedKeyframe.start();
+        gst_element_send_event(videoencoder, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+    }
 }
 
 void RtpWorker::pauseAudio()
 {
     QMutexLocker locker(&rtpaudioout_mutex);
     rtpaudioout = false;
+    holdAudio(true);
 }
 
 void RtpWorker::pauseVideo()
 {
     QMutexLocker locker(&rtpvideoout_mutex);
     rtpvideoout = false;
+    holdVideo(true);
+}
+
+static GstPadProbeReturn drop_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    Q_UNUSED(pad);
+    Q_UNUSED(info);
+    Q_UNUSED(data);
+    return GST_PAD_PROBE_DROP;
 }
 
+// buffers only, events such as caps and eos still pass
+static void set_hold(GstPad *pad, gulong *probe, bool hold)
+{
+    if (!pad || hold == (*probe != 0))
+        return;
+    if (hold) {
+        *probe = gst_pad_add_probe(pad, GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                                   drop_probe, nullptr, nullptr);
+    } else {
+        gst_pad_remove_probe(pad, *probe);
+        *probe = 0;
+    }
+}
+
+// the payloaders only come up with their caps once something was encoded,
+//   so nothing is held before getCaps() is done.  call with
+//   rtpaudioout_mutex held.
+void RtpWorker::holdAudio(bool hold) { set_hold(audioHoldPad, &audioHold, hold && canTransmitAudio); }
+
+// likewise, with rtpvideoout_mutex held
+void RtpWorker::holdVideo(bool hold) { set_hold(videoHoldPad, &videoHold, hold && canTransmitVideo); }
+
 void RtpWorker::stop()
 {
     // cancel any current operation
@@ -382,6 +752,276 @@ void RtpWorker::stop()
     g_source_attach(timer, mainContext_);
 }
 
+void RtpWorker::prewarm()
+{
+    QMutexLocker locker(&pipelines_mutex);
+    if (send_in_use || pd_audiowarm || pd_videowarm || !infile.isEmpty() || !indata.isEmpty())
+        return;
+
+    if (!ain.isEmpty())
+        pd_audiowarm = warmDevice(ain, PDevice::AudioIn, audioInputOptions(), &audiowarmsink);
+    if (!vin.isEmpty())
+        pd_videowarm = warmDevice(vin, PDevice::VideoIn, videoInputOptions(), &videowarmsink);
+    if (!pd_audiowarm && !pd_videowarm)
+        return;
+
+#ifdef RTPWORKER_DEBUG
+    qDebug("prewarming input devices");
+#endif
+    // not waiting for it, devices may take a while
+    send_in_use = true;
+    watchSendBus();
+    send_pipelineContext->activate();
+}
+
+void RtpWorker::cancelPrewarm()
+{
+    QMutexLocker locker(&pipelines_mutex);
+    if (!pd_audiowarm && !pd_videowarm)
+        return;
+
+    // started sending, the send bin takes care of the pipeline
+    if (!sendbin) {
+        send_pipelineContext->deactivate();
+        unwatchSendBus();
+        send_in_use = false;
+    }
+    releaseWarmDevices();
+}
+
+PipelineDeviceContext *RtpWorker::warmDevice(const QString &id, PDevice::Type type, const PipelineDeviceOptions &opts,
+                                             GstElement **sink)
+{
+    PipelineDeviceContext *pd
+        = PipelineDeviceContext::create(send_pipelineContext, id, type, hardwareDeviceMonitor_, opts);
+    if (!pd) {
+#ifdef RTPWORKER_DEBUG
+        qDebug("Failed to prewarm input element '%s'.", qPrintable(id));
+#endif
+        return nullptr;
+    }
+
+    *sink = gst_element_factory_make("fakesink", nullptr);
+    g_object_set(G_OBJECT(*sink), "sync", FALSE, "async", FALSE, nullptr);
+    gst_bin_add(GST_BIN(spipeline), *sink);
+    gst_element_link(pd->element(), *sink);
+    return pd;
+}
+
+void RtpWorker::releaseWarmDevices()
+{
+    // devices of the session stay open through its refs
+    delete pd_audiowarm;
+    pd_audiowarm = nullptr;
+    delete pd_videowarm;
+    pd_videowarm = nullptr;
+
+    for (GstElement **sink : { &audiowarmsink, &videowarmsink }) {
+        if (*sink) {
+            gst_element_set_state(*sink, GST_STATE_NULL);
+            gst_bin_remove(GST_BIN(spipeline), *sink);
+            *sink = nullptr;
+        }
+    }
+}
+
+PipelineDeviceOptions RtpWorker::audioInputOptions() const
+{
+    PipelineDeviceOptions options;
+    if (pd_audiosink != nullptr) {
+        options     = pd_audiosink->options();
+        options.aec = !options.echoProberName.isEmpty();
+    }
+    return options;
+}
+
+PipelineDeviceOptions RtpWorker::videoInputOptions() const
+{
+    PipelineDeviceOptions opts;
+    if (!localVideoParams.isEmpty())
+        opts.videoSize = localVideoParams[0].size;
+    // opts.videoSize = QSize(640, 480);
+    opts.fps  = 30;
+    opts.h264 = sendVideoCodec() == "h264";
+    return opts;
+}
+
+// holds data at a pad for as long as it is installed
+static GstPadProbeReturn hold_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    Q_UNUSED(pad);
+    Q_UNUSED(info);
+    Q_UNUSED(data);
+    return GST_PAD_PROBE_OK;
+}
+
+// replaces the ref of an input linked to the send bin by one of another
+//   device, once the old one is between buffers.  should the new device
+//   fail, the old one is kept.
+void RtpWorker::switchInput(PipelineDeviceContext **pd, GstElement **element, const QString &id, PDevice::Type type,
+                            const PipelineDeviceOptions &opts)
+{
+    if (!*pd || id.isEmpty() || (*pd)->id() == id)
+        return;
+
+    QMutexLocker           locker(&pipelines_mutex);
+    PipelineDeviceContext *next
+        = PipelineDeviceContext::create(send_pipelineContext, id, type, hardwareDeviceMonitor_, opts);
+    if (!next) {
+        qWarning("Failed to create input element '%s', keeping the one in use", qPrintable(id));
+        return;
+    }
+
+    // the send bin was built for raw video or for the camera's h264
+    if (type == PDevice::VideoIn && next->isEncoded() != videoPassthrough) {
+        qWarning("Video input '%s' can't replace the one in use while sending", qPrintable(id));
+        delete next;
+        return;
+    }
+
+    auto sw     = new DeviceSwitch;
+    sw->worker  = this;
+    sw->old     = *pd;
+    sw->src     = gst_element_get_static_pad(*element, "src");
+    sw->sink    = gst_pad_get_peer(sw->src);
+    sw->newsrc  = gst_element_get_static_pad(next->element(), "src");
+    sw->newsink = GST_PAD(gst_object_ref(sw->sink));
+    sw->pad     = GST_PAD(gst_object_ref(sw->src));
+
+    // the device may take a while to start, the old one goes on meanwhile
+    sw->block = gst_pad_add_probe(sw->newsrc, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM, hold_probe, nullptr, nullptr);
+    next->activate();
+
+    *pd      = next;
+    *element = next->element();
+    beginSwitch(sw);
+}
+
+// likewise for the audio output, the receive bin playing on
+void RtpWorker::switchOutput()
+{
+    if (!pd_audiosink || aout.isEmpty() || pd_audiosink->id() == aout)
+        return;
+
+    QMutexLocker           locker(&pipelines_mutex);
+    PipelineDeviceContext *next
+        = PipelineDeviceContext::create(recv_pipelineContext, aout, PDevice::AudioOut, hardwareDeviceMonitor_);
+    if (!next) {
+        qWarning("Failed to create output element '%s', keeping the one in use", qPrintable(aout));
+        return;
+    }
+
+    auto sw     = new DeviceSwitch;
+    sw->worker  = this;
+    sw->old     = pd_audiosink;
+    sw->src     = gst_element_get_static_pad(recvbin, "src");
+    sw->sink    = gst_pad_get_peer(sw->src);
+    sw->newsrc  = GST_PAD(gst_object_ref(sw->src));
+    sw->newsink = gst_element_get_static_pad(next->element(), "sink");
+    sw->pad     = GST_PAD(gst_object_ref(sw->src));
+
+    // the echo to cancel is the one of the new output
+    pd_audiosink = next;
+    if (pd_audiosrc) {
+        PipelineDeviceOptions opts = pd_audiosrc->options();
+        opts.echoProberName        = next->options().echoProberName;
+        pd_audiosrc->setOptions(opts);
+    }
+    beginSwitch(sw);
+}
+
+void RtpWorker::beginSwitch(DeviceSwitch *sw)
+{
+    {
+        QMutexLocker locker(&switches_mutex);
+        switches += sw;
+    }
+
+    // called right away if nothing flows at the moment
+    sw->probe = gst_pad_add_probe(sw->pad, GST_PAD_PROBE_TYPE_IDLE, cb_device_switch_idle, sw, nullptr);
+}
+
+// note: this may be called from a streaming thread
+GstPadProbeReturn RtpWorker::deviceSwitchIdle(DeviceSwitch *sw)
+{
+    QMutexLocker locker(&switches_mutex);
+    if (!sw->linked) {
+        gst_pad_unlink(sw->src, sw->sink);
+        gst_pad_link(sw->newsrc, sw->newsink);
+        if (sw->block)
+            gst_pad_remove_probe(sw->newsrc, sw->block);
+        sw->linked = true;
+
+        if (!switchTimer) {
+            switchTimer = g_timeout_source_new(0);
+            g_source_set_callback(switchTimer, cb_finishSwitches, this, nullptr);
+            g_source_attach(switchTimer, mainContext_);
+        }
+    }
+
+    // an old input is held until released, an output goes on
+    return sw->pad == sw->newsrc ? GST_PAD_PROBE_REMOVE : GST_PAD_PROBE_OK;
+}
+
+gboolean RtpWorker::finishSwitches()
+{
+    QMutexLocker          locker(&pipelines_mutex);
+    QList<DeviceSwitch *> done;
+    {
+        QMutexLocker switchesLocker(&switches_mutex);
+        g_source_unref(switchTimer);
+        switchTimer = nullptr;
+
+        for (auto it = switches.begin(); it != switches.end();) {
+            if ((*it)->linked) {
+                done += *it;
+                it = switches.erase(it);
+            } else
+                ++it;
+        }
+    }
+
+    for (DeviceSwitch *sw : std::as_const(done))
+        endSwitch(sw);
+    return FALSE;
+}
+
+// the old ref goes down before its pad is let go, so that nothing
+//   reaches the end of it unlinked
+void RtpWorker::endSwitch(DeviceSwitch *sw)
+{
+    delete sw->old;
+
+    // the probe of an output went away once linked
+    if (sw->pad != sw->newsrc || !sw->linked)
+        gst_pad_remove_probe(sw->pad, sw->probe);
+    if (sw->block && !sw->linked)
+        gst_pad_remove_probe(sw->newsrc, sw->block);
+
+    for (GstPad *pad : { sw->pad, sw->src, sw->sink, sw->newsrc, sw->newsink }) {
+        if (pad)
+            gst_object_unref(pad);
+    }
+    delete sw;
+}
+
+void RtpWorker::cancelSwitches()
+{
+    QList<DeviceSwitch *> left;
+    {
+        QMutexLocker locker(&switches_mutex);
+        if (switchTimer) {
+            g_source_destroy(switchTimer);
+            g_source_unref(switchTimer);
+            switchTimer = nullptr;
+        }
+        left.swap(switches);
+    }
+
+    for (DeviceSwitch *sw : std::as_const(left))
+        endSwitch(sw);
+}
+
 static GstBuffer *makeGstBuffer(const PRtpPacket &packet)
 {
     GstBuffer *buffer;
@@ -420,17 +1060,104 @@ GstAppSink *RtpWorker::makeVideoPlayAppSink(const gchar *name)
 
 void RtpWorker::rtpAudioIn(const PRtpPacket &packet)
 {
+    // we don't run a full rtcp session, just pick the loss out of the
+    //   remote's reports
+    if (packet.portOffset == 1) {
+        int percent = rtcp_fraction_lost(packet.rawValue);
+        if (percent != -1) {
+            if (stats)
+                stats->audioSent.loss = percent;
+            setAudioPacketLoss(percent, true);
+        }
+        return;
+    }
+
     QMutexLocker locker(&audiortpsrc_mutex);
     if (packet.portOffset == 0 && audiortpsrc) {
+        if (audioJitter)
+            audioJitter->packetReceived(packet.rawValue);
+        if (stats)
+            stats->audioReceived.packetReceived(packet.rawValue);
         gst_app_src_push_buffer((GstAppSrc *)audiortpsrc, makeGstBuffer(packet));
     }
 }
 
 void RtpWorker::rtpVideoIn(const PRtpPacket &packet)
 {
+    if (packet.portOffset == 1) {
+        int percent = rtcp_fraction_lost(packet.rawValue);
+        if (percent != -1) {
+            if (stats)
+                stats->videoSent.loss = percent;
+            setVideoPacketLoss(percent, true);
+        }
+
+        RtcpFeedback feedback;
+        if (rtcp_parse_feedback(packet.rawValue, &feedback))
+            videoFeedbackReceived(feedback);
+        return;
+    }
+
     QMutexLocker locker(&videortpsrc_mutex);
-    if (packet.portOffset == 0 && videortpsrc)
+    if (packet.portOffset == 0 && videortpsrc) {
+        // retransmissions come with a payload type, an ssrc and sequence
+        //   numbers of their own.  only the media tells who to ask for
+        //   keyframes, and goes into the estimates.  fec packets, in red,
+        //   take sequence numbers of the media but say nothing of its
+        //   timing.
+        int  pt    = rtp_media_payload_type(packet.rawValue, videoRecvRedPt);
+        bool media = pt != -1 && is_media_payload(videoRecvPayloads, pt);
+        if (media || (pt != -1 && pt == videoRecvFecPt)) {
+            if (videoJitter)
+                videoJitter->packetReceived(packet.rawValue, media);
+            if (stats)
+                stats->videoReceived.packetReceived(packet.rawValue, media);
+            videoRemoteSsrc = rtp_ssrc(packet.rawValue);
+        } else if (pt != -1 && stats)
+            stats->videoReceived.retransmissionReceived(packet.rawValue.size());
+        if (media && latencyTracker) {
+            qint64 capture = -1;
+            if (int id = captureTimeExtensionId) {
+                QByteArray ext = rtp_header_extension(packet.rawValue, id);
+                if (ext.size() >= 8)
+                    capture = ntp_to_unix_usec(GST_READ_UINT64_BE(ext.constData()));
+            }
+            latencyTracker->packetReceived(rtp_timestamp(packet.rawValue), rtp_marker(packet.rawValue), capture);
+        }
         gst_app_src_push_buffer((GstAppSrc *)videortpsrc, makeGstBuffer(packet));
+    }
+}
+
+void RtpWorker::requestKeyframe()
+{
+    quint32 ssrc;
+    {
+        QMutexLocker locker(&videortpsrc_mutex);
+        ssrc = videoRemoteSsrc;
+
+        // nothing received yet, so nobody to ask
+        if (!ssrc)
+            return;
+        if (lastRequestedKeyframe.isValid() && lastRequestedKeyframe.elapsed() < KEYFRAME_MIN_INTERVAL)
+            return;
+        lastRequestedKeyframe.start();
+    }
+
+    if (stats)
+        ++stats->videoReceived.plis;
+    sendVideoRtcp(rtcp_make_pli(feedbackSsrc, ssrc));
+}
+
+void RtpWorker::setPreviewEnabled(bool enabled)
+{
+    if (previewEnabled.exchange(enabled) == enabled || !enabled)
+        return;
+
+    // the decoder starts over at the next keyframe, so have one soon
+    previewNeedsKeyframe = true;
+    QMutexLocker locker(&videoenc_mutex);
+    if (videoPassthrough && videoencoder)
+        gst_element_send_event(videoencoder, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
 }
 
 void RtpWorker::setOutputVolume(int level)
@@ -466,10 +1193,24 @@ void RtpWorker::recordStop()
     // FIXME: don't just do nothing
 }
 
-void RtpWorker::dumpPipeline(std::function<void(const QStringList &)> callback)
+void RtpWorker::dumpPipeline(std::function<void(const QStringList &)> callback, bool profile)
 {
+    QMutexLocker locker(&pipelines_mutex);
     QStringList ret;
-    auto        dir = QString::fromLocal8Bit(qgetenv("GST_DEBUG_DUMP_DOT_DIR"));
+    if (profile && callback) {
+        QStringList report;
+        if (spipeline)
+            report += PipelineProfiler::report(spipeline, QStringLiteral("send pipeline"));
+        if (rpipeline)
+            report += PipelineProfiler::report(rpipeline, QStringLiteral("receive pipeline"));
+        ret += report.join(QStringLiteral("\n\n"));
+        if (spipeline)
+            ret += PipelineProfiler::graph(spipeline);
+        if (rpipeline)
+            ret += PipelineProfiler::graph(rpipeline);
+    }
+
+    auto dir = QString::fromLocal8Bit(qgetenv("GST_DEBUG_DUMP_DOT_DIR"));
     if (!dir.isEmpty()) {
         if (spipeline) {
             GST_DEBUG_BIN_TO_DOT_FILE(GST_BIN(spipeline), GST_DEBUG_GRAPH_SHOW_ALL, "psimedia_send");
@@ -565,6 +1306,66 @@ void RtpWorker::cb_packet_ready_eos_stub(GstAppSink *appsink, gpointer data)
 
 gboolean RtpWorker::cb_fileReady(gpointer data) { return static_cast<RtpWorker *>(data)->fileReady(); }
 
+gboolean RtpWorker::cb_updateLatency(gpointer data) { return static_cast<RtpWorker *>(data)->updateLatency(); }
+
+gboolean RtpWorker::cb_sendStartTimeout(gpointer data) { return static_cast<RtpWorker *>(data)->sendStartTimeout(); }
+
+gboolean RtpWorker::cb_finishSwitches(gpointer data) { return static_cast<RtpWorker *>(data)->finishSwitches(); }
+
+GstPadProbeReturn RtpWorker::cb_device_switch_idle(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    Q_UNUSED(pad);
+    Q_UNUSED(info);
+    auto sw = static_cast<DeviceSwitch *>(data);
+    return sw->worker->deviceSwitchIdle(sw);
+}
+
+GstPadProbeReturn RtpWorker::cb_video_upstream_event(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    Q_UNUSED(pad);
+    static_cast<RtpWorker *>(data)->videoUpstreamEvent(GST_PAD_PROBE_INFO_EVENT(info));
+    return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn RtpWorker::cb_video_payloaded(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    static_cast<RtpWorker *>(data)->videoPayloaded(pad, info);
+    return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn RtpWorker::cb_video_dequeued(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    Q_UNUSED(pad);
+    static_cast<RtpWorker *>(data)->videoDequeued(GST_PAD_PROBE_INFO_BUFFER(info));
+    return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn RtpWorker::cb_video_decoded(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    Q_UNUSED(pad);
+    static_cast<RtpWorker *>(data)->latencyTracker->frameDecoded(GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info)));
+    return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn RtpWorker::cb_video_preview_gate(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    Q_UNUSED(pad);
+    if (!static_cast<RtpWorker *>(data)->videoPreviewWanted(GST_PAD_PROBE_INFO_BUFFER(info)))
+        return GST_PAD_PROBE_DROP;
+    return GST_PAD_PROBE_OK;
+}
+
+GstCaps *RtpWorker::cb_video_request_pt_map(GstElement *element, guint pt, gpointer data)
+{
+    Q_UNUSED(element);
+    return static_cast<RtpWorker *>(data)->videoRequestPtMap(pt);
+}
+
+void RtpWorker::cb_video_payload_added(GstElement *element, GstPad *pad, gpointer data)
+{
+    static_cast<RtpWorker *>(data)->videoPayloadAdded(element, pad);
+}
+
 gboolean RtpWorker::doStart()
 {
     timer = nullptr;
@@ -584,6 +1385,9 @@ gboolean RtpWorker::doStart()
     if (!setupSendRecv()) {
         if (cb_error)
             cb_error(app);
+    } else if (sendTimeout) {
+        // signaled once sending started
+        cb_sendReady = cb_started;
     } else {
         // don't signal started here if using files
         if (!fileDemux && cb_started)
@@ -600,6 +1404,9 @@ gboolean RtpWorker::doUpdate()
     if (!setupSendRecv()) {
         if (cb_error)
             cb_error(app);
+    } else if (sendTimeout) {
+        // sending was added, signaled once it started
+        cb_sendReady = cb_updated;
     } else {
         if (cb_updated)
             cb_updated(app);
@@ -727,6 +1534,28 @@ void RtpWorker::fileDemux_pad_removed(GstElement *element, GstPad *pad)
 gboolean RtpWorker::bus_call(GstBus *bus, GstMessage *msg)
 {
     Q_UNUSED(bus);
+    QMutexLocker locker(&pipelines_mutex);
+
+    // starting to send, we wait for the send bin to play, rather than
+    //   blocking everyone else in this thread
+    if (sendTimeout && sendbin) {
+        if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_STATE_CHANGED && GST_MESSAGE_SRC(msg) == GST_OBJECT(sendbin)) {
+            GstState oldstate, newstate, pending;
+            gst_message_parse_state_changed(msg, &oldstate, &newstate, &pending);
+            if (newstate == GST_STATE_PLAYING && pending == GST_STATE_VOID_PENDING) {
+                sendReady();
+                return TRUE;
+            }
+        } else if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+#ifdef RTPWORKER_DEBUG
+            qDebug("error while setting send pipeline to PLAYING");
+#endif
+            sendStartFailed();
+            return TRUE;
+        }
+    }
+
+#ifdef RTPWORKER_DEBUG
     // GMainLoop *loop = static_cast<GMainLoop *>(data);
     switch (GST_MESSAGE_TYPE(msg)) {
     case GST_MESSAGE_EOS: {
@@ -786,6 +1615,7 @@ gboolean RtpWorker::bus_call(GstBus *bus, GstMessage *msg)
         qDebug("Bus message: %s", GST_MESSAGE_TYPE_NAME(msg));
         break;
     }
+#endif
 
     return TRUE;
 }
@@ -810,6 +1640,9 @@ GstFlowReturn RtpWorker::show_frame_output(GstAppSink *appsink)
         return GST_FLOW_ERROR;
     }
 
+    if (latencyTracker)
+        frame.timing = latencyTracker->framePulled(frame.pts);
+
     if (cb_outputFrame)
         cb_outputFrame(frame, app);
 
@@ -830,13 +1663,12 @@ GstFlowReturn RtpWorker::packet_ready_rtp_audio(GstAppSink *appsink)
     packet.rawValue   = ba;
     packet.portOffset = 0;
 
-#ifdef RTPWORKER_DEBUG
-    audioStats->print_stats(packet.rawValue.size());
-#endif
-
     QMutexLocker locker(&rtpaudioout_mutex);
-    if (cb_rtpAudioOut && rtpaudioout)
+    if (cb_rtpAudioOut && rtpaudioout) {
+        if (stats)
+            stats->audioSent.packetSent(sz);
         cb_rtpAudioOut(packet, app);
+    }
 
     return GST_FLOW_OK;
 }
@@ -855,43 +1687,486 @@ GstFlowReturn RtpWorker::packet_ready_rtp_video(GstAppSink *appsink)
     packet.rawValue   = ba;
     packet.portOffset = 0;
 
+    // let relays and constrained receivers drop upper layers
+    if (videoTemporalLayers > 1) {
+        QMutexLocker locker(&videoenc_mutex);
+        packet.temporalLayer = rtp_vp8_temporal_layer(ba, videoPt, videoRedPt);
+    }
+
+    QMutexLocker locker(&rtpvideoout_mutex);
+    if (cb_rtpVideoOut && rtpvideoout) {
+        if (stats)
+            stats->videoSent.packetSent(sz);
+        cb_rtpVideoOut(packet, app);
+    }
+
+    return GST_FLOW_OK;
+}
+
+gboolean RtpWorker::fileReady()
+{
+    if (loopFile) {
+        // gst_element_set_state(sendPipeline, GST_STATE_PAUSED);
+        // gst_element_get_state(sendPipeline, nullptr, nullptr, GST_CLOCK_TIME_NONE);
+
+        /*gst_element_seek(sendPipeline, 1, GST_FORMAT_TIME,
+            (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_SEGMENT),
+            GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_END, 0);*/
+    }
+
+    QMutexLocker locker(&pipelines_mutex);
+    send_pipelineContext->activate();
+    // gst_element_set_state(sendPipeline, GST_STATE_PLAYING);
+    // gst_element_get_state(sendPipeline, nullptr, nullptr, GST_CLOCK_TIME_NONE);
+
+    waitForSend();
+    cb_sendReady = cb_started;
+    return FALSE;
+}
+
+gboolean RtpWorker::sendStartTimeout()
+{
+#ifdef RTPWORKER_DEBUG
+    qDebug("timeout while setting send pipeline to PLAYING");
+#endif
+    QMutexLocker locker(&pipelines_mutex);
+    sendStartFailed();
+    return FALSE;
+}
+
+void RtpWorker::watchSendBus()
+{
+    if (sendWatch)
+        return;
+
+    // whatever was posted while nobody was sending is of no interest
+    GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(spipeline));
+    gst_bus_set_flushing(bus, TRUE);
+    gst_bus_set_flushing(bus, FALSE);
+
+    sendWatch = gst_bus_create_watch(bus);
+    gst_object_unref(bus);
+    g_source_set_callback(sendWatch, (GSourceFunc)cb_bus_call, this, nullptr);
+    g_source_attach(sendWatch, mainContext_);
+}
+
+void RtpWorker::unwatchSendBus()
+{
+    if (sendWatch) {
+        g_source_destroy(sendWatch);
+        g_source_unref(sendWatch);
+        sendWatch = nullptr;
+    }
+}
+
+void RtpWorker::waitForSend()
+{
+    // 10 seconds ought to be enough time to init (video devices probing may take considerable time)
+    sendTimeout = g_timeout_source_new(10000);
+    g_source_set_callback(sendTimeout, cb_sendStartTimeout, this, nullptr);
+    g_source_attach(sendTimeout, mainContext_);
+}
+
+void RtpWorker::cancelSendWait()
+{
+    if (sendTimeout) {
+        g_source_destroy(sendTimeout);
+        g_source_unref(sendTimeout);
+        sendTimeout = nullptr;
+    }
+    cb_sendReady = nullptr;
+}
+
+void RtpWorker::sendReady()
+{
+    auto cb = cb_sendReady;
+    cancelSendWait();
+
+    bool live = !fileDemux;
+    if (live) {
+        // the session's refs keep the devices running
+        releaseWarmDevices();
+    }
+
 #ifdef RTPWORKER_DEBUG
-    videoStats->print_stats(packet.rawValue.size());
+    qDebug("state changed");
+
+    qDebug("Dumping send pipeline");
+    dump_pipeline(spipeline);
+    GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS(GST_BIN(spipeline), GST_DEBUG_GRAPH_SHOW_ALL, "psimedia_send_active");
+
+#endif
+
+    if (!getCaps()) {
+        error = RtpSessionContext::ErrorCodec;
+        if (cb_error)
+            cb_error(app);
+        return;
+    }
+
+    // nothing is encoded until transmitting
+    {
+        QMutexLocker locker(&rtpaudioout_mutex);
+        holdAudio(!rtpaudioout);
+    }
+    {
+        QMutexLocker locker(&rtpvideoout_mutex);
+        holdVideo(!rtpvideoout);
+    }
+
+    if (live) {
+        actual_localAudioPayloadInfo = localAudioPayloadInfo;
+        actual_localVideoPayloadInfo = localVideoPayloadInfo;
+    }
+
+    if (cb)
+        cb(app);
+}
+
+void RtpWorker::sendStartFailed()
+{
+    cleanup();
+    error = RtpSessionContext::ErrorGeneric;
+    if (cb_error)
+        cb_error(app);
+}
+
+// note: this is called from a streaming thread
+void RtpWorker::videoUpstreamEvent(GstEvent *event)
+{
+    // the jitter buffer asks for retransmissions and the depayloader for
+    //   keyframes.  without an rtp session in the pipeline, nobody would
+    //   turn these into rtcp feedback for us.
+    const GstStructure *s = gst_event_get_structure(event);
+    if (gst_video_event_is_force_key_unit(event)) {
+        requestKeyframe();
+    } else if (s && gst_structure_has_name(s, "GstRTPRetransmissionRequest")) {
+        guint seqnum, ssrc;
+        if (gst_structure_get_uint(s, "seqnum", &seqnum) && gst_structure_get_uint(s, "ssrc", &ssrc)) {
+            if (stats)
+                ++stats->videoReceived.nacks;
+            sendVideoRtcp(rtcp_make_nack(feedbackSsrc, ssrc, QList<quint16>() << quint16(seqnum)));
+        }
+    }
+}
+
+// note: this is called from a streaming thread
+void RtpWorker::videoPayloaded(GstPad *pad, GstPadProbeInfo *info)
+{
+    // payloaders keep the pts of the raw frame, which is the running time
+    //   it was captured at.  how long ago that was is what we take off the
+    //   wall clock.
+    GstElement  *element = gst_pad_get_parent_element(pad);
+    GstClock    *clock   = gst_element_get_clock(element);
+    GstClockTime base    = gst_element_get_base_time(element);
+    gst_object_unref(element);
+    if (!clock)
+        return;
+    GstClockTime clockNow = gst_clock_get_time(clock);
+    qint64       now      = LatencyTracker::now();
+    gst_object_unref(clock);
+
+    int  id    = captureTimeExtensionId;
+    auto stamp = [&](GstBuffer *buffer) {
+        GstClockTime pts = GST_BUFFER_PTS(buffer);
+        if (!GST_CLOCK_TIME_IS_VALID(pts) || base + pts > clockNow)
+            return;
+        qint64 capture = now - qint64(GST_TIME_AS_USECONDS(clockNow - base - pts));
+        if (stamp_capture_time(buffer, id, capture) && latencyTracker)
+            latencyTracker->frameSent(capture);
+    };
+
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+        if (id) {
+            list                          = gst_buffer_list_make_writable(list);
+            GST_PAD_PROBE_INFO_DATA(info) = list;
+        }
+        for (guint n = 0; n < gst_buffer_list_length(list); ++n)
+            stamp(id ? gst_buffer_list_get_writable(list, n) : gst_buffer_list_get(list, n));
+    } else {
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        if (id) {
+            buffer                        = gst_buffer_make_writable(buffer);
+            GST_PAD_PROBE_INFO_DATA(info) = buffer;
+        }
+        stamp(buffer);
+    }
+}
+
+// note: this is called from a streaming thread
+bool RtpWorker::videoPreviewWanted(GstBuffer *buffer)
+{
+    if (!previewEnabled)
+        return false;
+    if (previewNeedsKeyframe) {
+        if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+            return false;
+        previewNeedsKeyframe = false;
+    }
+    return true;
+}
+
+// note: this is called from a streaming thread
+GstCaps *RtpWorker::videoRequestPtMap(guint pt)
+{
+    QMutexLocker locker(&videortpsrc_mutex);
+    for (const PPayloadInfo &pi : std::as_const(videoRecvPayloads)) {
+        if (guint(pi.id) != pt)
+            continue;
+
+        GstStructure *cs = payloadInfoToStructure(pi, "video");
+        if (!cs)
+            break;
+        GstCaps *caps = gst_caps_new_empty();
+        gst_caps_append_structure(caps, cs);
+        return caps;
+    }
+
+    // the demuxer fails without caps.  payload types not negotiated, or
+    //   not yet, get some without a codec, which go to a fakesink.
+    return gst_caps_new_simple("application/x-rtp", "media", G_TYPE_STRING, "video", "clock-rate", G_TYPE_INT, 90000,
+                               "payload", G_TYPE_INT, int(pt), nullptr);
+}
+
+static QString caps_encoding_name(GstCaps *caps)
+{
+    const gchar *name = caps ? gst_structure_get_string(gst_caps_get_structure(caps, 0), "encoding-name") : nullptr;
+    return name ? QString::fromLatin1(name).toLower() : QString();
+}
+
+// links a pad of the demuxer to a new branch for codec, and the branch to
+//   the funnel.  a codec we can't decode goes to a fakesink, returning
+//   false.
+bool RtpWorker::addVideoBranch(GstBin *videodec, GstPad *pad, const QString &codec)
+{
+    GstElement *branch  = bins_videodepay_create(codec);
+    bool        decoded = branch != nullptr;
+    if (!decoded) {
+#ifdef RTPWORKER_DEBUG
+        qDebug("no decoder for %s", qPrintable(codec));
+#endif
+        branch = gst_element_factory_make("fakesink", nullptr);
+        g_object_set(G_OBJECT(branch), "async", FALSE, "sync", FALSE, nullptr);
+    }
+
+    gst_bin_add(videodec, branch);
+    GstPad *sinkpad = gst_element_get_static_pad(branch, "sink");
+    gst_pad_link(pad, sinkpad);
+    gst_object_unref(sinkpad);
+
+    if (decoded) {
+        GstElement *funnel = gst_bin_get_by_name(videodec, "funnel");
+        gst_element_link(branch, funnel);
+        gst_object_unref(funnel);
+
+        if (stats) {
+            GstElement *decoder = gst_bin_get_by_name(GST_BIN(branch), "video-decoder");
+            if (decoder) {
+                stats->videoReceived.watchCodec(decoder);
+                gst_object_unref(decoder);
+            }
+        }
+    }
+    gst_element_sync_state_with_parent(branch);
+
+    g_object_set_data_full(G_OBJECT(pad), "psimedia-codec", g_strdup(codec.toLatin1().constData()), g_free);
+    return decoded;
+}
+
+// called from the streaming thread, the first time packets of a payload
+//   type come in
+void RtpWorker::videoPayloadAdded(GstElement *demux, GstPad *pad)
+{
+    GstCaps *caps  = gst_pad_get_current_caps(pad);
+    QString  codec = caps_encoding_name(caps);
+    if (caps)
+        gst_caps_unref(caps);
+
+    auto videodec = GST_BIN(gst_element_get_parent(demux));
+    bool decoded  = addVideoBranch(videodec, pad, codec);
+    gst_object_unref(videodec);
+
+    // updates may give the payload type another codec, or one at all
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, cb_video_payload_caps, this, nullptr);
+
+    // the remote switched codecs, the new decoder can only start at a
+    //   keyframe
+    GST_OBJECT_LOCK(demux);
+    bool switched = demux->numsrcpads > 1;
+    GST_OBJECT_UNLOCK(demux);
+    if (decoded && switched)
+        requestKeyframe();
+}
+
+GstPadProbeReturn RtpWorker::cb_video_payload_caps(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+        GstCaps *caps;
+        gst_event_parse_caps(event, &caps);
+        static_cast<RtpWorker *>(data)->videoPayloadCaps(pad, caps);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// called from the streaming thread, ahead of the caps going to the branch.
+//   a branch of another codec replaces the one there is.
+void RtpWorker::videoPayloadCaps(GstPad *pad, GstCaps *caps)
+{
+    QString codec = caps_encoding_name(caps);
+    if (codec == QString::fromLatin1(static_cast<const char *>(g_object_get_data(G_OBJECT(pad), "psimedia-codec"))))
+        return;
+
+    GstPad *sinkpad = gst_pad_get_peer(pad);
+    if (!sinkpad)
+        return;
+    GstElement *old      = gst_pad_get_parent_element(sinkpad);
+    auto        videodec = GST_BIN(gst_element_get_parent(old));
+    gst_pad_unlink(pad, sinkpad);
+    gst_object_unref(sinkpad);
+
+    // the funnel pad it fed goes with it
+    GstPad *srcpad = gst_element_get_static_pad(old, "src");
+    if (srcpad) {
+        GstPad *funnelpad = gst_pad_get_peer(srcpad);
+        if (funnelpad) {
+            gst_pad_unlink(srcpad, funnelpad);
+            GstElement *funnel = gst_pad_get_parent_element(funnelpad);
+            gst_element_release_request_pad(funnel, funnelpad);
+            gst_object_unref(funnel);
+            gst_object_unref(funnelpad);
+        }
+        gst_object_unref(srcpad);
+    }
+    gst_element_set_locked_state(old, TRUE);
+    gst_element_set_state(old, GST_STATE_NULL);
+    gst_bin_remove(videodec, old);
+    gst_object_unref(old);
+
+    if (addVideoBranch(videodec, pad, codec))
+        requestKeyframe();
+    gst_object_unref(videodec);
+}
+
+void RtpWorker::videoDequeued(GstBuffer *buffer)
+{
+    GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+    if (!gst_rtp_buffer_map(buffer, GST_MAP_READ, &rtp))
+        return;
+    quint32 timestamp = gst_rtp_buffer_get_timestamp(&rtp);
+    bool    marker    = gst_rtp_buffer_get_marker(&rtp);
+    gst_rtp_buffer_unmap(&rtp);
+
+    latencyTracker->packetDequeued(timestamp, marker, GST_BUFFER_PTS(buffer));
+}
+
+// note: this may be called from any thread
+void RtpWorker::videoFeedbackReceived(const RtcpFeedback &feedback)
+{
+    if (stats) {
+        stats->videoSent.nacks += quint64(feedback.nacks.count());
+        if (feedback.keyframe)
+            ++stats->videoSent.plis;
+    }
+
+    QMutexLocker locker(&videoenc_mutex);
+
+    if (feedback.keyframe && videoencoder
+        && (!lastForcedKeyframe.isValid() || lastForcedKeyframe.elapsed() >= KEYFRAME_MIN_INTERVAL)) {
+#ifdef RTPWORKER_DEBUG
+        qDebug("forcing keyframe");
 #endif
+        lastForcedKeyframe.start();
+        gst_element_send_event(videoencoder,
+                               gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+    }
+
+    // rtprtxsend resends from its history on the same request events the
+    //   jitter buffer would send it in a full rtp session
+    if (rtxsend && !feedback.nacks.isEmpty()) {
+        GstPad *pad = gst_element_get_static_pad(rtxsend, "src");
+        for (quint16 seqnum : feedback.nacks) {
+            GstStructure *s = gst_structure_new("GstRTPRetransmissionRequest", "seqnum", G_TYPE_UINT, guint(seqnum),
+                                                "ssrc", G_TYPE_UINT, guint(feedback.mediaSsrc), nullptr);
+            gst_pad_send_event(pad, gst_event_new_custom(GST_EVENT_CUSTOM_UPSTREAM, s));
+        }
+        gst_object_unref(pad);
+    }
+}
+
+void RtpWorker::sendVideoRtcp(const QByteArray &packet)
+{
+    PRtpPacket rtcp;
+    rtcp.rawValue   = packet;
+    rtcp.portOffset = 1;
+    if (cb_rtpVideoOut)
+        cb_rtpVideoOut(rtcp, app);
+}
+
+void RtpWorker::setAudioPacketLoss(int percent, bool remote)
+{
+    QMutexLocker locker(&opusenc_mutex);
+
+    // once the remote reports, our own measurement is only a guess
+    if (remote)
+        remoteLossReported = true;
+    else if (remoteLossReported)
+        return;
+
+    if (percent == audioPacketLoss)
+        return;
+    audioPacketLoss = percent;
+
+    // the encoder only adds fec data when it expects loss
+    if (opusenc)
+        g_object_set(G_OBJECT(opusenc), "packet-loss-percentage", qBound(0, percent, 100), nullptr);
+}
+
+void RtpWorker::setVideoPacketLoss(int percent, bool remote)
+{
+    QMutexLocker locker(&videoenc_mutex);
+
+    if (remote)
+        videoRemoteLossReported = true;
+    else if (videoRemoteLossReported)
+        return;
 
-    QMutexLocker locker(&rtpvideoout_mutex);
-    if (cb_rtpVideoOut && rtpvideoout)
-        cb_rtpVideoOut(packet, app);
+    if (percent == videoPacketLoss)
+        return;
+    videoPacketLoss = percent;
 
-    return GST_FLOW_OK;
+    if (ulpfecenc && useFec)
+        g_object_set(G_OBJECT(ulpfecenc), "percentage", fec_percentage(percent), nullptr);
 }
 
-gboolean RtpWorker::fileReady()
+gboolean RtpWorker::updateLatency()
 {
-    if (loopFile) {
-        // gst_element_set_state(sendPipeline, GST_STATE_PAUSED);
-        // gst_element_get_state(sendPipeline, nullptr, nullptr, GST_CLOCK_TIME_NONE);
-
-        /*gst_element_seek(sendPipeline, 1, GST_FORMAT_TIME,
-            (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_SEGMENT),
-            GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_END, 0);*/
+    // the estimators are only replaced from this thread, so no locking
+    bool changed = false;
+    if (audioJitter && audiojitterbuffer) {
+        setAudioPacketLoss(audioJitter->lossPercent(), false);
+        if (audioScaler)
+            changed |= step_jitterbuffer_latency(audiojitterbuffer, audioScaler, audioJitter->updateTarget(),
+                                                 &audioLatency, &audioLatencyNext);
+        else
+            changed |= set_jitterbuffer_latency(audiojitterbuffer, audioJitter->updateTarget(), &audioLatency);
+    }
+    if (videoJitter && videojitterbuffer) {
+        setVideoPacketLoss(videoJitter->lossPercent(), false);
+        changed |= set_jitterbuffer_latency(videojitterbuffer, videoJitter->updateTarget(), &videoLatency);
     }
 
-    send_pipelineContext->activate();
-    gst_element_get_state(send_pipelineContext->element(), nullptr, nullptr, GST_CLOCK_TIME_NONE);
-    // gst_element_set_state(sendPipeline, GST_STATE_PLAYING);
-    // gst_element_get_state(sendPipeline, nullptr, nullptr, GST_CLOCK_TIME_NONE);
-
-    if (!getCaps()) {
-        error = RtpSessionContext::ErrorCodec;
-        if (cb_error)
-            cb_error(app);
-        return FALSE;
+    if (changed) {
+#ifdef RTPWORKER_DEBUG
+        qDebug("jitter buffer latency: audio=%d video=%d", audioLatency, videoLatency);
+#endif
+        gst_bin_recalculate_latency(GST_BIN(rpipeline));
+        if (cb_jitterBufferLatency)
+            cb_jitterBufferLatency(audioLatency, videoLatency, app);
     }
 
-    if (cb_started)
-        cb_started(app);
-    return FALSE;
+    return TRUE;
 }
 
 bool RtpWorker::setupSendRecv()
@@ -903,14 +2178,14 @@ bool RtpWorker::setupSendRecv()
     //   - the only control you have over quality is maxbitrate
     //   - input device/file indicates desire to send
     //   - remote payloadinfo indicates desire to receive (we need this
-    //     to support vp8)
+    //     to support vp8 and h264)
     //   - once sending or receiving is started, media types cannot
     //     be added or removed (doing so will throw an error)
     //   - once sending or receiving is started, codecs can't be changed
-    //     (changes will be rejected).  one exception: remote  vp8
-    //     config can be updated.
-    //   - once sending or receiving is started, devices can't be changed
-    //     (changes will be ignored)
+    //     (changes will be rejected).  one exception: remote video
+    //     codec config can be updated.
+    //   - once sending or receiving is started, devices can be switched
+    //     for others, but not added or removed (changes will be ignored)
 
     if (!sendbin) {
         if (!localAudioParams.isEmpty() || !localVideoParams.isEmpty()) {
@@ -925,6 +2200,10 @@ bool RtpWorker::setupSendRecv()
             error = RtpSessionContext::ErrorGeneric;
             return false;
         }*/
+
+        // inputs switched meanwhile.  files are played to the end.
+        switchInput(&pd_audiosrc, &audiosrc, ain, PDevice::AudioIn, audioInputOptions());
+        switchInput(&pd_videosrc, &videosrc, vin, PDevice::VideoIn, videoInputOptions());
     }
 
     if (!recvbin) {
@@ -936,10 +2215,16 @@ bool RtpWorker::setupSendRecv()
     } else {
         // TODO: support adding/removing audio/video to existing session
 
-        // see if vp8 was updated in the remote config
-        updateVp8Config();
+        // see if the video codec was updated in the remote config
+        updateVideoCodecConfig();
+
+        switchOutput();
     }
 
+    updateOpusConfig();
+    updateFecConfig();
+    updateRtxConfig();
+
     // apply actual settings back to these variables, so the user can
     //   read them
     localAudioPayloadInfo  = actual_localAudioPayloadInfo;
@@ -954,13 +2239,44 @@ bool RtpWorker::startSend() { return startSend(16000); }
 
 bool RtpWorker::startSend(int rate)
 {
-    // file source
-    if (!infile.isEmpty() || !indata.isEmpty()) {
-        if (send_in_use)
+    bool fromFile = !infile.isEmpty() || !indata.isEmpty();
+    if (!fromFile && ain.isEmpty() && vin.isEmpty())
+        return true;
+
+    // sending is reserved for us while prewarmed, and the devices running.
+    //   otherwise reserve it now, the send bin is built without the lock.
+    bool prewarmed;
+    {
+        QMutexLocker locker(&pipelines_mutex);
+        prewarmed = pd_audiowarm || pd_videowarm;
+        if (send_in_use && !prewarmed)
             return false;
+        send_in_use = true;
+    }
+
+    auto fail = [this, prewarmed]() {
+        QMutexLocker locker(&pipelines_mutex);
+        delete pd_audiosrc;
+        pd_audiosrc = nullptr;
+        audiosrc    = nullptr;
+        delete pd_videosrc;
+        pd_videosrc = nullptr;
+        videosrc    = nullptr;
+        if (sendbin) {
+            g_object_unref(G_OBJECT(sendbin));
+            sendbin = nullptr;
+        }
+        if (!prewarmed)
+            send_in_use = false;
+
+        error = RtpSessionContext::ErrorGeneric;
+        return false;
+    };
 
-        sendbin = gst_bin_new("sendbin");
+    sendbin = gst_bin_new("sendbin");
 
+    // file source
+    if (fromFile) {
         GstElement *fileSource = gst_element_factory_make("filesrc", nullptr);
         g_object_set(G_OBJECT(fileSource), "location", infile.toUtf8().data(), nullptr);
 
@@ -973,99 +2289,51 @@ bool RtpWorker::startSend(int rate)
         gst_bin_add(GST_BIN(sendbin), fileDemux);
         gst_element_link(fileSource, fileDemux);
     }
-    // device source
-    else if (!ain.isEmpty() || !vin.isEmpty()) {
-        if (send_in_use)
-            return false;
-
-        sendbin = gst_bin_new("sendbin");
-
+    // device source.  the devices are shared with other sessions.
+    else {
+        QMutexLocker locker(&pipelines_mutex);
         if (!ain.isEmpty() && !localAudioParams.isEmpty()) {
-            PipelineDeviceOptions options;
-            if (pd_audiosink != nullptr) {
-                options     = pd_audiosink->options();
-                options.aec = !options.echoProberName.isEmpty();
-            }
-
             pd_audiosrc = PipelineDeviceContext::create(send_pipelineContext, ain, PDevice::AudioIn,
-                                                        hardwareDeviceMonitor_, options);
+                                                        hardwareDeviceMonitor_, audioInputOptions());
             if (!pd_audiosrc) {
 #ifdef RTPWORKER_DEBUG
                 qDebug("Failed to create audio input element '%s'.", qPrintable(ain));
 #endif
-                g_object_unref(G_OBJECT(sendbin));
-                sendbin = nullptr;
-
-                error = RtpSessionContext::ErrorGeneric;
-                return false;
+                return fail();
             }
             audiosrc = pd_audiosrc->element();
         }
 
         if (!vin.isEmpty() && !localVideoParams.isEmpty()) {
-            PipelineDeviceOptions opts;
-            opts.videoSize = localVideoParams[0].size;
-            // opts.videoSize = QSize(640, 480);
-            opts.fps = 30;
-
             pd_videosrc = PipelineDeviceContext::create(send_pipelineContext, vin, PDevice::VideoIn,
-                                                        hardwareDeviceMonitor_, opts);
+                                                        hardwareDeviceMonitor_, videoInputOptions());
             if (!pd_videosrc) {
 #ifdef RTPWORKER_DEBUG
                 qDebug("Failed to create video input element '%s'.", qPrintable(vin));
 #endif
-                delete pd_audiosrc;
-                pd_audiosrc = nullptr;
-                g_object_unref(G_OBJECT(sendbin));
-                sendbin = nullptr;
-
-                error = RtpSessionContext::ErrorGeneric;
-                return false;
+                return fail();
             }
 
             videosrc = pd_videosrc->element();
-        }
-    }
-
-    // no desire to send
-    if (!sendbin)
-        return true;
-
-    send_in_use = true;
-
-    if (audiosrc) {
-        if (!addAudioChain(rate)) {
-            delete pd_audiosrc;
-            pd_audiosrc = nullptr;
-            delete pd_videosrc;
-            pd_videosrc = nullptr;
-            g_object_unref(G_OBJECT(sendbin));
-            sendbin = nullptr;
 
-            error = RtpSessionContext::ErrorGeneric;
-            return false;
+            // no need to decode and encode again what the camera encoded
+            videoPassthrough = pd_videosrc->isEncoded();
         }
     }
-    if (videosrc) {
-        if (!addVideoChain()) {
-            delete pd_audiosrc;
-            pd_audiosrc = nullptr;
-            delete pd_videosrc;
-            pd_videosrc = nullptr;
-            g_object_unref(G_OBJECT(sendbin));
-            sendbin = nullptr;
 
-            error = RtpSessionContext::ErrorGeneric;
-            return false;
-        }
-    }
+    if (audiosrc && !addAudioChain(rate))
+        return fail();
+    if (videosrc && !addVideoChain())
+        return fail();
 
+    QMutexLocker locker(&pipelines_mutex);
     gst_bin_add(GST_BIN(spipeline), sendbin);
 
     if (!audiosrc && !videosrc) {
-        // in the case of files, preroll
+        // in the case of files, preroll.  the demuxer finds its streams on
+        //   the way, see fileReady()
+        watchSendBus();
         gst_element_set_state(spipeline, GST_STATE_PAUSED);
-        gst_element_get_state(spipeline, nullptr, nullptr, GST_CLOCK_TIME_NONE);
         // gst_element_set_state(sendbin, GST_STATE_PAUSED);
         // gst_element_get_state(sendbin, nullptr, nullptr, GST_CLOCK_TIME_NONE);
 
@@ -1097,62 +2365,24 @@ bool RtpWorker::startSend(int rate)
         GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS(GST_BIN(spipeline), GST_DEBUG_GRAPH_SHOW_ALL, "psimedia_send_inactive");
 #endif
 
-        /*if(shared_clock && recv_clock_is_shared)
-        {
-            qDebug("send pipeline slaving to recv clock");
-            gst_pipeline_use_clock(GST_PIPELINE(spipeline), shared_clock);
-        }*/
-
         // gst_element_set_state(pipeline, GST_STATE_PLAYING);
         // gst_element_get_state(pipeline, nullptr, nullptr, GST_CLOCK_TIME_NONE);
         dumpPipeline();
+        watchSendBus();
         send_pipelineContext->activate();
 
-        // 10 seconds ought to be enough time to init (video devices probing may take considerable time)
-        int ret = gst_element_get_state(spipeline, nullptr, nullptr, 10 * GST_SECOND);
-        // gst_element_get_state(sendbin, nullptr, nullptr, GST_CLOCK_TIME_NONE);
-        if (ret != GST_STATE_CHANGE_SUCCESS && ret != GST_STATE_CHANGE_NO_PREROLL) {
-#ifdef RTPWORKER_DEBUG
-            qDebug("error/timeout while setting send pipeline to PLAYING");
-#endif
-            cleanup();
-            error = RtpSessionContext::ErrorGeneric;
-            return false;
-        }
-
-        if (!shared_clock && use_shared_clock) {
-            qDebug("send clock is master");
-
-            shared_clock = gst_pipeline_get_clock(GST_PIPELINE(spipeline));
-            gst_pipeline_use_clock(GST_PIPELINE(spipeline), shared_clock);
-            send_clock_is_shared = true;
-
-            // if recv active, apply this clock to it
-            if (recv_in_use) {
-                qDebug("recv pipeline slaving to send clock");
-                gst_element_set_state(rpipeline, GST_STATE_READY);
-                gst_element_get_state(rpipeline, nullptr, nullptr, GST_CLOCK_TIME_NONE);
-                gst_pipeline_use_clock(GST_PIPELINE(rpipeline), shared_clock);
-                gst_element_set_state(rpipeline, GST_STATE_PLAYING);
-            }
-        }
-
-#ifdef RTPWORKER_DEBUG
-        qDebug("state changed");
-
-        qDebug("Dumping send pipeline");
-        dump_pipeline(spipeline);
-        GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS(GST_BIN(spipeline), GST_DEBUG_GRAPH_SHOW_ALL, "psimedia_send_active");
-
-#endif
-
-        if (!getCaps()) {
-            error = RtpSessionContext::ErrorCodec;
-            return false;
+        // the pipeline is playing already, and the refs wait for the send
+        //   bin to be
+        if (prewarmed) {
+            gst_element_sync_state_with_parent(sendbin);
+            if (pd_audiosrc)
+                pd_audiosrc->activate();
+            if (pd_videosrc)
+                pd_videosrc->activate();
         }
 
-        actual_localAudioPayloadInfo = localAudioPayloadInfo;
-        actual_localVideoPayloadInfo = localVideoPayloadInfo;
+        // the rest is up to sendReady(), once the send bin plays
+        waitForSend();
     }
 
     return true;
@@ -1160,9 +2390,11 @@ bool RtpWorker::startSend(int rate)
 
 bool RtpWorker::startRecv()
 {
-    QString     acodec, vcodec;
-    GstElement *audioout = nullptr;
-    GstElement *asrc     = nullptr;
+    QString     acodec;
+    int         aclockrate = -1, vclockrate = -1;
+    GstElement *audioout   = nullptr;
+    GstElement *asrc       = nullptr;
+    GstElement *vsrc       = nullptr;
 
     // TODO: support more than opus
     int opus_at = -1;
@@ -1173,19 +2405,11 @@ bool RtpWorker::startRecv()
         }
     }
 
-    // TODO: support more than vp8
-    int vp8_at = -1;
-    for (int n = 0; n < remoteVideoPayloadInfo.count(); ++n) {
-        const PPayloadInfo &ri = remoteVideoPayloadInfo[n];
-        if (ri.name.toUpper() == "VP8" && ri.clockrate == 90000) {
-            vp8_at = n;
-            break;
-        }
-    }
+    int video_at = find_video_codec(remoteVideoPayloadInfo);
 
     // if remote does not support our codecs, error out
-    // FIXME: again, support more than opus/vp8
-    if ((!remoteAudioPayloadInfo.isEmpty() && opus_at == -1) || (!remoteVideoPayloadInfo.isEmpty() && vp8_at == -1)) {
+    // FIXME: again, support more than opus
+    if ((!remoteAudioPayloadInfo.isEmpty() && opus_at == -1) || (!remoteVideoPayloadInfo.isEmpty() && video_at == -1)) {
         return false;
     }
 
@@ -1204,11 +2428,9 @@ bool RtpWorker::startRecv()
             return false;
         }
 
-        if (recv_in_use)
-            return false;
-
+        // several sessions may receive at once, so leave naming to gstreamer
         if (!recvbin)
-            recvbin = gst_bin_new("recvbin");
+            recvbin = gst_bin_new(nullptr);
 
         audiortpsrc_mutex.lock();
         audiortpsrc = gst_element_factory_make("appsrc", nullptr);
@@ -1223,15 +2445,16 @@ bool RtpWorker::startRecv()
         //   it's okay, for now we only support opus which requires
         //   the name..
         // UPD 2016-04-16: it's not clear after migrating to opus
-        acodec = remoteAudioPayloadInfo[at].name.toLower();
+        acodec     = remoteAudioPayloadInfo[at].name.toLower();
+        aclockrate = remoteAudioPayloadInfo[at].clockrate;
     }
 
-    if (!remoteVideoPayloadInfo.isEmpty() && vp8_at != -1) {
+    if (!remoteVideoPayloadInfo.isEmpty() && video_at != -1) {
 #ifdef RTPWORKER_DEBUG
         qDebug("setting up video recv");
 #endif
 
-        int at = vp8_at;
+        int at = video_at;
 
         GstStructure *cs = payloadInfoToStructure(remoteVideoPayloadInfo[at], "video");
         if (!cs) {
@@ -1241,11 +2464,9 @@ bool RtpWorker::startRecv()
             goto fail1;
         }
 
-        if (recv_in_use)
-            return false;
-
+        // several sessions may receive at once, so leave naming to gstreamer
         if (!recvbin)
-            recvbin = gst_bin_new("recvbin");
+            recvbin = gst_bin_new(nullptr);
 
         videortpsrc_mutex.lock();
         videortpsrc = gst_element_factory_make("appsrc", nullptr);
@@ -1256,46 +2477,67 @@ bool RtpWorker::startRecv()
         g_object_set(G_OBJECT(videortpsrc), "caps", caps, nullptr);
         gst_caps_unref(caps);
 
-        // FIXME: what if we don't have a name and just id?
-        //   it's okay, for now we only really support vp8 which
-        //   requires the name..
-        vcodec = remoteVideoPayloadInfo[at].name;
-        if (vcodec == "H263-1998") // FIXME: gross
-            vcodec = "h263p";
-        else
-            vcodec = vcodec.toLower();
+        // the caps are of the first codec we have.  packets of the others
+        //   are told apart by the demuxer in the decoder bin.
+        vclockrate = remoteVideoPayloadInfo[at].clockrate;
     }
 
     // no desire to receive
     if (!recvbin)
         return true;
 
-    recv_in_use = true;
-
     if (audiortpsrc) {
         GstElement *audiodec = bins_audiodec_create(acodec);
         if (!audiodec)
             goto fail1;
 
+        audiojitterbuffer = gst_bin_get_by_name(GST_BIN(audiodec), "jitterbuffer");
+        if (audiojitterbuffer && aclockrate > 0 && bins_rtp_latency_is_adaptive()) {
+            QMutexLocker locker(&audiortpsrc_mutex);
+            audioJitter = new JitterEstimator(aclockrate, get_jitterbuffer_latency(audiojitterbuffer),
+                                              ADAPTIVE_LATENCY_MIN, ADAPTIVE_LATENCY_MAX);
+        }
+
+        if (stats) {
+            stats->audioReceived.setClockRate(aclockrate);
+            GstElement *decoder = gst_bin_get_by_name(GST_BIN(audiodec), "audio-decoder");
+            if (decoder) {
+                stats->audioReceived.watchCodec(decoder);
+                gst_object_unref(decoder);
+            }
+        }
+
+        // time scale the decoded audio, so latency changes don't glitch
+        if (audioJitter) {
+            GstPad *pad = gst_element_get_static_pad(audiodec, "src");
+            audioScaler = new TimeScaler;
+            gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, scale_audio_probe, audioScaler,
+                              scale_audio_probe_destroy);
+            gst_object_unref(pad);
+        }
+
         if (!aout.isEmpty()) {
 #ifdef RTPWORKER_DEBUG
             qDebug("creating audioout");
 #endif
 
+            // the output device is shared with other sessions
+            pipelines_mutex.lock();
             pd_audiosink
                 = PipelineDeviceContext::create(recv_pipelineContext, aout, PDevice::AudioOut, hardwareDeviceMonitor_);
+            if (pd_audiosink && pd_audiosrc) {
+                PipelineDeviceOptions opts = pd_audiosrc->options();
+                opts.aec                   = true;
+                opts.echoProberName        = pd_audiosink->options().echoProberName;
+                pd_audiosrc->setOptions(opts);
+            }
+            pipelines_mutex.unlock();
             if (!pd_audiosink) {
 #ifdef RTPWORKER_DEBUG
                 qDebug("failed to create audio output element");
 #endif
                 goto fail1;
             }
-            if (pd_audiosrc) {
-                PipelineDeviceOptions opts = pd_audiosrc->options();
-                opts.aec                   = true;
-                opts.echoProberName        = pd_audiosink->options().echoProberName;
-                pd_audiosrc->setOptions(opts);
-            }
 
             audioout = pd_audiosink->element();
         } else
@@ -1308,58 +2550,111 @@ bool RtpWorker::startRecv()
             g_object_set(G_OBJECT(volumeout), "volume", vol, nullptr);
         }
 
-        GstElement *audioconvert  = gst_element_factory_make("audioconvert", nullptr);
-        GstElement *audioresample = gst_element_factory_make("audioresample", nullptr);
-        if (pd_audiosink)
-            asrc = audioresample;
-
         gst_bin_add(GST_BIN(recvbin), audiortpsrc);
         gst_bin_add(GST_BIN(recvbin), audiodec);
         gst_bin_add(GST_BIN(recvbin), volumeout);
-        gst_bin_add(GST_BIN(recvbin), audioconvert);
-        gst_bin_add(GST_BIN(recvbin), audioresample);
-        if (!asrc)
+        gst_element_link_many(audiortpsrc, audiodec, volumeout, nullptr);
+
+        // the output device converts what it gets, and is mixed with
+        //   the streams of other sessions
+        if (pd_audiosink) {
+            asrc = volumeout;
+        } else {
+            GstElement *audioconvert  = gst_element_factory_make("audioconvert", nullptr);
+            GstElement *audioresample = gst_element_factory_make("audioresample", nullptr);
+            gst_bin_add(GST_BIN(recvbin), audioconvert);
+            gst_bin_add(GST_BIN(recvbin), audioresample);
             gst_bin_add(GST_BIN(recvbin), audioout);
-
-        gst_element_link_many(audiortpsrc, audiodec, volumeout, audioconvert, audioresample, nullptr);
-        if (!asrc)
-            gst_element_link(audioresample, audioout);
+            gst_element_link_many(volumeout, audioconvert, audioresample, audioout, nullptr);
+        }
 
         actual_remoteAudioPayloadInfo = remoteAudioPayloadInfo;
     }
 
     if (videortpsrc) {
-        GstElement *videodec = bins_videodec_create(vcodec);
+        GstElement *videodec = bins_videodec_create();
         if (!videodec)
             goto fail1;
 
-        GstElement *videoconvert = gst_element_factory_make("videoconvert", nullptr);
-        GstAppSink *appVideoSink = makeVideoPlayAppSink("netvideoplay");
+        // a branch for each payload type, as packets of it come in
+        {
+            QMutexLocker locker(&videortpsrc_mutex);
+            videoRecvPayloads = remoteVideoPayloadInfo;
+        }
+        videoptdemux = gst_bin_get_by_name(GST_BIN(videodec), "ptdemux");
+        g_signal_connect(G_OBJECT(videoptdemux), "request-pt-map", G_CALLBACK(cb_video_request_pt_map), this);
+        g_signal_connect(G_OBJECT(videoptdemux), "pad-added", G_CALLBACK(cb_video_payload_added), this);
+
+        videojitterbuffer = gst_bin_get_by_name(GST_BIN(videodec), "jitterbuffer");
+        {
+            QMutexLocker locker(&videortpsrc_mutex);
+            if (videojitterbuffer && vclockrate > 0 && bins_rtp_latency_is_adaptive())
+                videoJitter = new JitterEstimator(vclockrate, get_jitterbuffer_latency(videojitterbuffer),
+                                                  ADAPTIVE_LATENCY_MIN, ADAPTIVE_LATENCY_MAX);
+        }
+
+        updateVideoRecvRecovery(videodec);
+
+        {
+            GstPad *pad = gst_element_get_static_pad(videortpsrc, "src");
+            gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM, cb_video_upstream_event, this, nullptr);
+            gst_object_unref(pad);
+        }
+
+        // the decoders are timed as their branches are added
+        if (stats)
+            stats->videoReceived.setClockRate(vclockrate);
+
+        // see when frames leave the jitter buffer and the decoder
+        if (latencyTracker && videojitterbuffer) {
+            GstPad *pad = gst_element_get_static_pad(videojitterbuffer, "src");
+            gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, cb_video_dequeued, this, nullptr);
+            gst_object_unref(pad);
 
-        GstAppSinkCallbacks sinkVideoCb;
-        sinkVideoCb.new_sample  = cb_show_frame_output;
-        sinkVideoCb.eos         = cb_packet_ready_eos_stub;     // TODO
-        sinkVideoCb.new_preroll = cb_packet_ready_preroll_stub; // TODO
+            pad = gst_element_get_static_pad(videodec, "src");
+            gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, cb_video_decoded, this, nullptr);
+            gst_object_unref(pad);
+        }
+
+        gst_bin_add(GST_BIN(recvbin), videortpsrc);
+        gst_bin_add(GST_BIN(recvbin), videodec);
+        gst_element_link(videortpsrc, videodec);
+
+        // the compositor scales and converts in one go, once the bin is in
+        //   the pipeline
+        if (compositor) {
+            vsrc = videodec;
+        } else {
+            GstElement *videoconvert = gst_element_factory_make("videoconvert", nullptr);
+            GstAppSink *appVideoSink = makeVideoPlayAppSink("netvideoplay");
+
+            GstAppSinkCallbacks sinkVideoCb;
+            sinkVideoCb.new_sample  = cb_show_frame_output;
+            sinkVideoCb.eos         = cb_packet_ready_eos_stub;     // TODO
+            sinkVideoCb.new_preroll = cb_packet_ready_preroll_stub; // TODO
 #if GST_CHECK_VERSION(1, 22, 0)
-        sinkVideoCb.new_event = cb_packet_ready_event_stub; // TODO
+            sinkVideoCb.new_event = cb_packet_ready_event_stub; // TODO
 #endif
 #if GST_CHECK_VERSION(1, 24, 0)
-        sinkVideoCb.propose_allocation = cb_packet_ready_allocation_stub; // TODO
+            sinkVideoCb.propose_allocation = cb_packet_ready_allocation_stub; // TODO
 #endif
-        gst_app_sink_set_callbacks(appVideoSink, &sinkVideoCb, this, nullptr);
+            gst_app_sink_set_callbacks(appVideoSink, &sinkVideoCb, this, nullptr);
 
-        gst_bin_add(GST_BIN(recvbin), videortpsrc);
-        gst_bin_add(GST_BIN(recvbin), videodec);
-        gst_bin_add(GST_BIN(recvbin), videoconvert);
-        gst_bin_add(GST_BIN(recvbin), (GstElement *)appVideoSink);
+            gst_bin_add(GST_BIN(recvbin), videoconvert);
+            gst_bin_add(GST_BIN(recvbin), (GstElement *)appVideoSink);
 
-        gst_element_link_many(videortpsrc, videodec, videoconvert, (GstElement *)appVideoSink, nullptr);
+            gst_element_link_many(videodec, videoconvert, (GstElement *)appVideoSink, nullptr);
+        }
 
         actual_remoteVideoPayloadInfo = remoteVideoPayloadInfo;
     }
 
+    // the bin is built, from here on the pipeline is shared
+    pipelines_mutex.lock();
+
     // gst_element_set_locked_state(recvbin, TRUE);
     gst_bin_add(GST_BIN(rpipeline), recvbin);
+    ++recv_refs;
 
     if (asrc) {
         GstPad *pad = gst_element_get_static_pad(asrc, "src");
@@ -1370,9 +2665,22 @@ bool RtpWorker::startRecv()
         gst_element_link(recvbin, audioout);
     }
 
-    if (shared_clock && send_clock_is_shared) {
-        qDebug("recv pipeline slaving to send clock");
-        gst_pipeline_use_clock(GST_PIPELINE(rpipeline), shared_clock);
+    if (vsrc) {
+        GstPad *pad   = gst_element_get_static_pad(vsrc, "src");
+        GstPad *ghost = gst_ghost_pad_new("videosrc", pad);
+        gst_element_add_pad(recvbin, ghost);
+        gst_object_unref(GST_OBJECT(pad));
+
+        if (compositor->addStream(rpipeline, compositorTile, ghost)) {
+            linkedCompositor = compositor;
+            linkedTile       = compositorTile;
+        } else {
+            // the tile went away, or the compositor can't be used
+            gst_element_remove_pad(recvbin, ghost);
+            GstElement *fakesink = gst_element_factory_make("fakesink", nullptr);
+            gst_bin_add(GST_BIN(recvbin), fakesink);
+            gst_element_link(vsrc, fakesink);
+        }
     }
 
     // gst_element_set_locked_state(recvbin, FALSE);
@@ -1381,23 +2689,30 @@ bool RtpWorker::startRecv()
     qDebug("activating");
 #endif
 
-    gst_element_set_state(rpipeline, GST_STATE_READY);
-    gst_element_get_state(rpipeline, nullptr, nullptr, GST_CLOCK_TIME_NONE);
-
-    recv_pipelineContext->activate();
-
-    /*if(!shared_clock && use_shared_clock)
-    {
-        qDebug("recv clock is master");
-
-        shared_clock = gst_pipeline_get_clock(GST_PIPELINE(rpipeline));
-        gst_pipeline_use_clock(GST_PIPELINE(rpipeline), shared_clock);
-        recv_clock_is_shared = true;
-    }*/
+    if (recv_refs > 1) {
+        // the pipeline is already playing for other sessions
+        gst_element_sync_state_with_parent(recvbin);
+        gst_bin_recalculate_latency(GST_BIN(rpipeline));
+    } else {
+        gst_element_set_state(rpipeline, GST_STATE_READY);
+        recv_pipelineContext->activate();
+    }
+    pipelines_mutex.unlock();
 
 #ifdef RTPWORKER_DEBUG
     qDebug("receive pipeline started");
 #endif
+
+    audioLatency = get_jitterbuffer_latency(audiojitterbuffer);
+    videoLatency = get_jitterbuffer_latency(videojitterbuffer);
+    if (audioJitter || videoJitter) {
+        latencyTimer = g_timeout_source_new(ADAPTIVE_LATENCY_INTERVAL);
+        g_source_set_callback(latencyTimer, cb_updateLatency, this, nullptr);
+        g_source_attach(latencyTimer, mainContext_);
+    }
+    if (cb_jitterBufferLatency)
+        cb_jitterBufferLatency(audioLatency, videoLatency, app);
+
     return true;
 
 fail1:
@@ -1406,6 +2721,8 @@ fail1:
         g_object_unref(G_OBJECT(audiortpsrc));
         audiortpsrc = nullptr;
     }
+    delete audioJitter;
+    audioJitter = nullptr;
     audiortpsrc_mutex.unlock();
 
     videortpsrc_mutex.lock();
@@ -1413,17 +2730,36 @@ fail1:
         g_object_unref(G_OBJECT(videortpsrc));
         videortpsrc = nullptr;
     }
+    delete videoJitter;
+    videoJitter = nullptr;
     videortpsrc_mutex.unlock();
 
+    if (audiojitterbuffer) {
+        gst_object_unref(audiojitterbuffer);
+        audiojitterbuffer = nullptr;
+    }
+
+    if (videojitterbuffer) {
+        gst_object_unref(videojitterbuffer);
+        videojitterbuffer = nullptr;
+    }
+
+    if (videoptdemux) {
+        gst_object_unref(videoptdemux);
+        videoptdemux = nullptr;
+    }
+
+    audioScaler = nullptr;
+
     if (recvbin) {
         g_object_unref(G_OBJECT(recvbin));
         recvbin = nullptr;
     }
 
+    pipelines_mutex.lock();
     delete pd_audiosink;
     pd_audiosink = nullptr;
-
-    recv_in_use = false;
+    pipelines_mutex.unlock();
 
     return false;
 }
@@ -1460,6 +2796,17 @@ bool RtpWorker::addAudioChain(int rate)
     if (!audioenc)
         return false;
 
+    {
+        QMutexLocker locker(&opusenc_mutex);
+        opusenc = gst_bin_get_by_name(GST_BIN(audioenc), "opus-encoder");
+        if (opusenc && audioPacketLoss > 0)
+            g_object_set(G_OBJECT(opusenc), "packet-loss-percentage", audioPacketLoss, nullptr);
+    }
+
+    // other codecs are cheap enough not to bother
+    if (stats && opusenc)
+        stats->audioSent.watchCodec(opusenc);
+
     {
         QMutexLocker locker(&volumein_mutex);
         volumein   = gst_element_factory_make("volume", nullptr);
@@ -1498,6 +2845,11 @@ bool RtpWorker::addAudioChain(int rate)
 
     gst_element_link_many(volumein, audioenc, audiortpsink, nullptr);
 
+    {
+        QMutexLocker locker(&rtpaudioout_mutex);
+        audioHoldPad = gst_element_get_static_pad(volumein, "sink");
+    }
+
     audiortppay = audioenc;
 
     if (fileDemux) {
@@ -1521,24 +2873,32 @@ bool RtpWorker::addAudioChain(int rate)
 }
 #define VIDEO_PREP
 
+// the first codec of the remote we have too, or else the one preferred
+QString RtpWorker::sendVideoCodec() const
+{
+    int at = find_video_codec(remoteVideoPayloadInfo);
+    if (at != -1)
+        return remoteVideoPayloadInfo[at].name.toLower();
+    if (!localVideoParams.isEmpty() && bins_video_codec_available(localVideoParams[0].codec))
+        return localVideoParams[0].codec;
+    return "vp8";
+}
+
 bool RtpWorker::addVideoChain()
 {
-    // TODO: support other codecs.  for now, we only support vp8
-    QString codec = "vp8";
+    QString codec = sendVideoCodec();
     QSize   size  = QSize(640, 480);
     int     fps   = 30;
-    // QString codec = localVideoParams[0].codec;
     // QSize size = localVideoParams[0].size;
     // int fps = localVideoParams[0].fps;
 #ifdef RTPWORKER_DEBUG
-    qDebug("codec=%s", qPrintable(codec));
+    qDebug("codec=%s passthrough=%d", qPrintable(codec), int(videoPassthrough));
 #endif
 
     // see if we need to match a pt id
     int pt = -1;
-    for (int n = 0; n < remoteVideoPayloadInfo.count(); ++n) {
-        const PPayloadInfo &ri = remoteVideoPayloadInfo[n];
-        if (ri.name.toUpper() == "VP8" && ri.clockrate == 90000) {
+    for (const PPayloadInfo &ri : std::as_const(remoteVideoPayloadInfo)) {
+        if (ri.name.toLower() == codec && ri.clockrate == 90000) {
             pt = ri.id;
             break;
         }
@@ -1549,25 +2909,77 @@ bool RtpWorker::addVideoChain()
     if (audiortppay)
         videokbps -= 45;
 
+    // sending the camera's own h264, only the preview decodes, and only
+    //   while there is one to show
+    GstElement *videodecplay = nullptr;
+    if (videoPassthrough) {
+        videodecplay = bins_videodecoder_create(codec);
+        if (!videodecplay)
+            return false;
+    }
+
 #ifdef VIDEO_PREP
-    GstElement *videoprep = bins_videoprep_create(size, fps, fileDemux ? false : true);
-    if (!videoprep)
-        return false;
+    // the camera's h264 can't be scaled without decoding it, but it is of
+    //   the size asked for already
+    GstElement *videoprep = nullptr;
+    if (!videoPassthrough) {
+        videoprep = bins_videoprep_create(size, fps, fileDemux ? false : true);
+        if (!videoprep)
+            return false;
+    }
 #endif
-    GstElement *videoenc = bins_videoenc_create(codec, pt, videokbps);
+    GstElement *videoenc = bins_videoenc_create(codec, pt, videokbps, videoTemporalLayers, videoPassthrough);
     if (!videoenc) {
 #ifdef VIDEO_PREP
-        g_object_unref(G_OBJECT(videoprep));
+        if (videoprep)
+            g_object_unref(G_OBJECT(videoprep));
 #endif
+        if (videodecplay)
+            g_object_unref(G_OBJECT(videodecplay));
         return false;
     }
 
+    {
+        QMutexLocker locker(&videoenc_mutex);
+        if (videoPassthrough) {
+            // keyframe requests go up to the camera
+            videoencoder = gst_bin_get_by_name(GST_BIN(videoenc), "video-payloader");
+        } else {
+            videoencoder = gst_bin_get_by_name(GST_BIN(videoenc), "video-encoder");
+            if (stats && videoencoder)
+                stats->videoSent.watchCodec(videoencoder);
+        }
+        ulpfecenc = gst_bin_get_by_name(GST_BIN(videoenc), "ulpfecenc");
+        redenc    = gst_bin_get_by_name(GST_BIN(videoenc), "redenc");
+        rtxsend   = gst_bin_get_by_name(GST_BIN(videoenc), "rtxsend");
+
+        GstElement *payloader = gst_bin_get_by_name(GST_BIN(videoenc), "video-payloader");
+        guint       paypt     = 0;
+        g_object_get(G_OBJECT(payloader), "pt", &paypt, nullptr);
+        videoPt = codec == "vp8" ? int(paypt) : -1;
+
+        // capture times go in ahead of fec and retransmissions, so those
+        //   cover them too
+        GstPad *pad = gst_element_get_static_pad(payloader, "src");
+        gst_pad_add_probe(pad, GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                          cb_video_payloaded, this, nullptr);
+        gst_object_unref(pad);
+        gst_object_unref(payloader);
+    }
+
     GstElement *videotee = gst_element_factory_make("tee", nullptr);
 
     GstElement *playqueue        = gst_element_factory_make("queue", "queue_play");
     GstElement *videoconvertplay = gst_element_factory_make("videoconvert", nullptr);
     GstAppSink *appVideoSink     = makeVideoPlayAppSink("sourcevideoplay");
 
+    if (videodecplay) {
+        previewNeedsKeyframe = true;
+        GstPad *pad          = gst_element_get_static_pad(playqueue, "sink");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, cb_video_preview_gate, this, nullptr);
+        gst_object_unref(pad);
+    }
+
     GstAppSinkCallbacks sinkPreviewCb;
     sinkPreviewCb.new_sample  = cb_show_frame_preview;
     sinkPreviewCb.eos         = cb_packet_ready_eos_stub;     // TODO
@@ -1605,21 +3017,36 @@ bool RtpWorker::addVideoChain()
     if (queue)
         gst_bin_add(GST_BIN(sendbin), queue);
 #ifdef VIDEO_PREP
-    gst_bin_add(GST_BIN(sendbin), videoprep);
+    if (videoprep)
+        gst_bin_add(GST_BIN(sendbin), videoprep);
 #endif
     gst_bin_add(GST_BIN(sendbin), videotee);
     gst_bin_add(GST_BIN(sendbin), playqueue);
+    if (videodecplay)
+        gst_bin_add(GST_BIN(sendbin), videodecplay);
     gst_bin_add(GST_BIN(sendbin), videoconvertplay);
     gst_bin_add(GST_BIN(sendbin), reinterpret_cast<GstElement *>(appVideoSink));
     gst_bin_add(GST_BIN(sendbin), rtpqueue);
     gst_bin_add(GST_BIN(sendbin), videoenc);
     gst_bin_add(GST_BIN(sendbin), videortpsink);
 #ifdef VIDEO_PREP
-    gst_element_link(videoprep, videotee);
+    if (videoprep)
+        gst_element_link(videoprep, videotee);
 #endif
-    gst_element_link_many(videotee, playqueue, videoconvertplay, reinterpret_cast<GstElement *>(appVideoSink), nullptr);
+    if (videodecplay)
+        gst_element_link_many(videotee, playqueue, videodecplay, videoconvertplay,
+                              reinterpret_cast<GstElement *>(appVideoSink), nullptr);
+    else
+        gst_element_link_many(videotee, playqueue, videoconvertplay, reinterpret_cast<GstElement *>(appVideoSink),
+                              nullptr);
     gst_element_link_many(videotee, rtpqueue, videoenc, videortpsink, nullptr); // FIXME!
 
+    // the preview goes on while held
+    {
+        QMutexLocker locker(&rtpvideoout_mutex);
+        videoHoldPad = gst_element_get_static_pad(rtpqueue, "sink");
+    }
+
     videortppay = videoenc;
 
     if (fileDemux) {
@@ -1644,13 +3071,12 @@ bool RtpWorker::addVideoChain()
         gst_element_link(videosrc, queue);
     } else {
 #ifdef VIDEO_PREP
-        GstPad *pad = gst_element_get_static_pad(videoprep, "sink");
+        GstPad *pad = gst_element_get_static_pad(videoprep ? videoprep : videotee, "sink");
 #else
         GstPad *pad = gst_element_get_static_pad(videotee, "sink");
 #endif
-        gst_element_add_pad(
-            sendbin,
-            gst_ghost_pad_new_from_template("sink1", pad, gst_static_pad_template_get(&raw_video_sink_template)));
+        GstStaticPadTemplate *templ = videoPassthrough ? &h264_video_sink_template : &raw_video_sink_template;
+        gst_element_add_pad(sendbin, gst_ghost_pad_new_from_template("sink1", pad, gst_static_pad_template_get(templ)));
         gst_object_unref(GST_OBJECT(pad));
     }
 
@@ -1688,6 +3114,16 @@ bool RtpWorker::getCaps()
 
         gst_caps_unref(caps);
 
+        // our decoder can make use of both (rfc 7587).  also ask for long
+        //   packets if our link is constrained, the remote will likely
+        //   want to do the same to us.
+        if (pi.name.toUpper() == "OPUS") {
+            set_payload_parameter(&pi, "useinbandfec", "1");
+            set_payload_parameter(&pi, "usedtx", "1");
+            pi.ptime    = opus_frame_size(-1, -1, maxbitrate != -1 && maxbitrate <= OPUS_CONSTRAINED_BITRATE);
+            pi.maxptime = OPUS_MAX_PTIME;
+        }
+
         localAudioPayloadInfo << pi;
         canTransmitAudio = true;
     }
@@ -1722,54 +3158,199 @@ bool RtpWorker::getCaps()
         gst_caps_unref(caps);
 
         localVideoPayloadInfo << pi;
+
+        // we can receive fec (rfc 5109) wrapped in red (rfc 2198), and
+        //   retransmissions (rfc 4588) of both plain and red packets, if
+        //   gstreamer can.  reuse the remote's payload ids where it offered
+        //   these already.
+        QList<int> apts = { pi.id };
+        if (bins_fec_available()) {
+            PPayloadInfo red;
+            red.id        = choose_payload_id(find_payload(remoteVideoPayloadInfo, "red"), localVideoPayloadInfo);
+            red.name      = "red";
+            red.clockrate = pi.clockrate;
+            localVideoPayloadInfo << red;
+            apts << red.id;
+
+            PPayloadInfo ulpfec;
+            ulpfec.id        = choose_payload_id(find_payload(remoteVideoPayloadInfo, "ulpfec"), localVideoPayloadInfo);
+            ulpfec.name      = "ulpfec";
+            ulpfec.clockrate = pi.clockrate;
+            localVideoPayloadInfo << ulpfec;
+        }
+
+        if (bins_rtx_available()) {
+            for (int apt : std::as_const(apts)) {
+                PPayloadInfo rtx;
+                rtx.id        = choose_payload_id(find_rtx_payload(remoteVideoPayloadInfo, apt), localVideoPayloadInfo);
+                rtx.name      = "rtx";
+                rtx.clockrate = pi.clockrate;
+                set_payload_parameter(&rtx, "apt", QString::number(apt));
+                localVideoPayloadInfo << rtx;
+            }
+        }
         canTransmitVideo = true;
     }
 
     return true;
 }
 
-bool RtpWorker::updateVp8Config()
+bool RtpWorker::updateVideoCodecConfig()
 {
-    // first, are we using vp8 currently?
-    int vp8_at = -1;
-    for (int n = 0; n < actual_remoteVideoPayloadInfo.count(); ++n) {
-        const PPayloadInfo &ri = actual_remoteVideoPayloadInfo[n];
-        if (ri.name.toUpper() == "VP8" && ri.clockrate == 90000) {
-            vp8_at = n;
-            break;
-        }
-    }
-    if (vp8_at == -1)
+    if (!videoptdemux || find_video_codec(remoteVideoPayloadInfo) == -1)
         return false;
 
-    // if so, update the videortpsrc caps
-    for (int n = 0; n < remoteVideoPayloadInfo.count(); ++n) {
-        const PPayloadInfo &ri = remoteVideoPayloadInfo[n];
-        if (ri.name.toUpper() == "VP8" && ri.clockrate == 90000 && ri.id == actual_remoteVideoPayloadInfo[vp8_at].id) {
-            GstStructure *cs = payloadInfoToStructure(remoteVideoPayloadInfo[n], "video");
-            if (!cs) {
-#ifdef RTPWORKER_DEBUG
-                qDebug("cannot parse payload info");
-#endif
-                continue;
-            }
+    // the demuxer asks again for the payload types it has seen, and for
+    //   those added once they show up.  branches of codecs no longer
+    //   negotiated stay idle.
+    {
+        QMutexLocker locker(&videortpsrc_mutex);
+        videoRecvPayloads = remoteVideoPayloadInfo;
+    }
+    g_signal_emit_by_name(videoptdemux, "clear-pt-map");
 
-            QMutexLocker locker(&videortpsrc_mutex);
-            if (!videortpsrc)
-                continue;
+    auto videodec = GST_ELEMENT(gst_element_get_parent(videoptdemux));
+    updateVideoRecvRecovery(videodec);
+    gst_object_unref(videodec);
 
-            GstCaps *caps = gst_caps_new_empty();
+    actual_remoteVideoPayloadInfo = remoteVideoPayloadInfo;
+    return true;
+}
 
-            gst_caps_append_structure(caps, cs);
-            g_object_set(G_OBJECT(videortpsrc), "caps", caps, nullptr);
-            gst_caps_unref(caps);
+// sets a property of an element in the bin back to its default
+static void reset_property(GstElement *bin, const char *name, const char *property)
+{
+    GstElement *e = gst_bin_get_by_name(GST_BIN(bin), name);
+    if (!e)
+        return;
+    GParamSpec *spec = g_object_class_find_property(G_OBJECT_GET_CLASS(e), property);
+    if (spec)
+        g_object_set_property(G_OBJECT(e), property, g_param_spec_get_default_value(spec));
+    gst_object_unref(e);
+}
+
+// red, fec and retransmissions, whichever the remote sends
+void RtpWorker::updateVideoRecvRecovery(GstElement *videodec)
+{
+    // red wraps everything once fec is on, so retransmissions are of red
+    //   packets then
+    int redpt = find_payload(remoteVideoPayloadInfo, "red");
+    int fecpt = find_payload(remoteVideoPayloadInfo, "ulpfec");
+    if (redpt == -1 || fecpt == -1 || !bins_fec_available())
+        redpt = fecpt = -1;
 
-            actual_remoteVideoPayloadInfo[vp8_at] = ri;
-            return true;
+    {
+        QMutexLocker locker(&videortpsrc_mutex);
+        videoRecvRedPt = redpt;
+        videoRecvFecPt = fecpt;
+    }
+
+    if (fecpt != -1) {
+        GstElement *reddec    = gst_bin_get_by_name(GST_BIN(videodec), "reddec");
+        GstElement *ulpfecdec = gst_bin_get_by_name(GST_BIN(videodec), "ulpfecdec");
+        if (reddec) {
+            g_object_set(G_OBJECT(reddec), "pt", redpt, nullptr);
+            gst_object_unref(reddec);
+        }
+        if (ulpfecdec) {
+            g_object_set(G_OBJECT(ulpfecdec), "pt", guint(fecpt), nullptr);
+            gst_object_unref(ulpfecdec);
         }
+    } else {
+        // an update may have dropped them
+        reset_property(videodec, "reddec", "pt");
+        reset_property(videodec, "ulpfecdec", "pt");
     }
 
-    return false;
+    // retransmissions of each codec, or of red
+    GstStructure *map = gst_structure_new_empty("application/x-rtp-pt-map");
+    for (const PPayloadInfo &pi : std::as_const(remoteVideoPayloadInfo)) {
+        int apt = payload_parameter(pi, "apt").toInt();
+        if (pi.name.toLower() != "rtx" || (redpt != -1 && apt != redpt))
+            continue;
+        gst_structure_set(map, QByteArray::number(pi.id).constData(), G_TYPE_UINT, guint(apt), nullptr);
+    }
+
+    // an empty map clears the one of an earlier update.  only ask for
+    //   retransmissions if the remote can send them, and we can take them.
+    bool        retransmit = false;
+    GstElement *rtxreceive = gst_bin_get_by_name(GST_BIN(videodec), "rtxreceive");
+    if (rtxreceive) {
+        g_object_set(G_OBJECT(rtxreceive), "payload-type-map", map, nullptr);
+        retransmit = gst_structure_n_fields(map) > 0;
+        gst_object_unref(rtxreceive);
+    }
+    gst_structure_free(map);
+
+    if (videojitterbuffer)
+        g_object_set(G_OBJECT(videojitterbuffer), "do-retransmission", gboolean(retransmit), nullptr);
+}
+
+void RtpWorker::updateOpusConfig()
+{
+    // fec, dtx and packetization are the receiver's choice, so follow the
+    //   remote's fmtp
+    bool fec = false, dtx = false;
+    int  ptime = -1, maxptime = -1;
+    for (const PPayloadInfo &ri : std::as_const(remoteAudioPayloadInfo)) {
+        if (ri.name.toUpper() == "OPUS") {
+            fec      = payload_parameter(ri, "useinbandfec") == "1";
+            dtx      = payload_parameter(ri, "usedtx") == "1";
+            ptime    = ri.ptime;
+            maxptime = ri.maxptime;
+            break;
+        }
+    }
+
+    // rtpopuspay puts one opus packet into each rtp packet, so the frame
+    //   size is the packetization time.  beyond 20ms opusenc packs
+    //   several frames into a packet.
+    int frameSize = opus_frame_size(ptime, maxptime, maxbitrate != -1 && maxbitrate <= OPUS_CONSTRAINED_BITRATE);
+
+    QMutexLocker locker(&opusenc_mutex);
+    if (opusenc) {
+        g_object_set(G_OBJECT(opusenc), "inband-fec", gboolean(fec), "dtx", gboolean(dtx), nullptr);
+        gst_util_set_object_arg(G_OBJECT(opusenc), "frame-size", QByteArray::number(frameSize).constData());
+    }
+}
+
+void RtpWorker::updateFecConfig()
+{
+    // only protect the stream if the remote can take fec apart again
+    int redpt = find_payload(remoteVideoPayloadInfo, "red");
+    int fecpt = find_payload(remoteVideoPayloadInfo, "ulpfec");
+
+    QMutexLocker locker(&videoenc_mutex);
+    if (!ulpfecenc || !redenc)
+        return;
+
+    useFec     = redpt != -1 && fecpt != -1;
+    videoRedPt = useFec ? redpt : -1;
+    if (useFec) {
+        g_object_set(G_OBJECT(ulpfecenc), "pt", guint(fecpt), "percentage", fec_percentage(videoPacketLoss),
+                     nullptr);
+        g_object_set(G_OBJECT(redenc), "pt", redpt, "allow-no-red-blocks", TRUE, nullptr);
+    } else {
+        g_object_set(G_OBJECT(ulpfecenc), "percentage", 0u, nullptr);
+        g_object_set(G_OBJECT(redenc), "allow-no-red-blocks", FALSE, nullptr);
+    }
+}
+
+void RtpWorker::updateRtxConfig()
+{
+    // we send with the remote's payload ids, as in addVideoChain()
+    int at = find_video_codec(remoteVideoPayloadInfo);
+    int pt = at != -1 ? remoteVideoPayloadInfo[at].id : -1;
+
+    QMutexLocker locker(&videoenc_mutex);
+
+    // with fec, everything leaves the red encoder as red
+    if (useFec)
+        pt = find_payload(remoteVideoPayloadInfo, "red");
+
+    int rtxpt = pt != -1 ? find_rtx_payload(remoteVideoPayloadInfo, pt) : -1;
+    if (rtxsend && rtxpt != -1)
+        set_rtx_payload_map(rtxsend, pt, rtxpt);
 }
 
 RtpWorker::Frame RtpWorker::Frame::pullFromSink(GstAppSink *appsink)
@@ -1799,6 +3380,7 @@ RtpWorker::Frame RtpWorker::Frame::pullFromSink(GstAppSink *appsink)
         gst_buffer_extract(buffer, 0, image.bits(), image.byteCount());
 #endif
         frame.image = image;
+        frame.pts   = GST_BUFFER_PTS(buffer);
     } else {
         qDebug("wrong size of received buffer: %x != %lx", (width * height * 4), gst_buffer_get_size(buffer));
         gchar *capsstr;
@@ -21,28 +21,38 @@
 #ifndef RTPWORKER_H
 #define RTPWORKER_H
 
+#include "latencytracker.h"
 #include "psimediaprovider.h"
+#include "sessionstats.h"
 #include <QByteArray>
+#include <QElapsedTimer>
 #include <QImage>
 #include <QMutex>
 #include <QString>
+#include <atomic>
 #include <gst/app/gstappsink.h>
 #include <gst/gst.h>
+#include <memory>
 
 namespace PsiMedia {
 
+class PipelineCompositor;
 class PipelineDeviceContext;
+class PipelineDeviceOptions;
 class DeviceMonitor;
-class Stats;
+class JitterEstimator;
+class RtcpFeedback;
+class TimeScaler;
 
 // Note: do not destruct this class during one of its callbacks
 class RtpWorker {
 public:
-    // this class exists in case we want to add metadata to the image,
-    //   such as a timestamp
+    // the image, and where it is in the stream
     class Frame {
     public:
-        QImage image;
+        QImage       image;
+        GstClockTime pts = GST_CLOCK_TIME_NONE;
+        FrameTiming  timing; // output frames only
 
         static Frame pullFromSink(GstAppSink *appsink);
     };
@@ -61,7 +71,22 @@ public:
     QList<PPayloadInfo> localVideoPayloadInfo;
     QList<PPayloadInfo> remoteAudioPayloadInfo;
     QList<PPayloadInfo> remoteVideoPayloadInfo;
-    int                 maxbitrate = -1;
+    int                 maxbitrate          = -1;
+    int                 videoTemporalLayers = 1;
+
+    // if set, received video goes into this tile instead of cb_outputFrame
+    std::shared_ptr<PipelineCompositor> compositor;
+    int                                 compositorTile = -1;
+
+    // follows video through the stages of the pipelines, if set
+    std::shared_ptr<LatencyTracker> latencyTracker;
+
+    // counts what goes in and out, if set
+    std::shared_ptr<SessionStats> stats;
+
+    // abs-capture-time header extension id, 0 if not used.  read from the
+    //   streaming threads.
+    std::atomic<int> captureTimeExtensionId { 0 };
 
     // read-only
     bool canTransmitAudio = false;
@@ -84,6 +109,13 @@ public:
     void pauseVideo();
     void stop(); // can be called at any time after calling start
 
+    // opens the input devices set and starts capturing, ahead of start(),
+    //   which then takes them over running.  this reserves sending, so it
+    //   does nothing while another session sends.  cancelPrewarm() closes
+    //   them again, if start() didn't come.  call these in the worker thread.
+    void prewarm();
+    void cancelPrewarm();
+
     // the rtp input functions are safe to call from any thread
     void rtpAudioIn(const PRtpPacket &packet);
     void rtpVideoIn(const PRtpPacket &packet);
@@ -91,9 +123,19 @@ public:
     void setOutputVolume(int level);
     void setInputVolume(int level);
 
+    // ask the remote for a video keyframe (rtcp pli)
+    void requestKeyframe();
+
+    // whether preview frames are wanted.  sending the camera's own h264,
+    //   the preview is all there is to decode, so it only is while wanted.
+    void setPreviewEnabled(bool enabled);
+
     void recordStart();
     void recordStop();
-    void dumpPipeline(std::function<void(const QStringList &)> = {});
+
+    // with profile, the list starts with a report on the elements of both
+    //   pipelines, followed by their annotated graphs.  see PipelineProfiler.
+    void dumpPipeline(std::function<void(const QStringList &)> = {}, bool profile = false);
 
     // callbacks
 
@@ -105,6 +147,9 @@ public:
     void (*cb_audioOutputIntensity)(int value, void *app) = nullptr;
     void (*cb_audioInputIntensity)(int value, void *app)  = nullptr;
 
+    // jitter buffer latency in ms, -1 for media types not being received
+    void (*cb_jitterBufferLatency)(int audio, int video, void *app) = nullptr;
+
     // callbacks - from alternate thread, be safe!
     //   also, it is not safe to assign callbacks except before starting
 
@@ -124,6 +169,40 @@ private:
     PipelineDeviceContext *pd_audiosrc = nullptr, *pd_videosrc = nullptr, *pd_audiosink = nullptr;
     GstElement            *sendbin = nullptr, *recvbin = nullptr;
 
+    // prewarmed inputs run into fakesinks, until refs of the session on the
+    //   same devices are linked
+    PipelineDeviceContext *pd_audiowarm = nullptr, *pd_videowarm = nullptr;
+    GstElement            *audiowarmsink = nullptr, *videowarmsink = nullptr;
+
+    // the bus of the send pipeline, watched while we send.  starting, the
+    //   send bin is waited for until the timeout, and cb_sendReady called
+    //   once it plays.
+    GSource *sendWatch   = nullptr;
+    GSource *sendTimeout = nullptr;
+
+    void (*cb_sendReady)(void *app) = nullptr;
+
+    // a device ref replaced by another while sending or receiving.  the
+    //   link src -> sink is replaced by newsrc -> newsink from an idle probe
+    //   on pad, after which the old ref is released back in our thread.
+    //   a new input is held by its blocked src pad until then.
+    class DeviceSwitch {
+    public:
+        RtpWorker             *worker  = nullptr;
+        PipelineDeviceContext *old     = nullptr;
+        GstPad                *pad     = nullptr;
+        gulong                 probe   = 0;
+        GstPad                *src     = nullptr;
+        GstPad                *sink    = nullptr;
+        GstPad                *newsrc  = nullptr;
+        GstPad                *newsink = nullptr;
+        gulong                 block   = 0; // on newsrc
+        bool                   linked  = false;
+    };
+    QMutex                switches_mutex;
+    QList<DeviceSwitch *> switches;
+    GSource              *switchTimer = nullptr;
+
     GstElement *fileDemux   = nullptr;
     GstElement *audiosrc    = nullptr;
     GstElement *videosrc    = nullptr;
@@ -133,43 +212,118 @@ private:
     GstElement *videortppay = nullptr;
     GstElement *volumein    = nullptr;
     GstElement *volumeout   = nullptr;
+    GstElement *opusenc     = nullptr;
     bool        rtpaudioout = false;
     bool        rtpvideoout = false;
     QMutex      audiortpsrc_mutex;
     QMutex      videortpsrc_mutex;
     QMutex      volumein_mutex;
     QMutex      volumeout_mutex;
+    QMutex      opusenc_mutex;
     QMutex      rtpaudioout_mutex;
     QMutex      rtpvideoout_mutex;
 
+    // while not transmitting, buffers are dropped ahead of the encoders,
+    //   at the sink of the input volume and of the rtp queue.  capture goes
+    //   on, for the preview and other sessions.  protected by the mutexes
+    //   of rtpaudioout and rtpvideoout.
+    GstPad *audioHoldPad = nullptr;
+    GstPad *videoHoldPad = nullptr;
+    gulong  audioHold    = 0;
+    gulong  videoHold    = 0;
+
     // GSource *recordTimer;
 
+    // adaptive jitter buffer latency
+    GSource         *latencyTimer      = nullptr;
+    GstElement      *audiojitterbuffer = nullptr;
+    GstElement      *videojitterbuffer = nullptr;
+    JitterEstimator *audioJitter       = nullptr;
+    JitterEstimator *videoJitter       = nullptr;
+    TimeScaler      *audioScaler       = nullptr; // owned by the decoder pad probe
+    int              audioLatency      = -1;
+    int              audioLatencyNext  = -1; // applied once audioScaler is done
+    int              videoLatency      = -1;
+
+    // received video, one decoder branch per payload type behind the
+    //   demuxer.  videoRecvPayloads is protected by videortpsrc_mutex, the
+    //   demuxer asks for it from its streaming thread, and rtpVideoIn()
+    //   tells the media from red, fec and retransmissions by it.
+    GstElement         *videoptdemux = nullptr;
+    QList<PPayloadInfo> videoRecvPayloads;
+
+    // loss reported by the remote in rtcp receiver reports, or measured
+    //   locally as long as there are none.  protected by opusenc_mutex.
+    int  audioPacketLoss    = -1;
+    bool remoteLossReported = false;
+
+    // video loss recovery.  everything but the receive side is protected
+    //   by videoenc_mutex, videoRecvRedPt, videoRecvFecPt, videoRemoteSsrc
+    //   and lastRequestedKeyframe by videortpsrc_mutex.
+    GstElement   *videoencoder = nullptr;
+    GstElement   *ulpfecenc    = nullptr;
+    GstElement   *redenc       = nullptr;
+    GstElement   *rtxsend      = nullptr;
+    QMutex        videoenc_mutex;
+    QElapsedTimer lastForcedKeyframe;
+    QElapsedTimer lastRequestedKeyframe;
+    bool          useFec                  = false;
+    int           videoPt                 = -1; // vp8 as sent, for finding layer ids
+    int           videoRedPt              = -1; // while useFec
+    int           videoPacketLoss         = -1;
+    bool          videoRemoteLossReported = false;
+    int           videoRecvRedPt          = -1; // while receiving fec
+    int           videoRecvFecPt          = -1;
+    quint32       videoRemoteSsrc         = 0;
+    quint32       feedbackSsrc            = 0; // sender ssrc of our rtcp feedback
+
+    // the camera's own h264 is sent as is, without an encoder, keyframes
+    //   are asked of the camera then, through the payloader.  the preview
+    //   decodes from a keyframe on, while enabled.  videoPassthrough is set
+    //   before the send pipeline starts.
+    bool              videoPassthrough = false;
+    std::atomic<bool> previewEnabled { true };
+    std::atomic<bool> previewNeedsKeyframe { false };
+
+    // compositor and tile the received video is linked to
+    std::shared_ptr<PipelineCompositor> linkedCompositor;
+    int                                 linkedTile = -1;
+
     QList<PPayloadInfo> actual_localAudioPayloadInfo;
     QList<PPayloadInfo> actual_localVideoPayloadInfo;
     QList<PPayloadInfo> actual_remoteAudioPayloadInfo;
     QList<PPayloadInfo> actual_remoteVideoPayloadInfo;
 
-    Stats *audioStats = nullptr;
-    Stats *videoStats = nullptr;
-
     void cleanup();
 
-    static gboolean      cb_doStart(gpointer data);
-    static gboolean      cb_doUpdate(gpointer data);
-    static gboolean      cb_doStop(gpointer data);
-    static void          cb_fileDemux_no_more_pads(GstElement *element, gpointer data);
-    static void          cb_fileDemux_pad_added(GstElement *element, GstPad *pad, gpointer data);
-    static void          cb_fileDemux_pad_removed(GstElement *element, GstPad *pad, gpointer data);
-    static gboolean      cb_bus_call(GstBus *bus, GstMessage *msg, gpointer data);
-    static GstFlowReturn cb_show_frame_preview(GstAppSink *appsink, gpointer data);
-    static GstFlowReturn cb_show_frame_output(GstAppSink *appsink, gpointer data);
-    static GstFlowReturn cb_packet_ready_rtp_audio(GstAppSink *appsink, gpointer data);
-    static GstFlowReturn cb_packet_ready_rtp_video(GstAppSink *appsink, gpointer data);
-    static GstFlowReturn cb_packet_ready_preroll_stub(GstAppSink *appsink, gpointer data);
-    static void          cb_packet_ready_eos_stub(GstAppSink *appsink, gpointer data);
-    static gboolean      cb_packet_ready_event_stub(GstAppSink *appsink, gpointer data);
-    static gboolean      cb_packet_ready_allocation_stub(GstAppSink *appsink, GstQuery *query, gpointer user_data);
-    static gboolean      cb_fileReady(gpointer data);
+    static gboolean          cb_doStart(gpointer data);
+    static gboolean          cb_doUpdate(gpointer data);
+    static gboolean          cb_doStop(gpointer data);
+    static void              cb_fileDemux_no_more_pads(GstElement *element, gpointer data);
+    static void              cb_fileDemux_pad_added(GstElement *element, GstPad *pad, gpointer data);
+    static void              cb_fileDemux_pad_removed(GstElement *element, GstPad *pad, gpointer data);
+    static gboolean          cb_bus_call(GstBus *bus, GstMessage *msg, gpointer data);
+    static GstFlowReturn     cb_show_frame_preview(GstAppSink *appsink, gpointer data);
+    static GstFlowReturn     cb_show_frame_output(GstAppSink *appsink, gpointer data);
+    static GstFlowReturn     cb_packet_ready_rtp_audio(GstAppSink *appsink, gpointer data);
+    static GstFlowReturn     cb_packet_ready_rtp_video(GstAppSink *appsink, gpointer data);
+    static GstFlowReturn     cb_packet_ready_preroll_stub(GstAppSink *appsink, gpointer data);
+    static void              cb_packet_ready_eos_stub(GstAppSink *appsink, gpointer data);
+    static gboolean          cb_packet_ready_event_stub(GstAppSink *appsink, gpointer data);
+    static gboolean          cb_packet_ready_allocation_stub(GstAppSink *appsink, GstQuery *query, gpointer user_data);
+    static gboolean          cb_fileReady(gpointer data);
+    static gboolean          cb_updateLatency(gpointer data);
+    static gboolean          cb_sendStartTimeout(gpointer data);
+    static GstPadProbeReturn cb_video_upstream_event(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+    static GstPadProbeReturn cb_video_payloaded(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+    static GstPadProbeReturn cb_video_dequeued(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+    static GstPadProbeReturn cb_video_decoded(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+    static GstPadProbeReturn cb_video_preview_gate(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+    static GstPadProbeReturn cb_device_switch_idle(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+    static gboolean          cb_finishSwitches(gpointer data);
+    static GstCaps          *cb_video_request_pt_map(GstElement *element, guint pt, gpointer data);
+    static void              cb_video_payload_added(GstElement *element, GstPad *pad, gpointer data);
+    static GstPadProbeReturn cb_video_payload_caps(GstPad *pad, GstPadProbeInfo *info, gpointer data);
 
     gboolean      doStart();
     gboolean      doUpdate();
@@ -183,7 +337,23 @@ private:
     GstFlowReturn packet_ready_rtp_audio(GstAppSink *appsink);
     GstFlowReturn packet_ready_rtp_video(GstAppSink *appsink);
     gboolean      fileReady();
-
+    gboolean      updateLatency();
+    gboolean      sendStartTimeout();
+    void          videoUpstreamEvent(GstEvent *event);
+    void          videoPayloaded(GstPad *pad, GstPadProbeInfo *info);
+    void          videoDequeued(GstBuffer *buffer);
+    GstCaps      *videoRequestPtMap(guint pt);
+    void          videoPayloadAdded(GstElement *demux, GstPad *pad);
+    void          videoPayloadCaps(GstPad *pad, GstCaps *caps);
+    bool          addVideoBranch(GstBin *videodec, GstPad *pad, const QString &codec);
+    bool          videoPreviewWanted(GstBuffer *buffer);
+    void          videoFeedbackReceived(const RtcpFeedback &feedback);
+    void          sendVideoRtcp(const QByteArray &packet);
+
+    void        holdAudio(bool hold);
+    void        holdVideo(bool hold);
+    void        setAudioPacketLoss(int percent, bool remote);
+    void        setVideoPacketLoss(int percent, bool remote);
     bool        setupSendRecv();
     bool        startSend();
     bool        startSend(int rate);
@@ -191,9 +361,36 @@ private:
     bool        addAudioChain();
     bool        addAudioChain(int rate);
     bool        addVideoChain();
+    QString     sendVideoCodec() const;
     bool        getCaps();
-    bool        updateVp8Config();
+    bool        updateVideoCodecConfig();
+    void        updateVideoRecvRecovery(GstElement *videodec);
+    void        updateOpusConfig();
+    void        updateFecConfig();
+    void        updateRtxConfig();
     GstAppSink *makeVideoPlayAppSink(const gchar *name);
+
+    PipelineDeviceOptions  audioInputOptions() const;
+    PipelineDeviceOptions  videoInputOptions() const;
+    PipelineDeviceContext *warmDevice(const QString &id, PDevice::Type type, const PipelineDeviceOptions &opts,
+                                      GstElement **sink);
+    void                   releaseWarmDevices();
+
+    void              switchInput(PipelineDeviceContext **pd, GstElement **element, const QString &id,
+                                  PDevice::Type type, const PipelineDeviceOptions &opts);
+    void              switchOutput();
+    void              beginSwitch(DeviceSwitch *sw);
+    GstPadProbeReturn deviceSwitchIdle(DeviceSwitch *sw);
+    gboolean          finishSwitches();
+    void              endSwitch(DeviceSwitch *sw);
+    void              cancelSwitches();
+
+    void watchSendBus();
+    void unwatchSendBus();
+    void waitForSend();
+    void cancelSendWait();
+    void sendReady();
+    void sendStartFailed();
 };
 
 }
@@ -85,6 +85,23 @@ static RwControlAudioIntensityMessage *getLatestAudioIntensityAndRemoveOthers(QL
     return amsg;
 }
 
+static RwControlJitterBufferLatencyMessage *getLatestJitterBufferLatencyAndRemoveOthers(QList<RwControlMessage *> *list)
+{
+    RwControlJitterBufferLatencyMessage *lmsg = nullptr;
+    for (int n = 0; n < list->count(); ++n) {
+        RwControlMessage *msg = list->at(n);
+        if (msg->type == RwControlMessage::JitterBufferLatency) {
+            // if we already had a msg, discard it and take the next
+            delete lmsg;
+
+            lmsg = static_cast<RwControlJitterBufferLatencyMessage *>(msg);
+            list->removeAt(n);
+            --n; // adjust position
+        }
+    }
+    return lmsg;
+}
+
 static void simplifyQueue(QList<RwControlMessage *> *list)
 {
     // is there a stop message?
@@ -123,8 +140,16 @@ static void applyDevicesToWorker(RtpWorker *worker, const RwControlConfigDevices
     worker->infile   = devices.fileNameIn;
     worker->indata   = devices.fileDataIn;
     worker->loopFile = devices.loopFile;
+
+    worker->compositor     = devices.compositor;
+    worker->compositorTile = devices.compositorTile;
+    if (worker->latencyTracker != devices.latencyTracker) // read by the streaming threads
+        worker->latencyTracker = devices.latencyTracker;
+    if (worker->stats != devices.stats)
+        worker->stats = devices.stats;
     worker->setOutputVolume(devices.audioOutVolume);
     worker->setInputVolume(devices.audioInVolume);
+    worker->setPreviewEnabled(devices.useVideoPreview);
 }
 
 static void applyCodecsToWorker(RtpWorker *worker, const RwControlConfigCodecs &codecs)
@@ -138,7 +163,9 @@ static void applyCodecsToWorker(RtpWorker *worker, const RwControlConfigCodecs &
     if (codecs.useRemoteVideoPayloadInfo)
         worker->remoteVideoPayloadInfo = codecs.remoteVideoPayloadInfo;
 
-    worker->maxbitrate = codecs.maximumSendingBitrate;
+    worker->maxbitrate             = codecs.maximumSendingBitrate;
+    worker->videoTemporalLayers    = codecs.videoTemporalLayers;
+    worker->captureTimeExtensionId = codecs.captureTimeExtensionId;
 }
 
 //----------------------------------------------------------------------------
@@ -147,11 +174,13 @@ static void applyCodecsToWorker(RtpWorker *worker, const RwControlConfigCodecs &
 RwControlLocal::RwControlLocal(GstMainLoop *thread, DeviceMonitor *hardwareDeviceMonitor, QObject *parent) :
     QObject(parent), thread_(thread), hardwareDeviceMonitor_(hardwareDeviceMonitor)
 {
+    context_ = thread_->acquireContext();
+
     // create RwControlRemote, block until ready
     QMutexLocker locker(&m);
     timer = g_timeout_source_new(0);
     g_source_set_callback(timer, cb_doCreateRemote, this, nullptr);
-    g_source_attach(timer, thread_->mainContext());
+    g_source_attach(timer, context_);
     w.wait(&m);
 }
 
@@ -161,9 +190,10 @@ RwControlLocal::~RwControlLocal()
     QMutexLocker locker(&m);
     timer = g_timeout_source_new(0);
     g_source_set_callback(timer, cb_doDestroyRemote, this, nullptr);
-    g_source_attach(timer, thread_->mainContext());
+    g_source_attach(timer, context_);
     g_source_unref(timer);
     w.wait(&m);
+    thread_->releaseContext(context_);
 
     qDeleteAll(in);
 }
@@ -176,16 +206,31 @@ void RwControlLocal::start(const RwControlConfigDevices &devices, const RwContro
     remote_->postMessage(msg);
 }
 
+void RwControlLocal::prewarm(const RwControlConfigDevices &devices, const RwControlConfigCodecs &codecs)
+{
+    auto msg     = new RwControlPrewarmMessage;
+    msg->devices = devices;
+    msg->codecs  = codecs;
+    remote_->postMessage(msg);
+}
+
 void RwControlLocal::stop()
 {
     auto msg = new RwControlStopMessage;
     remote_->postMessage(msg);
 }
 
-void RwControlLocal::dumpPipeline(std::function<void(const QStringList &)> callback)
+void RwControlLocal::requestKeyframe()
+{
+    auto msg = new RwControlRequestKeyframeMessage;
+    remote_->postMessage(msg);
+}
+
+void RwControlLocal::dumpPipeline(std::function<void(const QStringList &)> callback, bool profile)
 {
     auto msg      = new RwControlDumpPipelineMessage;
     msg->callback = callback;
+    msg->profile  = profile;
     remote_->postMessage(msg);
 }
 
@@ -232,7 +277,7 @@ gboolean RwControlLocal::doCreateRemote()
 {
     QMutexLocker locker(&m);
     timer   = nullptr;
-    remote_ = new RwControlRemote(thread_->mainContext(), hardwareDeviceMonitor_, this);
+    remote_ = new RwControlRemote(context_, hardwareDeviceMonitor_, this);
     w.wakeOne();
     return FALSE;
 }
@@ -278,11 +323,18 @@ void RwControlLocal::processMessages()
     }
 
     // we only care about the latest output frame
+    if (stats) {
+        int firstPos;
+        int count = queuedFrameInfo(list, RwControlFrame::Output, &firstPos);
+        if (count > 1)
+            stats->videoReceived.dropped += quint64(count - 1);
+    }
     fmsg = getLatestFrameAndRemoveOthers(&list, RwControlFrame::Output);
     if (fmsg) {
-        QImage i = fmsg->frame.image;
+        QImage      i = fmsg->frame.image;
+        FrameTiming t = fmsg->frame.timing;
         delete fmsg;
-        emit outputFrame(i);
+        emit outputFrame(i, t);
         if (!self) {
             qDeleteAll(list);
             return;
@@ -314,6 +366,18 @@ void RwControlLocal::processMessages()
         }
     }
 
+    // we only care about the latest jitter buffer latency
+    RwControlJitterBufferLatencyMessage *lmsg = getLatestJitterBufferLatencyAndRemoveOthers(&list);
+    if (lmsg) {
+        RwControlJitterBufferLatency l = lmsg->latency;
+        delete lmsg;
+        emit jitterBufferLatencyChanged(l.audio, l.video);
+        if (!self) {
+            qDeleteAll(list);
+            return;
+        }
+    }
+
     // process the remaining messages
     while (!list.isEmpty()) {
         RwControlMessage *msg = list.takeFirst();
@@ -341,8 +405,11 @@ void RwControlLocal::postMessage(RwControlMessage *msg)
     if (msg->type == RwControlMessage::Frame) {
         auto fmsg     = static_cast<RwControlFrameMessage *>(msg);
         int  firstPos = -1;
-        if (queuedFrameInfo(in, fmsg->frame.type, &firstPos) >= QUEUE_FRAME_MAX)
+        if (queuedFrameInfo(in, fmsg->frame.type, &firstPos) >= QUEUE_FRAME_MAX) {
+            if (stats && fmsg->frame.type == RwControlFrame::Output)
+                ++stats->videoReceived.dropped;
             in.removeAt(firstPos);
+        }
     }
 
     in += msg;
@@ -370,6 +437,7 @@ RwControlRemote::RwControlRemote(GMainContext *mainContext, DeviceMonitor *hardw
     worker->cb_error                = cb_worker_error;
     worker->cb_audioOutputIntensity = cb_worker_audioOutputIntensity;
     worker->cb_audioInputIntensity  = cb_worker_audioInputIntensity;
+    worker->cb_jitterBufferLatency  = cb_worker_jitterBufferLatency;
     worker->cb_previewFrame         = cb_worker_previewFrame;
     worker->cb_outputFrame          = cb_worker_outputFrame;
     worker->cb_rtpAudioOut          = cb_worker_rtpAudioOut;
@@ -409,6 +477,11 @@ void RwControlRemote::cb_worker_audioInputIntensity(int value, void *app)
     static_cast<RwControlRemote *>(app)->worker_audioInputIntensity(value);
 }
 
+void RwControlRemote::cb_worker_jitterBufferLatency(int audio, int video, void *app)
+{
+    static_cast<RwControlRemote *>(app)->worker_jitterBufferLatency(audio, video);
+}
+
 void RwControlRemote::cb_worker_previewFrame(const RtpWorker::Frame &frame, void *app)
 {
     static_cast<RwControlRemote *>(app)->worker_previewFrame(frame);
@@ -485,6 +558,14 @@ bool RwControlRemote::processMessage(RwControlMessage *msg)
         pending_status  = true;
         worker->start();
         return false;
+    } else if (msg->type == RwControlMessage::Prewarm) {
+        auto pmsg = static_cast<RwControlPrewarmMessage *>(msg);
+
+        // start() applies the config again, as it may have changed since
+        applyDevicesToWorker(worker, pmsg->devices);
+        applyCodecsToWorker(worker, pmsg->codecs);
+
+        worker->prewarm();
     } else if (msg->type == RwControlMessage::Stop) {
         auto smsg = static_cast<RwControlStopMessage *>(msg);
         Q_UNUSED(smsg);
@@ -495,7 +576,9 @@ bool RwControlRemote::processMessage(RwControlMessage *msg)
         } else {
             // this can happen if we stop before we even start.
             //   just send back a stopped status and don't muck
-            //   with the worker.
+            //   with the worker, other than closing prewarmed devices.
+            worker->cancelPrewarm();
+
             auto msg            = new RwControlStatusMessage;
             msg->status.stopped = true;
             local_->postMessage(msg);
@@ -505,8 +588,16 @@ bool RwControlRemote::processMessage(RwControlMessage *msg)
     } else if (msg->type == RwControlMessage::UpdateDevices) {
         auto umsg = static_cast<RwControlUpdateDevicesMessage *>(msg);
 
+        // volumes and the preview are applied right away, only devices
+        //   switched need the worker to act on them
+        bool switched = umsg->devices.audioOutId != worker->aout || umsg->devices.audioInId != worker->ain
+            || umsg->devices.videoInId != worker->vin || umsg->devices.fileNameIn != worker->infile;
         applyDevicesToWorker(worker, umsg->devices);
 
+        // prewarmed only, start() takes it from here
+        if (!start_requested || !switched)
+            return true;
+
         worker->update();
         return false;
     } else if (msg->type == RwControlMessage::UpdateCodecs) {
@@ -538,7 +629,9 @@ bool RwControlRemote::processMessage(RwControlMessage *msg)
             worker->recordStop();
     } else if (msg->type == RwControlMessage::DumpPileline) {
         auto rmsg = static_cast<RwControlDumpPipelineMessage *>(msg);
-        worker->dumpPipeline(rmsg->callback);
+        worker->dumpPipeline(rmsg->callback, rmsg->profile);
+    } else if (msg->type == RwControlMessage::RequestKeyframe) {
+        worker->requestKeyframe();
     }
 
     return true;
@@ -603,6 +696,14 @@ void RwControlRemote::worker_audioInputIntensity(int value)
     local_->postMessage(msg);
 }
 
+void RwControlRemote::worker_jitterBufferLatency(int audio, int video)
+{
+    auto msg           = new RwControlJitterBufferLatencyMessage;
+    msg->latency.audio = audio;
+    msg->latency.video = video;
+    local_->postMessage(msg);
+}
+
 void RwControlRemote::worker_previewFrame(const RtpWorker::Frame &frame)
 {
     auto msg         = new RwControlFrameMessage;
@@ -613,9 +714,10 @@ void RwControlRemote::worker_previewFrame(const RtpWorker::Frame &frame)
 
 void RwControlRemote::worker_outputFrame(const RtpWorker::Frame &frame)
 {
-    auto msg         = new RwControlFrameMessage;
-    msg->frame.type  = RwControlFrame::Output;
-    msg->frame.image = frame.image;
+    auto msg          = new RwControlFrameMessage;
+    msg->frame.type   = RwControlFrame::Output;
+    msg->frame.image  = frame.image;
+    msg->frame.timing = frame.timing;
     local_->postMessage(msg);
 }
 
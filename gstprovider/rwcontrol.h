@@ -42,7 +42,9 @@ namespace PsiMedia {
 //
 // When RwControlLocal is created, you pass it the GstMainLoop.  The constructor
 // atomically creates a corresponding RwControlRemote in the remote thread and
-// associates the two objects.
+// associates the two objects.  The remote runs in whichever of the loop's
+// control contexts the local got, so that sessions don't queue up behind
+// each other.
 //
 // The possible exchanges are made clear here.  Things you can do:
 //
@@ -63,6 +65,8 @@ namespace PsiMedia {
 //
 // - Transmit/pause the audio/video streams.  This is fire and forget.
 //
+// - Ask the remote for a video keyframe.  This is fire and forget.
+//
 // - Start/stop recording a session.  For starting, this is somewhat fire
 //   and forget.  You'll eventually start receiving data packets, but the
 //   assumption is that recording is occurring even before the first packet
@@ -96,6 +100,16 @@ public:
     int        audioOutVolume;
     int        audioInVolume;
 
+    // video output into a tile, instead of the output widget
+    std::shared_ptr<PipelineCompositor> compositor;
+    int                                 compositorTile = -1;
+
+    // shared with the session, which reads it and reports painted frames
+    std::shared_ptr<LatencyTracker> latencyTracker;
+
+    // counters, likewise shared with the session
+    std::shared_ptr<SessionStats> stats;
+
     RwControlConfigDevices() :
         loopFile(false), useVideoPreview(false), useVideoOut(false), audioOutVolume(-1), audioInVolume(-1)
     {
@@ -115,10 +129,12 @@ public:
     QList<PPayloadInfo> remoteVideoPayloadInfo;
 
     int maximumSendingBitrate;
+    int videoTemporalLayers;
+    int captureTimeExtensionId;
 
     RwControlConfigCodecs() :
         useLocalAudioParams(false), useLocalVideoParams(false), useRemoteAudioPayloadInfo(false),
-        useRemoteVideoPayloadInfo(false), maximumSendingBitrate(-1)
+        useRemoteVideoPayloadInfo(false), maximumSendingBitrate(-1), videoTemporalLayers(1), captureTimeExtensionId(0)
     {
     }
 };
@@ -172,13 +188,20 @@ public:
     RwControlAudioIntensity() : type((Type)-1), value(-1) { }
 };
 
+class RwControlJitterBufferLatency {
+public:
+    int audio = -1;
+    int video = -1;
+};
+
 // always remote -> local, for internal use
 class RwControlFrame {
 public:
     enum Type { Preview, Output };
 
-    Type   type;
-    QImage image;
+    Type        type;
+    QImage      image;
+    FrameTiming timing;
 };
 
 // internal
@@ -186,6 +209,7 @@ class RwControlMessage {
 public:
     enum Type {
         Start,
+        Prewarm,
         Stop,
         UpdateDevices,
         UpdateCodecs,
@@ -193,8 +217,10 @@ public:
         Record,
         Status,
         AudioIntensity,
+        JitterBufferLatency,
         Frame,
-        DumpPileline
+        DumpPileline,
+        RequestKeyframe
     };
 
     Type type;
@@ -212,6 +238,14 @@ public:
     RwControlStartMessage() : RwControlMessage(RwControlMessage::Start) { }
 };
 
+class RwControlPrewarmMessage : public RwControlMessage {
+public:
+    RwControlConfigDevices devices;
+    RwControlConfigCodecs  codecs;
+
+    RwControlPrewarmMessage() : RwControlMessage(RwControlMessage::Prewarm) { }
+};
+
 class RwControlStopMessage : public RwControlMessage {
 public:
     RwControlStopMessage() : RwControlMessage(RwControlMessage::Stop) { }
@@ -222,6 +256,12 @@ public:
     RwControlDumpPipelineMessage() : RwControlMessage(RwControlMessage::DumpPileline) { }
 
     std::function<void(const QStringList &)> callback;
+    bool                                     profile = false;
+};
+
+class RwControlRequestKeyframeMessage : public RwControlMessage {
+public:
+    RwControlRequestKeyframeMessage() : RwControlMessage(RwControlMessage::RequestKeyframe) { }
 };
 
 class RwControlUpdateDevicesMessage : public RwControlMessage {
@@ -266,6 +306,13 @@ public:
     RwControlAudioIntensityMessage() : RwControlMessage(RwControlMessage::AudioIntensity) { }
 };
 
+class RwControlJitterBufferLatencyMessage : public RwControlMessage {
+public:
+    RwControlJitterBufferLatency latency;
+
+    RwControlJitterBufferLatencyMessage() : RwControlMessage(RwControlMessage::JitterBufferLatency) { }
+};
+
 class RwControlFrameMessage : public RwControlMessage {
 public:
     RwControlFrame frame;
@@ -281,11 +328,13 @@ public:
     ~RwControlLocal() override;
 
     void start(const RwControlConfigDevices &devices, const RwControlConfigCodecs &codecs);
+    void prewarm(const RwControlConfigDevices &devices, const RwControlConfigCodecs &codecs); // before start
     void stop(); // if called, may still receive many status messages before stopped
     void updateDevices(const RwControlConfigDevices &devices);
     void updateCodecs(const RwControlConfigCodecs &codecs);
     void setTransmit(const RwControlTransmit &transmit);
     void setRecord(const RwControlRecord &record);
+    void requestKeyframe();
 
     // can be called from any thread
     void rtpAudioIn(const PRtpPacket &packet);
@@ -300,21 +349,27 @@ public:
     void (*cb_rtpVideoOut)(const PRtpPacket &packet, void *app) = nullptr;
     void (*cb_recordData)(const QByteArray &packet, void *app)  = nullptr;
 
-    void dumpPipeline(std::function<void(const QStringList &)> callback);
+    // output frames that never make it to the widget are counted here.
+    //   likewise only safe to assign prior to starting.
+    SessionStats *stats = nullptr;
+
+    void dumpPipeline(std::function<void(const QStringList &)> callback, bool profile = false);
 signals:
     // response to start, stop, updateCodecs, or it could be spontaneous
     void statusReady(const RwControlStatus &status);
 
     void previewFrame(const QImage &img);
-    void outputFrame(const QImage &img);
+    void outputFrame(const QImage &img, const FrameTiming &timing);
     void audioOutputIntensityChanged(int intensity);
     void audioInputIntensityChanged(int intensity);
+    void jitterBufferLatencyChanged(int audio, int video);
 
 private slots:
     void processMessages();
 
 private:
     GstMainLoop     *thread_                = nullptr;
+    GMainContext    *context_               = nullptr;
     DeviceMonitor   *hardwareDeviceMonitor_ = nullptr;
     GSource         *timer                  = nullptr;
     QMutex           m;
@@ -363,6 +418,7 @@ private:
     static void     cb_worker_error(void *app);
     static void     cb_worker_audioOutputIntensity(int value, void *app);
     static void     cb_worker_audioInputIntensity(int value, void *app);
+    static void     cb_worker_jitterBufferLatency(int audio, int video, void *app);
     static void     cb_worker_previewFrame(const RtpWorker::Frame &frame, void *app);
     static void     cb_worker_outputFrame(const RtpWorker::Frame &frame, void *app);
     static void     cb_worker_rtpAudioOut(const PRtpPacket &packet, void *app);
@@ -377,6 +433,7 @@ private:
     void     worker_error();
     void     worker_audioOutputIntensity(int value);
     void     worker_audioInputIntensity(int value);
+    void     worker_jitterBufferLatency(int audio, int video);
     void     worker_previewFrame(const RtpWorker::Frame &frame);
     void     worker_outputFrame(const RtpWorker::Frame &frame);
     void     worker_rtpAudioOut(const PRtpPacket &packet);
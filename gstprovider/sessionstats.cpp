@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "sessionstats.h"
+
+#include <QMutex>
+#include <cmath>
+
+// buffers in a codec at once we keep track of.  encoders with lookahead
+//   and threaded decoders hold a few, anything beyond is not timed.
+#define CODEC_MAX_PENDING 32
+
+namespace PsiMedia {
+
+// entry times of the buffers in a codec, by pts.  the sink and src pads
+//   may be served by different threads.
+class CodecTimer {
+public:
+    StreamStats *stats;
+    QMutex       m;
+    GstClockTime pts[CODEC_MAX_PENDING];
+    qint64       entered[CODEC_MAX_PENDING];
+    int          at = 0;
+
+    explicit CodecTimer(StreamStats *stats) : stats(stats)
+    {
+        for (int n = 0; n < CODEC_MAX_PENDING; ++n)
+            pts[n] = GST_CLOCK_TIME_NONE;
+    }
+};
+
+static GstPadProbeReturn codec_sink_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    Q_UNUSED(pad);
+    auto         timer = static_cast<CodecTimer *>(data);
+    GstClockTime pts   = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+    if (!GST_CLOCK_TIME_IS_VALID(pts))
+        return GST_PAD_PROBE_OK;
+
+    QMutexLocker locker(&timer->m);
+    timer->pts[timer->at]     = pts;
+    timer->entered[timer->at] = g_get_monotonic_time();
+    timer->at                 = (timer->at + 1) % CODEC_MAX_PENDING;
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn codec_src_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    Q_UNUSED(pad);
+    auto         timer = static_cast<CodecTimer *>(data);
+    GstClockTime pts   = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+    if (!GST_CLOCK_TIME_IS_VALID(pts))
+        return GST_PAD_PROBE_OK;
+
+    qint64 entered = -1;
+    {
+        QMutexLocker locker(&timer->m);
+        for (int n = 0; n < CODEC_MAX_PENDING; ++n) {
+            if (timer->pts[n] == pts) {
+                entered       = timer->entered[n];
+                timer->pts[n] = GST_CLOCK_TIME_NONE;
+                break;
+            }
+        }
+    }
+    if (entered != -1)
+        timer->stats->addCodecTime(g_get_monotonic_time() - entered);
+    return GST_PAD_PROBE_OK;
+}
+
+static void codec_timer_destroy(gpointer data) { delete static_cast<CodecTimer *>(data); }
+
+StreamStats::StreamStats()
+{
+    for (auto &bucket : codecTimes)
+        bucket = 0;
+    clock.start();
+}
+
+void StreamStats::packetSent(int size)
+{
+    ++packets;
+    bytes += quint64(size);
+}
+
+void StreamStats::setClockRate(int rate) { clockRate = rate; }
+
+void StreamStats::packetReceived(const QByteArray &rtp, bool media)
+{
+    auto p = reinterpret_cast<const quint8 *>(rtp.constData());
+    if (rtp.size() < 12 || (p[0] >> 6) != 2)
+        return;
+
+    ++packets;
+    bytes += quint64(rtp.size());
+    if (!media)
+        ++recovered;
+
+    // only the media's own ssrc counts, should another one show up
+    quint32 ssrc = GST_READ_UINT32_BE(p + 8);
+    quint16 seq  = GST_READ_UINT16_BE(p + 2);
+    quint32 ts   = GST_READ_UINT32_BE(p + 4);
+    if (started && ssrc != ssrc_)
+        return;
+
+    if (!started) {
+        started  = true;
+        ssrc_    = ssrc;
+        maxSeq   = seq;
+        baseSeq  = seq;
+        expected = 1;
+        received = 1;
+    } else {
+        // sequence tracking as in rfc 3550 appendix a.1, as in the jitter
+        //   estimator
+        quint16 delta = quint16(seq - maxSeq);
+        if (delta < 0x8000) {
+            if (seq < maxSeq)
+                cycles += 0x10000;
+            maxSeq = seq;
+        }
+        expected = cycles + maxSeq - baseSeq + 1;
+        ++received;
+    }
+
+    int rate = clockRate;
+    if (!media || rate <= 0)
+        return;
+
+    double arrival = double(clock.nsecsElapsed()) / 1000;
+    double transit = arrival - double(ts) * 1000000 / rate;
+    if (!timed) {
+        timed       = true;
+        lastTs      = ts;
+        lastTransit = transit;
+        return;
+    }
+
+    // timestamps wrap, transit times must not
+    if (ts < lastTs && lastTs - ts > 0x80000000u)
+        tsCycles += double(0x100000000ull) * 1000000 / rate;
+    lastTs = ts;
+    transit -= tsCycles;
+
+    double d    = std::fabs(transit - lastTransit);
+    lastTransit = transit;
+    jitter_ += (d - jitter_) / 16;
+    jitter = int(jitter_);
+}
+
+void StreamStats::retransmissionReceived(int size)
+{
+    ++packets;
+    ++recovered;
+    bytes += quint64(size);
+}
+
+void StreamStats::addCodecTime(qint64 usec)
+{
+    int bucket = 0;
+    for (qint64 limit = 1000; bucket < CODEC_TIME_BUCKETS - 1 && usec >= limit; limit *= 2)
+        ++bucket;
+    ++codecTimes[bucket];
+}
+
+void StreamStats::watchCodec(GstElement *codec)
+{
+    auto    timer = new CodecTimer(this);
+    GstPad *pad   = gst_element_get_static_pad(codec, "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, codec_sink_probe, timer, nullptr);
+    gst_object_unref(pad);
+
+    // the src pad owns the timer, the sink pad goes away with it
+    pad = gst_element_get_static_pad(codec, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, codec_src_probe, timer, codec_timer_destroy);
+    gst_object_unref(pad);
+}
+
+PStreamStatistics StreamStats::snapshot() const
+{
+    PStreamStatistics out;
+    out.packets   = packets;
+    out.bytes     = bytes;
+    out.recovered = recovered;
+    out.nacks     = nacks;
+    out.plis      = plis;
+    out.dropped   = dropped;
+
+    quint64 exp = expected;
+    quint64 got = received;
+    if (exp > 0) {
+        // duplicates make up for losses
+        out.lost = exp > got ? qint64(exp - got) : 0;
+        out.loss = int(out.lost * 100 / qint64(exp));
+    } else
+        out.loss = loss;
+
+    int j      = jitter;
+    out.jitter = j != -1 ? (j + 500) / 1000 : -1;
+
+    for (const auto &bucket : codecTimes)
+        out.codecTimes += bucket;
+    return out;
+}
+
+void StreamStats::reset()
+{
+    packets   = 0;
+    bytes     = 0;
+    expected  = 0;
+    received  = 0;
+    recovered = 0;
+    loss      = -1;
+    jitter    = -1;
+    nacks     = 0;
+    plis      = 0;
+    dropped   = 0;
+    for (auto &bucket : codecTimes)
+        bucket = 0;
+
+    started     = false;
+    timed       = false;
+    cycles      = 0;
+    tsCycles    = 0;
+    jitter_     = 0;
+    lastTransit = 0;
+    clock.restart();
+}
+
+void SessionStats::reset()
+{
+    audioSent.reset();
+    audioReceived.reset();
+    videoSent.reset();
+    videoReceived.reset();
+}
+
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef PSI_SESSIONSTATS_H
+#define PSI_SESSIONSTATS_H
+
+#include "psimediaprovider.h"
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <atomic>
+#include <gst/gst.h>
+
+// codec times are counted in buckets of powers of two ms: below 1, below
+//   2, below 4 and so on, the last bucket taking everything longer
+#define CODEC_TIME_BUCKETS 8
+
+namespace PsiMedia {
+
+// counters of one media type in one direction.  they are bumped by the
+//   streaming threads and read by the session, without locking.
+class StreamStats {
+public:
+    std::atomic<quint64> packets { 0 };
+    std::atomic<quint64> bytes { 0 };
+    std::atomic<quint64> expected { 0 };  // received only, by sequence numbers
+    std::atomic<quint64> received { 0 };  // likewise, without retransmissions
+    std::atomic<quint64> recovered { 0 }; // received only, retransmissions and fec
+    std::atomic<int>     loss { -1 };     // sent only, percent reported by the remote
+    std::atomic<int>     jitter { -1 };   // received only, rfc 3550, in us
+    std::atomic<quint64> nacks { 0 };
+    std::atomic<quint64> plis { 0 };
+    std::atomic<quint64> dropped { 0 };
+    std::atomic<quint64> codecTimes[CODEC_TIME_BUCKETS];
+
+    StreamStats();
+
+    StreamStats(const StreamStats &)            = delete;
+    StreamStats &operator=(const StreamStats &) = delete;
+
+    void packetSent(int size);
+
+    // calls must not overlap.  the clock rate is needed for the jitter.
+    //   packets of the media go to packetReceived(), and so does fec that
+    //   takes sequence numbers of the media, just not for the jitter.
+    //   retransmissions have sequence numbers of their own.
+    void setClockRate(int rate);
+    void packetReceived(const QByteArray &rtp, bool media = true);
+    void retransmissionReceived(int size);
+
+    void addCodecTime(qint64 usec);
+
+    // time each buffer spends in codec, an encoder or decoder keeping the
+    //   pts, for as long as the element lives
+    void watchCodec(GstElement *codec);
+
+    // bitrate is left for the caller, which knows how long it has been
+    PStreamStatistics snapshot() const;
+
+    // only while nothing is counting
+    void reset();
+
+private:
+    // receive state, only touched by packetReceived()
+    std::atomic<int> clockRate { 0 };
+    QElapsedTimer    clock;
+    bool             started     = false;
+    bool             timed       = false;
+    quint32          ssrc_       = 0;
+    quint16          maxSeq      = 0;
+    quint64          cycles      = 0;
+    quint64          baseSeq     = 0;
+    quint32          lastTs      = 0;
+    double           tsCycles    = 0; // us
+    double           lastTransit = 0; // us
+    double           jitter_     = 0; // us
+};
+
+class SessionStats {
+public:
+    StreamStats audioSent;
+    StreamStats audioReceived;
+    StreamStats videoSent;
+    StreamStats videoReceived;
+
+    void reset();
+};
+
+}
+
+#endif
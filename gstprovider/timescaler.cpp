@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#include "timescaler.h"
+
+#include <QtGlobal>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TIMESCALER_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define TIMESCALER_NEON
+#include <arm_neon.h>
+#endif
+
+// pitch periods considered, in us.  the upper bound is low enough that
+//   two periods fit into a 20ms frame.
+#define SCALER_MIN_PERIOD 2500
+#define SCALER_MAX_PERIOD 10000
+
+// normalized correlation needed to scale voiced audio
+#define SCALER_MIN_CORRELATION 0.6
+
+// mean square below which audio counts as silence (about -40dBFS)
+#define SCALER_SILENCE_ENERGY 100000.0
+
+namespace PsiMedia {
+
+static float dot_product(const float *a, const float *b, int count)
+{
+    float sum = 0;
+    int   n   = 0;
+
+#if defined(TIMESCALER_SSE2)
+    __m128 acc = _mm_setzero_ps();
+    for (; n + 4 <= count; n += 4)
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + n), _mm_loadu_ps(b + n)));
+    float parts[4];
+    _mm_storeu_ps(parts, acc);
+    sum = parts[0] + parts[1] + parts[2] + parts[3];
+#elif defined(TIMESCALER_NEON)
+    float32x4_t acc = vdupq_n_f32(0);
+    for (; n + 4 <= count; n += 4)
+        acc = vmlaq_f32(acc, vld1q_f32(a + n), vld1q_f32(b + n));
+    sum = vgetq_lane_f32(acc, 0) + vgetq_lane_f32(acc, 1) + vgetq_lane_f32(acc, 2) + vgetq_lane_f32(acc, 3);
+#endif
+
+    for (; n < count; ++n)
+        sum += a[n] * b[n];
+    return sum;
+}
+
+void TimeScaler::adjust(int ms) { pendingUs += ms * 1000; }
+
+int TimeScaler::pending() const { return pendingUs / 1000; }
+
+void TimeScaler::consume(int doneUs)
+{
+    // done is signed like the pending change.  never flip the sign, the
+    //   last period may overshoot by a little.
+    int cur = pendingUs.load();
+    int next;
+    do {
+        if ((cur > 0 && doneUs >= cur) || (cur < 0 && doneUs <= cur))
+            next = 0;
+        else
+            next = cur - doneUs;
+    } while (!pendingUs.compare_exchange_weak(cur, next));
+}
+
+int TimeScaler::findPeriod(int minLag, int maxLag) const
+{
+    int    best      = -1;
+    double bestScore = SCALER_MIN_CORRELATION;
+    for (int lag = minLag; lag <= maxLag; ++lag) {
+        double e1 = energy[lag] - energy[0];
+        double e2 = energy[2 * lag] - energy[lag];
+
+        double score;
+        if ((e1 + e2) / (2 * lag) < SCALER_SILENCE_ENERGY) {
+            // any period will do, so prefer the longest
+            score = 2;
+        } else {
+            double c = dot_product(mono.constData(), mono.constData() + lag, lag);
+            score    = c / std::sqrt(e1 * e2 + 1);
+        }
+
+        if (score >= bestScore) {
+            best      = lag;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+bool TimeScaler::process(const qint16 *in, int frames, int channels, int rate, QVector<qint16> *out)
+{
+    int want = pendingUs.load();
+    if (want == 0 || frames <= 0 || channels <= 0 || rate <= 0)
+        return false;
+
+    int minLag     = int(qint64(rate) * SCALER_MIN_PERIOD / 1000000);
+    int wantFrames = int(qint64(rate) * qAbs(want) / 1000000);
+    if (minLag < 1)
+        return false;
+
+    // a remainder shorter than any period can't be done, forget it
+    if (wantFrames < minLag) {
+        consume(want);
+        return false;
+    }
+
+    // don't go past what was asked for
+    int maxLag = int(qint64(rate) * SCALER_MAX_PERIOD / 1000000);
+    maxLag     = qMin(maxLag, frames / 2);
+    maxLag     = qMin(maxLag, wantFrames);
+    if (maxLag < minLag)
+        return false;
+
+    // search on a mono mixdown of the two periods
+    int len = 2 * maxLag;
+    mono.resize(len);
+    energy.resize(len + 1);
+    energy[0] = 0;
+    for (int n = 0; n < len; ++n) {
+        int sum = 0;
+        for (int c = 0; c < channels; ++c)
+            sum += in[n * channels + c];
+        mono[n]       = float(sum) / channels;
+        energy[n + 1] = energy[n] + double(mono[n]) * mono[n];
+    }
+
+    int lag = findPeriod(minLag, maxLag);
+    if (lag == -1)
+        return false;
+
+    bool stretch = want > 0;
+    out->resize((frames + (stretch ? lag : -lag)) * channels);
+    qint16 *o = out->data();
+
+    if (stretch) {
+        // first period, then a fade from the second period back into the
+        //   first, then the rest
+        std::copy(in, in + lag * channels, o);
+        o += lag * channels;
+        for (int n = 0; n < lag; ++n) {
+            float w = float(n) / lag;
+            for (int c = 0; c < channels; ++c) {
+                float a = in[(lag + n) * channels + c];
+                float b = in[n * channels + c];
+                *(o++)  = qint16(std::lround(a * (1 - w) + b * w));
+            }
+        }
+        std::copy(in + lag * channels, in + frames * channels, o);
+    } else {
+        // a fade from the first period into the second, then the rest
+        for (int n = 0; n < lag; ++n) {
+            float w = float(n) / lag;
+            for (int c = 0; c < channels; ++c) {
+                float a = in[n * channels + c];
+                float b = in[(lag + n) * channels + c];
+                *(o++)  = qint16(std::lround(a * (1 - w) + b * w));
+            }
+        }
+        std::copy(in + 2 * lag * channels, in + frames * channels, o);
+    }
+
+    int doneUs = int(qint64(lag) * 1000000 / rate);
+    consume(stretch ? doneUs : -doneUs);
+    return true;
+}
+
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2026  Psi IM team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ */
+
+#ifndef PSI_TIMESCALER_H
+#define PSI_TIMESCALER_H
+
+#include <QVector>
+#include <atomic>
+
+namespace PsiMedia {
+
+// stretches or squeezes decoded audio by whole pitch periods, so that the
+//   playout can run ahead of or behind the rtp timestamps without audible
+//   gaps.  this is a reduced wsola: each block is searched for the period
+//   that best matches its successor, and one period is then either
+//   removed or repeated with a crossfade.  silent blocks are always
+//   eligible, voiced blocks only if the match is good enough.
+//
+// adjust() may be called from any thread, process() is meant for the
+//   streaming thread.
+class TimeScaler {
+public:
+    TimeScaler() = default;
+
+    TimeScaler(const TimeScaler &)            = delete;
+    TimeScaler &operator=(const TimeScaler &) = delete;
+
+    // queue a playout change, in ms.  positive values play out more audio
+    //   than was received (filling the sink), negative values less
+    //   (draining it).
+    void adjust(int ms);
+
+    // playout change still to be done, in ms
+    int pending() const;
+
+    // scale a block of interleaved s16 samples into out.  returns false if
+    //   the block should be passed through unchanged.
+    bool process(const qint16 *in, int frames, int channels, int rate, QVector<qint16> *out);
+
+private:
+    std::atomic<int> pendingUs { 0 };
+
+    // scratch space, only touched by process()
+    QVector<float>  mono;
+    QVector<double> energy;
+
+    int  findPeriod(int minLag, int maxLag) const;
+    void consume(int doneUs);
+};
+
+}
+
+#endif
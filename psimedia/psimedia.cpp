@@ -20,7 +20,12 @@
 
 #include "psimedia_p.h"
 
+#include <QElapsedTimer>
 #include <QMetaMethod>
+#include <QPointer>
+#include <QTimer>
+#include <map>
+#include <random>
 
 namespace PsiMedia {
 static AudioParams importAudioParams(const PAudioParams &pp)
@@ -101,6 +106,23 @@ static PPayloadInfo exportPayloadInfo(const PayloadInfo &p)
     return out;
 }
 
+static RtpStatistics::Stream importStreamStatistics(const PStreamStatistics &s)
+{
+    RtpStatistics::Stream out;
+    out.packets    = s.packets;
+    out.bytes      = s.bytes;
+    out.bitrate    = s.bitrate;
+    out.lost       = s.lost;
+    out.recovered  = s.recovered;
+    out.loss       = s.loss;
+    out.jitter     = s.jitter;
+    out.nacks      = s.nacks;
+    out.plis       = s.plis;
+    out.dropped    = s.dropped;
+    out.codecTimes = s.codecTimes;
+    return out;
+}
+
 //----------------------------------------------------------------------------
 // Global
 //----------------------------------------------------------------------------
@@ -434,13 +456,20 @@ class RtpPacket::Private : public QSharedData {
 public:
     QByteArray rawValue;
     int        portOffset;
+    int        temporalLayer;
 
-    Private(const QByteArray &_rawValue, int _portOffset) : rawValue(_rawValue), portOffset(_portOffset) { }
+    Private(const QByteArray &_rawValue, int _portOffset, int _temporalLayer) :
+        rawValue(_rawValue), portOffset(_portOffset), temporalLayer(_temporalLayer)
+    {
+    }
 };
 
 RtpPacket::RtpPacket() : d(nullptr) { }
 
-RtpPacket::RtpPacket(const QByteArray &rawValue, int portOffset) : d(new Private(rawValue, portOffset)) { }
+RtpPacket::RtpPacket(const QByteArray &rawValue, int portOffset, int temporalLayer) :
+    d(new Private(rawValue, portOffset, temporalLayer))
+{
+}
 
 RtpPacket::RtpPacket(const RtpPacket &other) = default;
 
@@ -454,6 +483,8 @@ QByteArray RtpPacket::rawValue() const { return d->rawValue; }
 
 int RtpPacket::portOffset() const { return d->portOffset; }
 
+int RtpPacket::temporalLayer() const { return d->temporalLayer; }
+
 //----------------------------------------------------------------------------
 // RtpChannel
 //----------------------------------------------------------------------------
@@ -473,7 +504,7 @@ RtpPacket RtpChannel::read()
 {
     if (d->c) {
         PRtpPacket pp = d->c->read();
-        return RtpPacket(pp.rawValue, pp.portOffset);
+        return RtpPacket(pp.rawValue, pp.portOffset, pp.temporalLayer);
     } else
         return RtpPacket();
 }
@@ -487,8 +518,9 @@ void RtpChannel::write(const RtpPacket &rtp)
         }
 
         PRtpPacket pp;
-        pp.rawValue   = rtp.rawValue();
-        pp.portOffset = rtp.portOffset();
+        pp.rawValue      = rtp.rawValue();
+        pp.portOffset    = rtp.portOffset();
+        pp.temporalLayer = rtp.temporalLayer();
         d->c->write(pp);
     }
 }
@@ -647,8 +679,12 @@ void RtpSession::setVideoPreviewWidget(VideoWidget *widget)
 }
 #endif
 
+void RtpSession::setPipelineProfilingEnabled(bool enabled) { d->c->setPipelineProfilingEnabled(enabled); }
+
 void RtpSession::dumpPipeline(std::function<void(const QStringList &)> callback) { d->c->dumpPipeline(callback); }
 
+void RtpSession::requestKeyframe() { d->c->requestKeyframe(); }
+
 void RtpSession::setRecordingQIODevice(QIODevice *dev) { d->c->setRecorder(dev); }
 
 void RtpSession::stopRecording() { d->c->stopRecording(); }
@@ -671,6 +707,10 @@ void RtpSession::setLocalVideoPreferences(const QList<VideoParams> &params)
 
 void RtpSession::setMaximumSendingBitrate(int kbps) { d->c->setMaximumSendingBitrate(kbps); }
 
+void RtpSession::setVideoTemporalLayers(int layers) { d->c->setVideoTemporalLayers(layers); }
+
+void RtpSession::setCaptureTimeExtensionId(int id) { d->c->setCaptureTimeExtensionId(id); }
+
 void RtpSession::setRemoteAudioPreferences(const QList<PayloadInfo> &info)
 {
     QList<PPayloadInfo> list;
@@ -687,6 +727,8 @@ void RtpSession::setRemoteVideoPreferences(const QList<PayloadInfo> &info)
     d->c->setRemoteVideoPreferences(list);
 }
 
+void RtpSession::prewarm() { d->c->prewarm(); }
+
 void RtpSession::start() { d->c->start(); }
 
 void RtpSession::updatePreferences() { d->c->updatePreferences(); }
@@ -761,9 +803,319 @@ int RtpSession::inputVolume() const { return d->c->inputVolume(); }
 
 void RtpSession::setInputVolume(int level) { d->c->setInputVolume(level); }
 
+int RtpSession::audioJitterBufferLatency() const { return d->c->audioJitterBufferLatency(); }
+
+int RtpSession::videoJitterBufferLatency() const { return d->c->videoJitterBufferLatency(); }
+
+RtpStatistics RtpSession::statistics() const
+{
+    PRtpStatistics s = d->c->statistics();
+    RtpStatistics  out;
+    out.audioSent     = importStreamStatistics(s.audioSent);
+    out.audioReceived = importStreamStatistics(s.audioReceived);
+    out.videoSent     = importStreamStatistics(s.videoSent);
+    out.videoReceived = importStreamStatistics(s.videoReceived);
+    return out;
+}
+
+VideoLatency RtpSession::videoLatency() const
+{
+    PVideoLatency l = d->c->videoLatency();
+    VideoLatency  out;
+    out.encode       = l.encode;
+    out.network      = l.network;
+    out.jitterBuffer = l.jitterBuffer;
+    out.decode       = l.decode;
+    out.convert      = l.convert;
+    out.render       = l.render;
+    out.total        = l.total;
+    return out;
+}
+
 RtpSession::Error RtpSession::errorCode() const { return static_cast<RtpSession::Error>(d->c->errorCode()); }
 
 RtpChannel *RtpSession::audioRtpChannel() { return &d->audioRtpChannel; }
 
 RtpChannel *RtpSession::videoRtpChannel() { return &d->videoRtpChannel; }
+
+//----------------------------------------------------------------------------
+// RtpImpairment
+//----------------------------------------------------------------------------
+RtpImpairment::Profile RtpImpairment::Profile::fromString(const QString &str, bool *ok)
+{
+    Profile     p;
+    QStringList parts;
+    for (const QString &part : str.split(',')) {
+        if (!part.trimmed().isEmpty())
+            parts += part;
+    }
+    if (!parts.isEmpty() && !parts.first().contains('=')) {
+        QString preset = parts.takeFirst().trimmed();
+        if (preset == "wifi") {
+            p.loss         = 0.01;
+            p.burstLength  = 2;
+            p.delay        = 10;
+            p.jitter       = 30;
+            p.reordering   = 0.005;
+            p.reorderDelay = 20;
+        } else if (preset == "cellular") {
+            p.loss        = 0.03;
+            p.burstLength = 4;
+            p.delay       = 60;
+            p.jitter      = 80;
+            p.bandwidth   = 1500;
+            p.queueLength = 400;
+        } else if (preset == "congested") {
+            p.loss        = 0.02;
+            p.delay       = 30;
+            p.jitter      = 10;
+            p.bandwidth   = 500;
+            p.queueLength = 150;
+        } else {
+            if (ok)
+                *ok = false;
+            return Profile();
+        }
+    }
+
+    for (const QString &part : std::as_const(parts)) {
+        int at = part.indexOf('=');
+        if (at == -1) {
+            if (ok)
+                *ok = false;
+            return Profile();
+        }
+
+        QString key   = part.left(at).trimmed();
+        QString value = part.mid(at + 1).trimmed();
+        bool    good  = false;
+        if (key == "seed")
+            p.seed = value.toUInt(&good);
+        else if (key == "loss")
+            p.loss = value.toDouble(&good);
+        else if (key == "burst")
+            p.burstLength = value.toDouble(&good);
+        else if (key == "dup")
+            p.duplication = value.toDouble(&good);
+        else if (key == "reorder")
+            p.reordering = value.toDouble(&good);
+        else if (key == "reorder-delay")
+            p.reorderDelay = value.toInt(&good);
+        else if (key == "delay")
+            p.delay = value.toInt(&good);
+        else if (key == "jitter")
+            p.jitter = value.toInt(&good);
+        else if (key == "bw")
+            p.bandwidth = value.toInt(&good);
+        else if (key == "queue")
+            p.queueLength = value.toInt(&good);
+
+        if (!good) {
+            if (ok)
+                *ok = false;
+            return Profile();
+        }
+    }
+
+    if (ok)
+        *ok = true;
+    return p;
+}
+
+QString RtpImpairment::Profile::toString() const
+{
+    return QString("seed=%1,loss=%2,burst=%3,dup=%4,reorder=%5,reorder-delay=%6,delay=%7,jitter=%8,bw=%9,queue=%10")
+        .arg(seed)
+        .arg(loss)
+        .arg(burstLength)
+        .arg(duplication)
+        .arg(reordering)
+        .arg(reorderDelay)
+        .arg(delay)
+        .arg(jitter)
+        .arg(bandwidth)
+        .arg(queueLength);
+}
+
+class RtpImpairment::Private {
+public:
+    RtpImpairment *q;
+    Profile        profile;
+    Statistics     stats;
+    std::mt19937   random;
+    QElapsedTimer  clock;
+    QTimer         timer;
+
+    // gilbert-elliott: all packets are lost while in the bad state
+    bool bad = false;
+
+    // when the bandwidth limited link is done with what was queued, in ms
+    double linkFree = 0;
+
+    // packets on their way, by the time they arrive
+    std::multimap<qint64, RtpPacket> pending;
+
+    Private(RtpImpairment *_q) : q(_q)
+    {
+        clock.start();
+        timer.setSingleShot(true);
+        timer.setTimerType(Qt::PreciseTimer);
+        QObject::connect(&timer, &QTimer::timeout, q, [this]() { deliver(); });
+    }
+
+    double chance() { return std::uniform_real_distribution<double>(0, 1)(random); }
+
+    bool lose()
+    {
+        if (profile.loss <= 0)
+            return false;
+
+        // stay in either state for a geometric number of packets, so that
+        //   losses average to the loss rate in bursts of the burst length
+        double burst = std::max(profile.burstLength, 1.0);
+        double toBad = std::min(profile.loss / (burst * (1 - std::min(profile.loss, 0.99))), 1.0);
+        if (bad)
+            bad = chance() >= 1 / burst;
+        else
+            bad = chance() < toBad;
+        return bad;
+    }
+
+    void schedule(qint64 at, const RtpPacket &packet)
+    {
+        pending.emplace(at, packet);
+        qint64 next = pending.begin()->first;
+        timer.start(int(std::max<qint64>(next - clock.elapsed(), 0)));
+    }
+
+    void write(const RtpPacket &packet)
+    {
+        ++stats.packetsIn;
+        if (lose()) {
+            ++stats.lost;
+            return;
+        }
+
+        double now = double(clock.elapsed());
+        double at  = now;
+        if (profile.bandwidth > 0) {
+            double start = std::max(now, linkFree);
+            if (start - now > profile.queueLength) {
+                ++stats.queueDropped;
+                return;
+            }
+            linkFree = start + packet.rawValue().size() * 8.0 / profile.bandwidth;
+            at       = linkFree;
+        }
+
+        at += profile.delay;
+        if (profile.jitter > 0)
+            at += chance() * profile.jitter;
+        if (profile.reordering > 0 && chance() < profile.reordering) {
+            ++stats.reordered;
+            at += profile.reorderDelay;
+        }
+
+        schedule(qint64(at), packet);
+        if (profile.duplication > 0 && chance() < profile.duplication) {
+            ++stats.duplicated;
+            schedule(qint64(at), packet);
+        }
+    }
+
+    void deliver()
+    {
+        QList<RtpPacket> ready;
+        qint64           now = clock.elapsed();
+        while (!pending.empty() && pending.begin()->first <= now) {
+            ready += pending.begin()->second;
+            pending.erase(pending.begin());
+        }
+        if (!pending.empty())
+            timer.start(int(std::max<qint64>(pending.begin()->first - now, 0)));
+
+        // we may be deleted from a slot
+        QPointer<RtpImpairment> self(q);
+        for (const RtpPacket &packet : std::as_const(ready)) {
+            ++stats.packetsOut;
+            emit q->packetReady(packet);
+            if (!self)
+                return;
+        }
+    }
+};
+
+RtpImpairment::RtpImpairment(QObject *parent) : QObject(parent) { d = new Private(this); }
+
+RtpImpairment::~RtpImpairment() { delete d; }
+
+void RtpImpairment::setProfile(const Profile &profile)
+{
+    d->profile = profile;
+    d->random.seed(profile.seed);
+    d->bad      = false;
+    d->linkFree = 0;
+}
+
+RtpImpairment::Profile RtpImpairment::profile() const { return d->profile; }
+
+RtpImpairment::Statistics RtpImpairment::statistics() const { return d->stats; }
+
+void RtpImpairment::resetStatistics() { d->stats = Statistics(); }
+
+void RtpImpairment::write(const RtpPacket &packet) { d->write(packet); }
+
+//----------------------------------------------------------------------------
+// RtpRelay
+//----------------------------------------------------------------------------
+class RtpRelay::Private {
+public:
+    RtpRelayContext *c;
+
+    Private() { c = provider()->createRtpRelay(); }
+
+    ~Private() { delete c; }
+};
+
+RtpRelay::RtpRelay(QObject *parent) : QObject(parent) { d = new Private; }
+
+RtpRelay::~RtpRelay() { delete d; }
+
+void RtpRelay::addSession(RtpSession *session, bool playLocally) { d->c->addSession(session->d->c, playLocally); }
+
+void RtpRelay::removeSession(RtpSession *session) { d->c->removeSession(session->d->c); }
+
+void RtpRelay::setMaximumTemporalLayer(RtpSession *session, int layer)
+{
+    d->c->setMaximumTemporalLayer(session->d->c, layer);
+}
+
+#ifdef QT_GUI_LIB
+//----------------------------------------------------------------------------
+// VideoCompositor
+//----------------------------------------------------------------------------
+class VideoCompositor::Private {
+public:
+    VideoCompositorContext *c;
+
+    Private() { c = provider()->createVideoCompositor(); }
+
+    ~Private() { delete c; }
+};
+
+VideoCompositor::VideoCompositor(QObject *parent) : QObject(parent) { d = new Private; }
+
+VideoCompositor::~VideoCompositor() { delete d; }
+
+void VideoCompositor::setOutputWidget(VideoWidget *widget) { d->c->setOutputWidget(widget ? widget->d : nullptr); }
+
+void VideoCompositor::addSession(RtpSession *session) { d->c->addSession(session->d->c); }
+
+void VideoCompositor::removeSession(RtpSession *session) { d->c->removeSession(session->d->c); }
+
+void VideoCompositor::setSessionVisible(RtpSession *session, bool visible)
+{
+    d->c->setSessionVisible(session->d->c, visible);
+}
+#endif
 }; // namespace PsiMedia
@@ -34,6 +34,7 @@ class QMetaMethod;
 
 namespace PsiMedia {
 class RtpChannelPrivate;
+class RtpRelay;
 class RtpSession;
 class RtpSessionPrivate;
 class VideoWidgetPrivate;
@@ -95,6 +96,7 @@ private:
 
     friend class VideoWidgetPrivate;
     friend class RtpSession;
+    friend class VideoCompositor;
     VideoWidgetPrivate *d;
 };
 #endif
@@ -179,7 +181,7 @@ private:
 class RtpPacket {
 public:
     RtpPacket();
-    RtpPacket(const QByteArray &rawValue, int portOffset);
+    RtpPacket(const QByteArray &rawValue, int portOffset, int temporalLayer = -1);
     RtpPacket(const RtpPacket &other);
     ~RtpPacket();
     RtpPacket &operator=(const RtpPacket &other);
@@ -189,6 +191,11 @@ public:
     QByteArray rawValue() const;
     int        portOffset() const;
 
+    // for video sent with temporal layers, the layer of this packet.  0 is
+    //   the base layer, and packets of the upper layers can be dropped
+    //   without breaking the decoding of the lower ones.  -1 if unknown.
+    int temporalLayer() const;
+
 private:
     class Private;
     QSharedDataPointer<Private> d;
@@ -270,6 +277,51 @@ private:
     Private *d;
 };
 
+// where the time goes between a video frame being captured and shown, as
+//   averages over about a second, in ms.  -1 for stages not measured.
+class VideoLatency {
+public:
+    int encode       = -1; // of the video we send, capture to rtp
+    int network      = -1; // remote capture to arrival of the frame
+    int jitterBuffer = -1;
+    int decode       = -1; // jitter buffer to decoded frame
+    int convert      = -1; // decoded frame to image
+    int render       = -1; // image to the output widget painting it
+    int total        = -1; // remote capture to painting
+};
+
+// counters of a session, for each media type in each direction
+class RtpStatistics {
+public:
+    class Stream {
+    public:
+        quint64 packets   = 0;
+        quint64 bytes     = 0;
+        int     bitrate   = -1; // kbit/s, since the previous call to statistics()
+        qint64  lost      = 0;  // received only, by sequence numbers
+        quint64 recovered = 0;  // received only, retransmitted and fec packets, counted in packets too
+        int     loss      = -1; // percent, for sent streams as reported by the remote
+        int     jitter    = -1; // ms, received only
+        quint64 nacks     = 0;  // retransmissions asked for, by the remote of sent streams, by us of received ones
+        quint64 plis      = 0;  // keyframe requests, likewise
+
+        // sent: packets dropped because the application didn't read them
+        //   from the RtpChannel in time.  received video: decoded frames
+        //   dropped because newer ones came in before they were shown.
+        quint64 dropped = 0;
+
+        // time each frame spends in the encoder (sent) or decoder
+        //   (received).  bucket n counts frames done in less than 2^n ms,
+        //   the last bucket all slower ones.
+        QList<quint64> codecTimes;
+    };
+
+    Stream audioSent;
+    Stream audioReceived;
+    Stream videoSent;
+    Stream videoReceived;
+};
+
 class RtpSession : public QObject {
     Q_OBJECT
 
@@ -294,8 +346,25 @@ public:
 #ifdef QT_GUI_LIB
     void setVideoPreviewWidget(VideoWidget *widget);
 #endif
+
+    // gstreamer tracers collect processing times, latencies and queue
+    //   levels of each element, and the cpu load of the threads they run in,
+    //   for as long as profiling is enabled.  it costs, so leave it off
+    //   unless looking into something.  enabling it the first time installs
+    //   the tracers for the rest of the process, gstreamer can't remove
+    //   them, though they log nothing with profiling off.
+    void setPipelineProfilingEnabled(bool enabled);
+
+    // the callback gets the .dot files written, if GST_DEBUG_DUMP_DOT_DIR
+    //   is set.  with profiling enabled, they are preceded by a text report
+    //   of the timings so far, and the graph of each pipeline in dot format,
+    //   annotated with them.
     void dumpPipeline(std::function<void(const QStringList &)>);
 
+    // asks the remote to send a video keyframe, e.g. after the application
+    //   dropped or could not decode video
+    void requestKeyframe();
+
     // pass a QIODevice to record to.  if a device is set before starting
     //   the session, then recording will wait until it starts.
     // records in mp4 vp8+opus format
@@ -311,10 +380,31 @@ public:
 
     void setMaximumSendingBitrate(int kbps);
 
+    // encode video in this many temporal layers (1 to 3), halving the
+    //   frame rate of each layer below the top one.  needs a gstreamer
+    //   that supports per-layer reference flags, otherwise video stays
+    //   single-layered.
+    void setVideoTemporalLayers(int layers);
+
+    // send the capture time of each video frame in the abs-capture-time rtp
+    //   header extension, and read it from received video, using this
+    //   one-byte extension id (1 to 14) as negotiated with the remote.  0,
+    //   the default, disables the extension.
+    void setCaptureTimeExtensionId(int id);
+
     // set remote preferences, using payloadinfo.
     void setRemoteAudioPreferences(const QList<PayloadInfo> &info);
     void setRemoteVideoPreferences(const QList<PayloadInfo> &info);
 
+    // opens the audio and video input devices set, and starts capturing,
+    //   e.g. while an incoming call rings.  start() then takes over the
+    //   running devices, rather than waiting for them to come up, which
+    //   may take seconds.  set local prefs first, as the capture mode is
+    //   picked from them.  stop(), or deleting the session, closes the
+    //   devices again if start() doesn't come.  only one session at a time
+    //   can send, and prewarming counts as sending.
+    void prewarm();
+
     // usage strategy:
     //   - initiator sets local prefs / bitrate
     //   - initiator starts(), waits for started()
@@ -398,6 +488,8 @@ public:
     //   called for them to take effect
     void updatePreferences();
 
+    // paused media is held, not encoded.  capture goes on for the preview.
+    //   once transmitted again, video resumes with a keyframe.
     void transmitAudio();
     void transmitVideo();
     void pauseAudio();
@@ -440,6 +532,21 @@ public:
     int  inputVolume() const; // 0 (mute) to 100
     void setInputVolume(int level);
 
+    // receive side buffering, in ms.  unless overridden with the
+    //   PSI_RTP_LATENCY environment variable, this follows the network
+    //   conditions of the incoming stream.  -1 if the media type is not
+    //   being received.
+    int audioJitterBufferLatency() const;
+    int videoJitterBufferLatency() const;
+
+    // the network and total parts need the remote to send capture times
+    //   (see setCaptureTimeExtensionId()), and are only as good as the
+    //   clocks of both sides are in sync.  render needs an output widget.
+    VideoLatency videoLatency() const;
+
+    // cheap enough to poll, e.g. once a second
+    RtpStatistics statistics() const;
+
     Error errorCode() const;
 
     RtpChannel *audioRtpChannel();
@@ -454,13 +561,137 @@ signals:
     void stopped();
     void finished(); // for file playback only
     void error();
+    void jitterBufferLatencyChanged();
 
 private:
     Q_DISABLE_COPY(RtpSession)
 
     friend class RtpSessionPrivate;
+    friend class RtpRelay;
+    friend class VideoCompositor;
     RtpSessionPrivate *d;
 };
+
+// forwards rtp between sessions without decoding it, for calls with more
+//   than two parties.  whatever the remote of one session sends is passed
+//   on to the remotes of all other sessions, each forwarded stream with
+//   its own ssrc.  rtcp feedback about forwarded streams is handled by the
+//   relay.  the sessions still send their own media as usual, and must be
+//   started for forwarded packets to show up on their channels.
+class RtpRelay : public QObject {
+    Q_OBJECT
+
+public:
+    explicit RtpRelay(QObject *parent = nullptr);
+    ~RtpRelay() override;
+
+    // media received on the session is played by the session itself only
+    //   if playLocally is set
+    void addSession(RtpSession *session, bool playLocally = false);
+    void removeSession(RtpSession *session);
+
+    // forward only vp8 temporal layers up to this one to the session, for
+    //   receivers short on bandwidth.  -1 for all.
+    void setMaximumTemporalLayer(RtpSession *session, int layer);
+
+private:
+    Q_DISABLE_COPY(RtpRelay)
+
+    class Private;
+    Private *d;
+};
+
+// for testing: delays, drops, duplicates and reorders the packets written
+//   to it the way a bad network would, and passes on what is left with
+//   packetReady().  put it between a channel and the network, or between the
+//   channels of two sessions.  everything random comes from the seed of the
+//   profile, so a run can be repeated with the same packet fates.
+class RtpImpairment : public QObject {
+    Q_OBJECT
+
+public:
+    class Profile {
+    public:
+        quint32 seed         = 1;
+        double  loss         = 0;   // probability of a packet being lost
+        double  burstLength  = 1;   // average number of packets lost in a row
+        double  duplication  = 0;   // probability of a packet arriving twice
+        double  reordering   = 0;   // probability of a packet being held back
+        int     reorderDelay = 0;   // by this many ms
+        int     delay        = 0;   // ms
+        int     jitter       = 0;   // up to this many ms more, uniformly
+        int     bandwidth    = 0;   // kbit/s, 0 for no limit
+        int     queueLength  = 200; // ms of data queued at the limit before dropping
+
+        // comma separated key=value pairs, e.g.
+        //   "seed=7,loss=0.05,burst=3,delay=40,jitter=20,dup=0.01,reorder=0.02,reorder-delay=30,bw=800,queue=200"
+        //   or one of the presets "wifi", "cellular" and "congested", optionally
+        //   followed by pairs overriding some of its values.  returns a
+        //   profile without impairments on error.
+        static Profile fromString(const QString &str, bool *ok = nullptr);
+        QString        toString() const;
+    };
+
+    class Statistics {
+    public:
+        quint64 packetsIn    = 0;
+        quint64 packetsOut   = 0;
+        quint64 lost         = 0; // by the loss model
+        quint64 queueDropped = 0; // by the bandwidth limit
+        quint64 duplicated   = 0;
+        quint64 reordered    = 0;
+    };
+
+    explicit RtpImpairment(QObject *parent = nullptr);
+    ~RtpImpairment() override;
+
+    // restarts the random sequence from the seed
+    void    setProfile(const Profile &profile);
+    Profile profile() const;
+
+    Statistics statistics() const;
+    void       resetStatistics();
+
+    void write(const RtpPacket &packet);
+
+signals:
+    void packetReady(const PsiMedia::RtpPacket &packet);
+
+private:
+    Q_DISABLE_COPY(RtpImpairment)
+
+    class Private;
+    friend class Private;
+    Private *d;
+};
+
+#ifdef QT_GUI_LIB
+// shows the remote video of several sessions in one widget, tiled in a
+//   grid.  each stream is scaled once, straight into its tile, and streams
+//   of hidden tiles are not scaled at all.  sessions must be added before
+//   they are started, and don't use their own output widget then.
+class VideoCompositor : public QObject {
+    Q_OBJECT
+
+public:
+    explicit VideoCompositor(QObject *parent = nullptr);
+    ~VideoCompositor() override;
+
+    void setOutputWidget(VideoWidget *widget);
+
+    void addSession(RtpSession *session);
+    void removeSession(RtpSession *session);
+
+    // hidden sessions give their tile to the others
+    void setSessionVisible(RtpSession *session, bool visible);
+
+private:
+    Q_DISABLE_COPY(VideoCompositor)
+
+    class Private;
+    Private *d;
+};
+#endif
 }; // namespace PsiMedia
 
 Q_DECLARE_METATYPE(PsiMedia::AudioParams)
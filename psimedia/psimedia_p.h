@@ -194,6 +194,7 @@ public:
         connect(c->qobject(), SIGNAL(stopped()), SLOT(c_stopped()));
         connect(c->qobject(), SIGNAL(finished()), SLOT(c_finished()));
         connect(c->qobject(), SIGNAL(error()), SLOT(c_error()));
+        connect(c->qobject(), SIGNAL(jitterBufferLatencyChanged()), SLOT(c_jitterBufferLatencyChanged()));
     }
 
     ~RtpSessionPrivate() { delete c; }
@@ -214,6 +215,8 @@ private slots:
 
     void c_stoppedRecording() { emit q->stoppedRecording(); }
 
+    void c_jitterBufferLatencyChanged() { emit q->jitterBufferLatencyChanged(); }
+
     void c_stopped()
     {
         audioRtpChannel.d->setContext(nullptr);
@@ -49,6 +49,8 @@ namespace PsiMedia {
 class FeaturesContext;
 class Provider;
 class RtpSessionContext;
+class RtpRelayContext;
+class VideoCompositorContext;
 class AudioRecorderContext;
 
 class Plugin {
@@ -149,8 +151,44 @@ class PRtpPacket {
 public:
     QByteArray rawValue;
     int        portOffset;
+    int        temporalLayer; // outgoing video only, -1 if not layered
 
-    inline PRtpPacket() : portOffset(0) { }
+    inline PRtpPacket() : portOffset(0), temporalLayer(-1) { }
+};
+
+// average time video frames spend in each stage, in ms, -1 if not measured
+class PVideoLatency {
+public:
+    int encode       = -1;
+    int network      = -1;
+    int jitterBuffer = -1;
+    int decode       = -1;
+    int convert      = -1;
+    int render       = -1;
+    int total        = -1;
+};
+
+class PStreamStatistics {
+public:
+    quint64        packets   = 0;
+    quint64        bytes     = 0;
+    int            bitrate   = -1; // kbit/s
+    qint64         lost      = 0;
+    quint64        recovered = 0;
+    int            loss      = -1; // percent
+    int            jitter    = -1; // ms
+    quint64        nacks     = 0;
+    quint64        plis      = 0;
+    quint64        dropped   = 0;
+    QList<quint64> codecTimes; // histogram, bucket n counting times below 2^n ms
+};
+
+class PRtpStatistics {
+public:
+    PStreamStatistics audioSent;
+    PStreamStatistics audioReceived;
+    PStreamStatistics videoSent;
+    PStreamStatistics videoReceived;
 };
 
 class Provider : public QObjectInterface {
@@ -160,9 +198,11 @@ public:
     virtual QString creditName() const = 0;
     virtual QString creditText() const = 0;
 
-    virtual FeaturesContext      *createFeatures()      = 0;
-    virtual RtpSessionContext    *createRtpSession()    = 0;
-    virtual AudioRecorderContext *createAudioRecorder() = 0;
+    virtual FeaturesContext        *createFeatures()        = 0;
+    virtual RtpSessionContext      *createRtpSession()      = 0;
+    virtual RtpRelayContext        *createRtpRelay()        = 0;
+    virtual VideoCompositorContext *createVideoCompositor() = 0;
+    virtual AudioRecorderContext   *createAudioRecorder()   = 0;
 
     HINT_SIGNALS : HINT_METHOD(initialized())
 };
@@ -224,10 +264,16 @@ public:
     virtual void setLocalVideoPreferences(const QList<PVideoParams> &params) = 0;
 
     virtual void setMaximumSendingBitrate(int kbps) = 0;
+    virtual void setVideoTemporalLayers(int layers) = 0;
+
+    // one-byte header extension id of abs-capture-time, 0 to not use it
+    virtual void setCaptureTimeExtensionId(int id) = 0;
 
     virtual void setRemoteAudioPreferences(const QList<PPayloadInfo> &info) = 0;
     virtual void setRemoteVideoPreferences(const QList<PPayloadInfo> &info) = 0;
 
+    // opens and starts the input devices set, ahead of start()
+    virtual void prewarm()           = 0;
     virtual void start()             = 0;
     virtual void updatePreferences() = 0;
 
@@ -255,18 +301,58 @@ public:
     virtual int  inputVolume() const       = 0; // 0 (mute) to 100
     virtual void setInputVolume(int level) = 0;
 
+    // current receive jitter buffer latency in ms, -1 if not receiving
+    virtual int audioJitterBufferLatency() const = 0;
+    virtual int videoJitterBufferLatency() const = 0;
+
+    virtual PVideoLatency videoLatency() const = 0;
+
+    // cheap enough to poll.  the bitrate is over the time since the
+    //   previous call.
+    virtual PRtpStatistics statistics() = 0;
+
     virtual Error errorCode() const = 0;
 
     virtual RtpChannelContext *audioRtpChannel() = 0;
     virtual RtpChannelContext *videoRtpChannel() = 0;
 
+    // ask the remote to send a video keyframe
+    virtual void requestKeyframe() = 0;
+
+    // while enabled, dumpPipeline() also reports per element timings
+    virtual void setPipelineProfilingEnabled(bool enabled) = 0;
     virtual void dumpPipeline(std::function<void(const QStringList &)> callback) = 0;
 
     HINT_SIGNALS : HINT_METHOD(started()) HINT_METHOD(preferencesUpdated())
                        HINT_METHOD(audioOutputIntensityChanged(int intensity))
                            HINT_METHOD(audioInputIntensityChanged(int intensity)) HINT_METHOD(stoppedRecording())
                                HINT_METHOD(stopped()) HINT_METHOD(finished()) // for file playback only
-                   HINT_METHOD(error())
+                   HINT_METHOD(error()) HINT_METHOD(jitterBufferLatencyChanged())
+};
+
+class RtpRelayContext : public QObjectInterface {
+public:
+    // rtp received on a session is forwarded to all other sessions of the
+    //   relay.  unless playLocally is set, it is not played by the session
+    //   itself.
+    virtual void addSession(RtpSessionContext *session, bool playLocally) = 0;
+    virtual void removeSession(RtpSessionContext *session)                = 0;
+
+    // highest vp8 temporal layer forwarded to the session, -1 for all
+    virtual void setMaximumTemporalLayer(RtpSessionContext *session, int layer) = 0;
+};
+
+class VideoCompositorContext : public QObjectInterface {
+public:
+#ifdef QT_GUI_LIB
+    virtual void setOutputWidget(VideoWidgetContext *widget) = 0;
+#endif
+
+    // remote video of the session goes into a tile of the output widget
+    //   instead of the session's own, from when the session is started
+    virtual void addSession(RtpSessionContext *session)                      = 0;
+    virtual void removeSession(RtpSessionContext *session)                   = 0;
+    virtual void setSessionVisible(RtpSessionContext *session, bool visible) = 0;
 };
 
 class AudioRecorderContext : public QObjectInterface {
@@ -292,10 +378,12 @@ public:
 }; // namespace PsiMedia
 
 Q_DECLARE_INTERFACE(PsiMedia::Plugin, "org.psi-im.psimedia.Plugin/1.6")
-Q_DECLARE_INTERFACE(PsiMedia::Provider, "org.psi-im.psimedia.Provider/1.6")
+Q_DECLARE_INTERFACE(PsiMedia::Provider, "org.psi-im.psimedia.Provider/1.8")
 Q_DECLARE_INTERFACE(PsiMedia::FeaturesContext, "org.psi-im.psimedia.FeaturesContext/1.6")
-Q_DECLARE_INTERFACE(PsiMedia::RtpChannelContext, "org.psi-im.psimedia.RtpChannelContext/1.6")
-Q_DECLARE_INTERFACE(PsiMedia::RtpSessionContext, "org.psi-im.psimedia.RtpSessionContext/1.6")
+Q_DECLARE_INTERFACE(PsiMedia::RtpChannelContext, "org.psi-im.psimedia.RtpChannelContext/1.7")
+Q_DECLARE_INTERFACE(PsiMedia::RtpSessionContext, "org.psi-im.psimedia.RtpSessionContext/1.11")
+Q_DECLARE_INTERFACE(PsiMedia::RtpRelayContext, "org.psi-im.psimedia.RtpRelayContext/1.0")
+Q_DECLARE_INTERFACE(PsiMedia::VideoCompositorContext, "org.psi-im.psimedia.VideoCompositorContext/1.0")
 Q_DECLARE_INTERFACE(PsiMedia::AudioRecorderContext, "org.psi-im.psimedia.AudioRecorderContext/1.4")
 
 #endif // PSIMEDIAPROVIDER_H